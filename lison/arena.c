@@ -0,0 +1,162 @@
+#include "lsn.h"
+
+#include <sys/mman.h>
+
+/**
+ * Bump allocator for LiSON documents.
+ * Memory comes from a list of blocks, each one at least twice the size of
+ * the previous, so a document needs only a logarithmic number of system
+ * allocations and is released with a single lsn_ar_delete.
+ */
+
+#define LSN_AR_ALIGN 8
+#define LSN_AR_HUGE_PAGE (2u << 20)
+
+static size_t lsn_ar_round(size_t size, size_t align)
+{
+	return (size + align - 1) & ~(align - 1);
+}
+
+static lsn_ar_block_t* lsn_ar_block(lsn_arena_t* arena, size_t size)
+{
+	size_t total = lsn_ar_round(sizeof(lsn_ar_block_t) + size, LSN_AR_ALIGN);
+	lsn_ar_block_t* block = NULL;
+	bool mapped = false;
+	if ((arena->flags & LSN_AR_HugePages) && total >= LSN_AR_HUGE_PAGE)
+	{
+		total = lsn_ar_round(total, LSN_AR_HUGE_PAGE);
+		void* data = MAP_FAILED;
+#ifdef MAP_HUGETLB
+		data = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+		// no reserved huge pages: ask for transparent ones
+		if (data == MAP_FAILED)
+		{
+			data = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+			if (data != MAP_FAILED)
+				madvise(data, total, MADV_HUGEPAGE);
+#endif
+		}
+		if (data != MAP_FAILED)
+		{
+			block = (lsn_ar_block_t*)data;
+			mapped = true;
+		}
+	}
+	if (!block)
+		block = (lsn_ar_block_t*)malloc(total);
+	if (!block)
+		return NULL;
+	block->next = arena->head;
+	block->size = total - sizeof(lsn_ar_block_t);
+	block->used = 0;
+	block->mapped = mapped;
+	arena->head = block;
+	LOG("[LSN ARENA] New block of %zu bytes\n", block->size);
+	return block;
+}
+
+static void lsn_ar_free_block(lsn_ar_block_t* block)
+{
+	if (block->mapped)
+		munmap(block, block->size + sizeof(lsn_ar_block_t));
+	else
+		free(block);
+}
+
+// API --------------------------------------------------
+
+void lsn_ar_init(lsn_arena_t* arena, size_t hint, uint8_t flags)
+{
+	arena->head = NULL;
+	arena->flags = flags;
+	arena->next_size = hint > LSN_AR_MIN_BLOCK ? hint : LSN_AR_MIN_BLOCK;
+}
+
+void* lsn_ar_alloc(lsn_arena_t* arena, size_t size)
+{
+	size = lsn_ar_round(size ? size : 1, LSN_AR_ALIGN);
+	lsn_ar_block_t* block = arena->head;
+	if (!block || block->size - block->used < size)
+	{
+		size_t want = arena->next_size;
+		while (want < size)
+			want *= 2;
+		block = lsn_ar_block(arena, want);
+		if (!block)
+			return NULL;
+		if (arena->next_size < LSN_AR_MAX_BLOCK)
+			arena->next_size *= 2;
+	}
+	void* res = block->data + block->used;
+	block->used += size;
+	return res;
+}
+
+char* lsn_ar_strndup(lsn_arena_t* arena, const char* src, size_t len)
+{
+	char* res = (char*)lsn_ar_alloc(arena, len + 1);
+	if (!res)
+		return NULL;
+	memcpy(res, src, len);
+	res[len] = 0;
+	return res;
+}
+
+void lsn_ar_reset(lsn_arena_t* arena)
+{
+	if (!arena || !arena->head)
+		return;
+	// the newest block is the largest one, keep it for the next document
+	lsn_ar_block_t* keep = arena->head;
+	lsn_ar_block_t* it = keep->next;
+	while (it)
+	{
+		lsn_ar_block_t* next = it->next;
+		lsn_ar_free_block(it);
+		it = next;
+	}
+	keep->next = NULL;
+	keep->used = 0;
+}
+
+void lsn_ar_delete(lsn_arena_t* arena)
+{
+	if (!arena)
+		return;
+	lsn_ar_block_t* it = arena->head;
+	while (it)
+	{
+		lsn_ar_block_t* next = it->next;
+		lsn_ar_free_block(it);
+		it = next;
+	}
+	arena->head = NULL;
+}
+
+size_t lsn_ar_size(const lsn_arena_t* arena)
+{
+	size_t res = 0;
+	for (const lsn_ar_block_t* it = arena->head; it; it = it->next)
+		res += it->size;
+	return res;
+}
+
+void lsn_ar_merge(lsn_arena_t* arena, lsn_arena_t* from)
+{
+	if (!from->head)
+		return;
+	lsn_ar_block_t* last = from->head;
+	while (last->next)
+		last = last->next;
+	// behind the head, which keeps serving allocations
+	if (arena->head)
+	{
+		last->next = arena->head->next;
+		arena->head->next = from->head;
+	}
+	else
+		arena->head = from->head;
+	from->head = NULL;
+}
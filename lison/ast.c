@@ -1,5 +1,7 @@
 #include "lsn.h"
 
+static void lsn_delete_nodes(lison_node_t* pending);
+
 // lison list driver code
 void lsn_lst_init(lison_list_t* list)
 {
@@ -11,16 +13,9 @@ void lsn_lst_init(lison_list_t* list)
 void lsn_lst_delete(lison_list_t* list)
 {
 	if (!list) return;
-	lison_node_t* del = list->head;
-	lison_node_t* next = del;
-	while (del)
-	{
-		next = del->next;
-		LOG("[LIST] Deleting object (%d)\n", del->value->tag);
-		lsn_delete(&del->value);
-		free(del);
-		del = next;
-	}
+	if (list->head)
+		free(LSN_LST_INDEX(list));
+	lsn_delete_nodes(list->head);
 	list->head = NULL;
 	list->tail = NULL;
 	LOG("[LIST] Object list deleted\n");
@@ -28,30 +23,34 @@ void lsn_lst_delete(lison_list_t* list)
 
 void lsn_lst_append(lison_list_t* list, lison_t* object)
 {
-	lison_node_t* new = (lison_node_t*)malloc(sizeof(lison_node_t));
+	lsn_ar_lst_append(NULL, list, object);
+}
+
+void lsn_ar_lst_append(lsn_arena_t* arena, lison_list_t* list, lison_t* object)
+{
+	// only the first node has room for the index
+	size_t size = list->head ? sizeof(lison_node_t) : sizeof(lsn_list_head_t);
+	lison_node_t* new = arena
+		? (lison_node_t*)lsn_ar_alloc(arena, size)
+		: (lison_node_t*)malloc(size);
 	new->value = object;
 	LOG("[LIST] Appending object (%d)\n", object->tag);
-	if (list->head == NULL)
+	// the index is rebuilt on the next lookup, arena ones are freed with the arena
+	if (list->head)
 	{
-		new->prev = NULL;
-		new->next = NULL;
-		list->head = new;
-		list->tail = new;
+		if (!arena)
+			free(LSN_LST_INDEX(list));
+		LSN_LST_INDEX(list) = NULL;
 	}
-	else if (list->head == list->tail)
-	{
-		new->prev = list->head;
-		new->next = NULL;
-		list->tail = new;
-		list->head->next = new;
-	}
-	else 
-	{
+	else
+		((lsn_list_head_t*)new)->index = NULL;
+	new->next = NULL;
+	new->prev = list->tail;
+	if (list->head == NULL)
+		list->head = new;
+	else
 		list->tail->next = new;
-		new->prev = list->tail;
-		new->next = NULL;
-		list->tail = new;
-	}
+	list->tail = new;
 }
 
 // lison AST driver code
@@ -60,6 +59,7 @@ lison_t* lsn_string(char* str)
 {
 	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
 	res->tag = LSN_String;
+	res->flags = 0;
 	res->value.string = (char*)malloc(strlen(str) + 1);
 	strcpy(res->value.string, str);
 	return res;
@@ -69,97 +69,237 @@ lison_t* lsn_tag(char* str)
 {
 	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
 	res->tag = LSN_Tag;
+	res->flags = 0;
 	res->value.tag = (char*)malloc(strlen(str) + 1);
 	strcpy(res->value.tag, str);
 	return res;
 }
 
-lison_t* lsn_string_str(const str_t *str)
+static lison_t* lsn_new(lsn_arena_t* arena, lison_tag_t tag)
 {
-	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
-	res->tag = LSN_String;
-	res->value.string = (char*)malloc(str->len + 1);
-	strncpy(res->value.string, str->data, str->len);
-	res->value.string[str->len] = 0;
+	lison_t* res = arena
+		? (lison_t*)lsn_ar_alloc(arena, sizeof(lison_t))
+		: (lison_t*)malloc(sizeof(lison_t));
+	res->tag = tag;
+	res->flags = arena ? LSN_F_Arena : 0;
 	return res;
 }
 
-lison_t* lsn_tag_str(const str_t *str)
+static char* lsn_copy_str(lsn_arena_t* arena, const str_t* str)
 {
-	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
-	res->tag = LSN_Tag;
-	res->value.tag = (char*)malloc(str->len + 1);
-	strncpy(res->value.tag, str->data, str->len);
-	res->value.tag[str->len] = 0;
+	if (arena)
+		return lsn_ar_strndup(arena, str->data, str->len);
+	char* res = (char*)malloc(str->len + 1);
+	memcpy(res, str->data, str->len);
+	res[str->len] = 0;
 	return res;
 }
 
+lison_t* lsn_string_str(const str_t *str)
+{
+	return lsn_ar_string_str(NULL, str);
+}
+
+lison_t* lsn_tag_str(const str_t *str)
+{
+	return lsn_ar_tag_str(NULL, str);
+}
+
 lison_t* lsn_integer(int value)
 {
-	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
-	res->tag = LSN_Integer;
+	return lsn_ar_integer(NULL, value);
+}
+
+lison_t* lsn_float(float value)
+{
+	return lsn_ar_float(NULL, value);
+}
+
+lison_t* lsn_object(lison_list_t list)
+{
+	return lsn_ar_object(NULL, list);
+}
+
+lison_t* lsn_int_array(const int32_t* values, size_t len)
+{
+	return lsn_ar_int_array(NULL, values, len);
+}
+
+lison_t* lsn_float_array(const float* values, size_t len)
+{
+	return lsn_ar_float_array(NULL, values, len);
+}
+
+lison_t* lsn_ar_string_str(lsn_arena_t* arena, const str_t* str)
+{
+	lison_t* res = lsn_new(arena, LSN_String);
+	res->value.string = lsn_copy_str(arena, str);
+	return res;
+}
+
+lison_t* lsn_ar_tag_str(lsn_arena_t* arena, const str_t* str)
+{
+	lison_t* res = lsn_new(arena, LSN_Tag);
+	res->value.tag = lsn_copy_str(arena, str);
+	return res;
+}
+
+lison_t* lsn_ar_string_ref(lsn_arena_t* arena, lison_tag_t tag, const str_t* str)
+{
+	lison_t* res = lsn_new(arena, tag);
+	res->flags |= LSN_F_Borrowed;
+	res->value.slice = *str;
+	return res;
+}
+
+lison_t* lsn_ar_integer(lsn_arena_t* arena, int value)
+{
+	lison_t* res = lsn_new(arena, LSN_Integer);
 	res->value.integer = value;
 	return res;
 }
 
-lison_t* lsn_float(float value)
+lison_t* lsn_ar_float(lsn_arena_t* arena, float value)
 {
-	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
-	res->tag = LSN_Float;
-	res->value.lsn_float= value;
+	lison_t* res = lsn_new(arena, LSN_Float);
+	res->value.lsn_float = value;
 	return res;
 }
 
-lison_t* lsn_object(lison_list_t list)
+lison_t* lsn_ar_object(lsn_arena_t* arena, lison_list_t list)
 {
-	lison_t* res = (lison_t*)malloc(sizeof(lison_t));
-	res->tag = LSN_Object;
+	lison_t* res = lsn_new(arena, LSN_Object);
 	res->value.object = list;
 	return res;
 }
 
-void lsn_delete(lison_t** object)
+static void* lsn_array_alloc(lsn_arena_t* arena, size_t size)
 {
-	if (!*object || !object) return;
-	LOG("[LISON] Deleting object (%d)\n", (*object)->tag);
-	switch ((*object)->tag)
+	// at least one byte, so the data is never NULL
+	return arena ? lsn_ar_alloc(arena, size) : malloc(size ? size : 1);
+}
+
+lison_t* lsn_ar_int_array(lsn_arena_t* arena, const int32_t* values, size_t len)
+{
+	lison_t* res = lsn_new(arena, LSN_IntArray);
+	res->value.array.ints = (int32_t*)lsn_array_alloc(arena, len * sizeof(int32_t));
+	res->value.array.len = len;
+	if (values && len)
+		memcpy(res->value.array.ints, values, len * sizeof(int32_t));
+	return res;
+}
+
+lison_t* lsn_ar_float_array(lsn_arena_t* arena, const float* values, size_t len)
+{
+	lison_t* res = lsn_new(arena, LSN_FloatArray);
+	res->value.array.floats = (float*)lsn_array_alloc(arena, len * sizeof(float));
+	res->value.array.len = len;
+	if (values && len)
+		memcpy(res->value.array.floats, values, len * sizeof(float));
+	return res;
+}
+
+lison_t* lsn_ar_pack(lsn_arena_t* arena, const lison_list_t* list)
+{
+	if (!list->head)
+		return NULL;
+	lison_tag_t kind = list->head->value->tag;
+	if (kind != LSN_Integer && kind != LSN_Float)
+		return NULL;
+	size_t len = 0;
+	for (const lison_node_t* it = list->head; it; it = it->next, len++)
+	{
+		if (it->value->tag != kind)
+			return NULL;
+	}
+	lison_t* res = kind == LSN_Integer ? lsn_ar_int_array(arena, NULL, len) : lsn_ar_float_array(arena, NULL, len);
+	size_t i = 0;
+	for (const lison_node_t* it = list->head; it; it = it->next, i++)
+	{
+		if (kind == LSN_Integer)
+			res->value.array.ints[i] = it->value->value.integer;
+		else
+			res->value.array.floats[i] = it->value->value.lsn_float;
+	}
+	return res;
+}
+
+/**
+ * Frees what a value owns, except the items of a list.
+ */
+static void lsn_delete_payload(lison_t* object)
+{
+	switch (object->tag)
 	{
-	case LSN_Object:
-		lsn_lst_delete(&(*object)->value.object);
-		break;
 	case LSN_String:
-		free((*object)->value.string);
-		break;
 	case LSN_Tag:
-		free((*object)->value.tag);
+		if (!(object->flags & (LSN_F_Borrowed | LSN_F_Interned)))
+			free(object->value.string);
+		break;
+	case LSN_IntArray:
+	case LSN_FloatArray:
+		free(object->value.array.ints);
 		break;
 	default:
 		break;
 	}
-	free(*object);
-	*object = NULL;
 }
 
-void lsn_print(lison_t* object)
+/**
+ * Frees a chain of nodes and their values without recursion: the items
+ * of a deleted list are spliced in front of the nodes still pending.
+ */
+static void lsn_delete_nodes(lison_node_t* pending)
 {
-	if (!object) return;
-	switch(object->tag)
+	while (pending)
 	{
-	case LSN_Object:
-	{
-		printf("(");
-		lison_node_t* act = object->value.object.head;
-		while (act)
+		lison_node_t* node = pending;
+		lison_t* value = node->value;
+		pending = node->next;
+		free(node);
+		// arena documents are released as a whole by lsn_doc_delete
+		if (value->flags & LSN_F_Arena)
+			continue;
+		LOG("[LIST] Deleting object (%d)\n", value->tag);
+		if (value->tag == LSN_Object && value->value.object.head)
 		{
-			lsn_print(act->value);
-			act = act->next;
+			lison_list_t* list = &value->value.object;
+			free(LSN_LST_INDEX(list));
+			list->tail->next = pending;
+			pending = list->head;
 		}
-		printf(")");
-		break;
+		else
+			lsn_delete_payload(value);
+		free(value);
 	}
+}
+
+void lsn_delete(lison_t** object)
+{
+	if (!object || !*object) return;
+	// arena documents are released as a whole by lsn_doc_delete
+	if ((*object)->flags & LSN_F_Arena)
+	{
+		*object = NULL;
+		return;
+	}
+	LOG("[LISON] Deleting object (%d)\n", (*object)->tag);
+	if ((*object)->tag == LSN_Object)
+		lsn_lst_delete(&(*object)->value.object);
+	else
+		lsn_delete_payload(*object);
+	free(*object);
+	*object = NULL;
+}
+
+static void lsn_print_atom(const lison_t* object)
+{
+	switch(object->tag)
+	{
 	case LSN_String:
 	{
-		printf("'%s'", object->value.string);
+		str_t str = lsn_str(object);
+		printf("'%.*s'", (int)str.len, str.data);
 		break;
 	}
 	case LSN_Integer:
@@ -174,7 +314,22 @@ void lsn_print(lison_t* object)
 	}
 	case LSN_Tag:
 	{
-		printf(":%s", object->value.tag);
+		str_t str = lsn_str(object);
+		printf(":%.*s", (int)str.len, str.data);
+		break;
+	}
+	case LSN_IntArray:
+	case LSN_FloatArray:
+	{
+		printf("(");
+		for (size_t i = 0; i < object->value.array.len; i++)
+		{
+			if (object->tag == LSN_IntArray)
+				printf("%d ", object->value.array.ints[i]);
+			else
+				printf("%f ", object->value.array.floats[i]);
+		}
+		printf(")");
 		break;
 	}
 	default:
@@ -182,3 +337,139 @@ void lsn_print(lison_t* object)
 	}
 	printf(" ");
 }
+
+void lsn_print(lison_t* object)
+{
+	if (!object) return;
+	// the next item of every open list, like lsn_walk in binary.c
+	const lison_node_t* local[LSN_LOCAL_DEPTH];
+	const lison_node_t** stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	while (true)
+	{
+		if (object->tag == LSN_Object)
+		{
+			printf("(");
+			if (top == cap)
+			{
+				const lison_node_t** grown = (const lison_node_t**)malloc(2 * cap * sizeof(lison_node_t*));
+				memcpy(grown, stack, top * sizeof(lison_node_t*));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+			stack[top++] = object->value.object.head;
+		}
+		else
+			lsn_print_atom(object);
+		while (top > 0 && !stack[top - 1])
+		{
+			printf(") ");
+			top--;
+		}
+		if (top == 0)
+			break;
+		object = stack[top - 1]->value;
+		stack[top - 1] = stack[top - 1]->next;
+	}
+	if (stack != local)
+		free(stack);
+}
+
+str_t lsn_str(const lison_t* object)
+{
+	if (!object || (object->tag != LSN_String && object->tag != LSN_Tag))
+		return (str_t) { .data = NULL, .len = 0 };
+	if (object->flags & LSN_F_Borrowed)
+		return object->value.slice;
+	if (object->flags & LSN_F_Interned)
+		return (str_t) { .data = (char*)object->value.sym.name, .len = object->value.sym.len };
+	return (str_t) { .data = object->value.string, .len = strlen(object->value.string) };
+}
+
+/**
+ * Copy of a value, lists are copied empty.
+ */
+static lison_t* lsn_detach_one(const lison_t* object)
+{
+	switch (object->tag)
+	{
+	case LSN_Object:
+	{
+		lison_list_t list;
+		lsn_lst_init(&list);
+		return lsn_object(list);
+	}
+	case LSN_String:
+	{
+		str_t str = lsn_str(object);
+		return lsn_string_str(&str);
+	}
+	case LSN_Tag:
+	{
+		str_t str = lsn_str(object);
+		return lsn_tag_str(&str);
+	}
+	case LSN_Integer:
+		return lsn_integer(object->value.integer);
+	case LSN_Float:
+		return lsn_float(object->value.lsn_float);
+	case LSN_IntArray:
+		return lsn_int_array(object->value.array.ints, object->value.array.len);
+	case LSN_FloatArray:
+		return lsn_float_array(object->value.array.floats, object->value.array.len);
+	default:
+		return NULL;
+	}
+}
+
+typedef struct _lsn_detach_frame_t
+{
+	const lison_node_t* it; // next item to copy
+	lison_t* copy;          // the list it is copied into
+} lsn_detach_frame_t;
+
+lison_t* lsn_detach(const lison_t* object)
+{
+	if (!object)
+		return NULL;
+	lison_t* root = lsn_detach_one(object);
+	if (object->tag != LSN_Object)
+		return root;
+
+	lsn_detach_frame_t local[LSN_LOCAL_DEPTH];
+	lsn_detach_frame_t* frames = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	frames[top++] = (lsn_detach_frame_t) { .it = object->value.object.head, .copy = root };
+	while (top > 0)
+	{
+		lsn_detach_frame_t* frame = &frames[top - 1];
+		if (!frame->it)
+		{
+			top--;
+			continue;
+		}
+		const lison_t* value = frame->it->value;
+		frame->it = frame->it->next;
+		lison_t* copy = lsn_detach_one(value);
+		lsn_lst_append(&frame->copy->value.object, copy);
+		if (value->tag != LSN_Object)
+			continue;
+		if (top == cap)
+		{
+			lsn_detach_frame_t* grown = (lsn_detach_frame_t*)malloc(2 * cap * sizeof(lsn_detach_frame_t));
+			memcpy(grown, frames, top * sizeof(lsn_detach_frame_t));
+			if (frames != local)
+				free(frames);
+			frames = grown;
+			cap *= 2;
+		}
+		frames[top++] = (lsn_detach_frame_t) { .it = value->value.object.head, .copy = copy };
+	}
+	if (frames != local)
+		free(frames);
+	return root;
+}
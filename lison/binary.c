@@ -0,0 +1,503 @@
+#include "lsn.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Binary encoding of LiSON documents.
+ *
+ * "LSNB" <version byte>
+ * <varint tags> { <varint len> <bytes> }   tag table, ids in order
+ * <value>
+ *
+ * <value> ::= 0 <varint count> <value>...   object
+ *           | 1 <varint len> <bytes>        string
+ *           | 2 <int32 little endian>       integer
+ *           | 3 <float32 little endian>     float
+ *           | 4 <varint id>                 tag
+ *           | 5 <varint count> <int32>...   packed integers
+ *           | 6 <varint count> <float32>... packed floats
+ *
+ * The leading byte of a value is its lison_tag_t. Varints are LEB128.
+ */
+
+#define LSN_BIN_MAGIC "LSNB"
+#define LSN_BIN_VERSION 1
+
+static void lsn_buf_reserve(lsn_buffer_t* buf, size_t more)
+{
+	if (buf->len + more <= buf->cap)
+		return;
+	size_t cap = buf->cap ? 2 * buf->cap : 4096;
+	while (cap < buf->len + more)
+		cap *= 2;
+	buf->data = (char*)realloc(buf->data, cap);
+	buf->cap = cap;
+}
+
+static void lsn_buf_varint(lsn_buffer_t* buf, uint64_t value)
+{
+	lsn_buf_reserve(buf, 10);
+	while (value >= 0x80)
+	{
+		buf->data[buf->len++] = (char)(value | 0x80);
+		value >>= 7;
+	}
+	buf->data[buf->len++] = (char)value;
+}
+
+static void lsn_buf_bytes(lsn_buffer_t* buf, const void* data, size_t len)
+{
+	lsn_buf_reserve(buf, len);
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+}
+
+static void lsn_buf_u32(lsn_buffer_t* buf, uint32_t value)
+{
+	unsigned char le[4] = {
+		(unsigned char)value, (unsigned char)(value >> 8),
+		(unsigned char)(value >> 16), (unsigned char)(value >> 24),
+	};
+	lsn_buf_bytes(buf, le, 4);
+}
+
+static size_t lsn_lst_count(const lison_list_t* list)
+{
+	size_t len = 0;
+	for (const lison_node_t* it = list->head; it; it = it->next)
+		len++;
+	return len;
+}
+
+/**
+ * Preorder walk with an explicit stack, calling back on every value.
+ */
+typedef void (*lsn_visit_t)(void* ctx, const lison_t* object);
+
+static void lsn_walk(const lison_t* root, lsn_visit_t visit, void* ctx)
+{
+	const lison_node_t* local[LSN_LOCAL_DEPTH];
+	const lison_node_t** stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	const lison_t* object = root;
+	while (true)
+	{
+		visit(ctx, object);
+		if (object->tag == LSN_Object)
+		{
+			if (top == cap)
+			{
+				const lison_node_t** grown = (const lison_node_t**)malloc(2 * cap * sizeof(lison_node_t*));
+				memcpy(grown, stack, top * sizeof(lison_node_t*));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+			stack[top++] = object->value.object.head;
+		}
+		while (top > 0 && !stack[top - 1])
+			top--;
+		if (top == 0)
+			break;
+		object = stack[top - 1]->value;
+		stack[top - 1] = stack[top - 1]->next;
+	}
+	if (stack != local)
+		free(stack);
+}
+
+typedef struct _lsn_encoder_t
+{
+	lsn_buffer_t* out;
+	lsn_symtab_t tags;
+} lsn_encoder_t;
+
+static void lsn_enc_tags(void* ctx, const lison_t* object)
+{
+	lsn_encoder_t* enc = (lsn_encoder_t*)ctx;
+	if (object->tag == LSN_Tag)
+	{
+		str_t name = lsn_str(object);
+		lsn_sym_intern(&enc->tags, name.data, name.len);
+	}
+}
+
+static void lsn_enc_value(void* ctx, const lison_t* object)
+{
+	lsn_encoder_t* enc = (lsn_encoder_t*)ctx;
+	lsn_buffer_t* out = enc->out;
+	lsn_buf_reserve(out, 1);
+	out->data[out->len++] = (char)object->tag;
+	switch (object->tag)
+	{
+	case LSN_Object:
+		lsn_buf_varint(out, lsn_lst_count(&object->value.object));
+		break;
+	case LSN_String:
+	{
+		str_t str = lsn_str(object);
+		lsn_buf_varint(out, str.len);
+		lsn_buf_bytes(out, str.data, str.len);
+		break;
+	}
+	case LSN_Integer:
+		lsn_buf_u32(out, (uint32_t)object->value.integer);
+		break;
+	case LSN_Float:
+	{
+		uint32_t bits;
+		memcpy(&bits, &object->value.lsn_float, sizeof(bits));
+		lsn_buf_u32(out, bits);
+		break;
+	}
+	case LSN_Tag:
+	{
+		str_t name = lsn_str(object);
+		uint32_t id = 0;
+		lsn_sym_find(&enc->tags, name.data, name.len, &id);
+		lsn_buf_varint(out, id);
+		break;
+	}
+	case LSN_IntArray:
+	case LSN_FloatArray:
+	{
+		size_t len = object->value.array.len;
+		lsn_buf_varint(out, len);
+		lsn_buf_reserve(out, 4 * len);
+		for (size_t i = 0; i < len; i++)
+		{
+			uint32_t bits;
+			if (object->tag == LSN_IntArray)
+				bits = (uint32_t)object->value.array.ints[i];
+			else
+				memcpy(&bits, &object->value.array.floats[i], sizeof(bits));
+			lsn_buf_u32(out, bits);
+		}
+		break;
+	}
+	}
+}
+
+// DECODER --------------------------------------------------
+
+typedef struct _lsn_decoder_t
+{
+	const unsigned char* it;
+	const unsigned char* end;
+	bool failed;
+} lsn_decoder_t;
+
+static uint64_t lsn_dec_varint(lsn_decoder_t* dec)
+{
+	uint64_t value = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7)
+	{
+		if (dec->it == dec->end)
+			break;
+		unsigned char byte = *dec->it++;
+		value |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+			return value;
+	}
+	dec->failed = true;
+	return 0;
+}
+
+static uint32_t lsn_dec_u32(lsn_decoder_t* dec)
+{
+	if (dec->end - dec->it < 4)
+	{
+		dec->failed = true;
+		return 0;
+	}
+	const unsigned char* b = dec->it;
+	dec->it += 4;
+	return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+static const char* lsn_dec_bytes(lsn_decoder_t* dec, size_t len)
+{
+	if ((size_t)(dec->end - dec->it) < len)
+	{
+		dec->failed = true;
+		return NULL;
+	}
+	const char* res = (const char*)dec->it;
+	dec->it += len;
+	return res;
+}
+
+// an open object while decoding
+typedef struct _lsn_dec_frame_t
+{
+	lison_list_t list;
+	uint64_t left;
+} lsn_dec_frame_t;
+
+static lison_t* lsn_decode(lsn_arena_t* arena, lsn_symtab_t* symbols, const char* data, size_t len, size_t max_depth)
+{
+	lsn_decoder_t dec = {
+		.it = (const unsigned char*)data,
+		.end = (const unsigned char*)data + len,
+		.failed = false,
+	};
+	const char* magic = lsn_dec_bytes(&dec, 5);
+	if (!magic || memcmp(magic, LSN_BIN_MAGIC, 4) != 0 || magic[4] != LSN_BIN_VERSION)
+		return NULL;
+
+	// tag table, the names stay in the input until the values copy them
+	uint64_t tags_len = lsn_dec_varint(&dec);
+	if (dec.failed || tags_len > len)
+		return NULL;
+	str_t* tags = (str_t*)malloc((tags_len ? tags_len : 1) * sizeof(str_t));
+	for (uint64_t i = 0; i < tags_len && !dec.failed; i++)
+	{
+		tags[i].len = lsn_dec_varint(&dec);
+		tags[i].data = (char*)lsn_dec_bytes(&dec, tags[i].len);
+	}
+
+	lsn_dec_frame_t local[LSN_LOCAL_DEPTH];
+	lsn_dec_frame_t* stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	lison_t* root = NULL;
+	while (!dec.failed && !root)
+	{
+		if (dec.it == dec.end)
+		{
+			dec.failed = true;
+			break;
+		}
+		lison_t* object = NULL;
+		switch (*dec.it++)
+		{
+		case LSN_Object:
+		{
+			uint64_t count = lsn_dec_varint(&dec);
+			// every child takes at least two bytes
+			if (dec.failed || count > (uint64_t)(dec.end - dec.it) || top >= max_depth)
+			{
+				dec.failed = true;
+				break;
+			}
+			if (count == 0)
+			{
+				lison_list_t empty;
+				lsn_lst_init(&empty);
+				object = lsn_ar_object(arena, empty);
+				break;
+			}
+			if (top == cap)
+			{
+				lsn_dec_frame_t* grown = (lsn_dec_frame_t*)malloc(2 * cap * sizeof(lsn_dec_frame_t));
+				memcpy(grown, stack, top * sizeof(lsn_dec_frame_t));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+			lsn_lst_init(&stack[top].list);
+			stack[top++].left = count;
+			break;
+		}
+		case LSN_String:
+		{
+			str_t str = { .len = lsn_dec_varint(&dec) };
+			str.data = (char*)lsn_dec_bytes(&dec, str.len);
+			if (!dec.failed)
+				object = lsn_ar_string_str(arena, &str);
+			break;
+		}
+		case LSN_Integer:
+		{
+			uint32_t bits = lsn_dec_u32(&dec);
+			if (!dec.failed)
+				object = lsn_ar_integer(arena, (int32_t)bits);
+			break;
+		}
+		case LSN_Float:
+		{
+			uint32_t bits = lsn_dec_u32(&dec);
+			float value;
+			memcpy(&value, &bits, sizeof(value));
+			if (!dec.failed)
+				object = lsn_ar_float(arena, value);
+			break;
+		}
+		case LSN_Tag:
+		{
+			uint64_t id = lsn_dec_varint(&dec);
+			if (dec.failed || id >= tags_len)
+			{
+				dec.failed = true;
+				break;
+			}
+			object = symbols
+				? lsn_ar_tag_sym(arena, symbols, &tags[id])
+				: lsn_ar_tag_str(arena, &tags[id]);
+			break;
+		}
+		case LSN_IntArray:
+		case LSN_FloatArray:
+		{
+			bool ints = dec.it[-1] == LSN_IntArray;
+			uint64_t count = lsn_dec_varint(&dec);
+			if (dec.failed || count > (uint64_t)(dec.end - dec.it) / 4)
+			{
+				dec.failed = true;
+				break;
+			}
+			object = ints ? lsn_ar_int_array(arena, NULL, count) : lsn_ar_float_array(arena, NULL, count);
+			for (uint64_t i = 0; i < count; i++)
+			{
+				uint32_t bits = lsn_dec_u32(&dec);
+				if (ints)
+					object->value.array.ints[i] = (int32_t)bits;
+				else
+					memcpy(&object->value.array.floats[i], &bits, sizeof(bits));
+			}
+			break;
+		}
+		default:
+			dec.failed = true;
+			break;
+		}
+
+		if (!object)
+			continue;
+
+		// attach the value, closing the objects it completes
+		while (true)
+		{
+			if (top == 0)
+			{
+				root = object;
+				break;
+			}
+			lsn_ar_lst_append(arena, &stack[top - 1].list, object);
+			if (--stack[top - 1].left > 0)
+				break;
+			object = lsn_ar_object(arena, stack[--top].list);
+		}
+	}
+
+	if (root && dec.it != dec.end)
+	{
+		// trailing bytes
+		dec.failed = true;
+		if (!arena)
+			lsn_delete(&root);
+		root = NULL;
+	}
+	while (top > 0 && !arena)
+		lsn_lst_delete(&stack[--top].list);
+	if (stack != local)
+		free(stack);
+	free(tags);
+	return dec.failed ? NULL : root;
+}
+
+// API --------------------------------------------------
+
+bool lsn_encode_binary(const lison_t* lison, lsn_buffer_t* out)
+{
+	if (!lison || !out)
+		return false;
+	lsn_encoder_t enc = { .out = out };
+	lsn_sym_init(&enc.tags, false);
+	lsn_walk(lison, lsn_enc_tags, &enc);
+
+	lsn_buf_bytes(out, LSN_BIN_MAGIC, 4);
+	lsn_buf_reserve(out, 1);
+	out->data[out->len++] = LSN_BIN_VERSION;
+	lsn_buf_varint(out, enc.tags.len);
+	for (uint32_t id = 0; id < enc.tags.len; id++)
+	{
+		lsn_buf_varint(out, enc.tags.symbols[id].len);
+		lsn_buf_bytes(out, enc.tags.symbols[id].name, enc.tags.symbols[id].len);
+	}
+	lsn_walk(lison, lsn_enc_value, &enc);
+	lsn_sym_delete(&enc.tags);
+	return true;
+}
+
+lison_t* lsn_decode_binary(const char* data, size_t len)
+{
+	if (!data)
+		return NULL;
+	return lsn_decode(NULL, NULL, data, len, LSN_MAX_DEPTH);
+}
+
+lsn_doc_t* lsn_decode_binary_doc(const char* data, size_t len, const lsn_options_t* opt)
+{
+	if (!data)
+		return NULL;
+	// decoded trees are a few times larger than the encoding
+	lsn_doc_t* doc = lsn_doc_new(4 * len, opt);
+	size_t max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	doc->root = lsn_decode(&doc->arena, doc->symbols, data, len, max_depth);
+	if (!doc->root)
+		lsn_doc_delete(&doc);
+	return doc;
+}
+
+void lsn_buffer_delete(lsn_buffer_t* buf)
+{
+	if (!buf)
+		return;
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = 0;
+	buf->cap = 0;
+}
+
+bool lsn_text_to_binary(char* in_path, char* out_path)
+{
+	lison_t* lison = lsn_deserialize(in_path);
+	if (!lison)
+		return false;
+	lsn_buffer_t buf = { NULL, 0, 0 };
+	lsn_encode_binary(lison, &buf);
+	lsn_delete(&lison);
+
+	bool res = false;
+	int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0)
+	{
+		size_t done = 0;
+		ssize_t wrote = 0;
+		while (done < buf.len && (wrote = write(fd, buf.data + done, buf.len - done)) > 0)
+			done += (size_t)wrote;
+		res = close(fd) == 0 && done == buf.len;
+	}
+	lsn_buffer_delete(&buf);
+	return res;
+}
+
+bool lsn_binary_to_text(char* in_path, char* out_path)
+{
+	int fd = open(in_path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	size_t len = (size_t)st.st_size;
+	void* data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	lsn_doc_t* doc = lsn_decode_binary_doc((const char*)data, len, NULL);
+	bool res = doc && lsn_serialize(out_path, doc->root);
+	lsn_doc_delete(&doc);
+	munmap(data, len);
+	return res;
+}
@@ -0,0 +1,155 @@
+#include "lsn.h"
+
+/**
+ * Columnar extraction of records.
+ * A first pass looks up every requested tag in every record, keeping the
+ * values in a table of cells, and settles the type of the columns and the
+ * size of the string blobs. The second pass copies the cells into arrays
+ * allocated once at their final size.
+ * Integer columns that also hold floats become float columns.
+ * The tags are looked up as keys (see lsn_key_get), so records with
+ * interned tags are matched by id.
+ */
+
+static void lsn_col_reset(lsn_column_t* col, const char* tag)
+{
+	col->tag = tag;
+	col->type = LSN_Object;
+	col->ints = NULL;
+	col->floats = NULL;
+	col->offsets = NULL;
+	col->data = NULL;
+}
+
+/**
+ * The type of a column after seeing value. LSN_Object is the type of a
+ * column that has no values yet.
+ * Returns false if the value cannot be in the column.
+ */
+static bool lsn_col_type(lsn_column_t* col, const lison_t* value)
+{
+	lison_tag_t tag = value->tag;
+	if (tag != LSN_Integer && tag != LSN_Float && tag != LSN_String && tag != LSN_Tag)
+		return false;
+	if (col->type == LSN_Object || col->type == tag)
+	{
+		col->type = tag;
+		return true;
+	}
+	bool numbers = (col->type == LSN_Integer || col->type == LSN_Float) && (tag == LSN_Integer || tag == LSN_Float);
+	if (numbers)
+		col->type = LSN_Float;
+	return numbers;
+}
+
+// API --------------------------------------------------
+
+bool lsn_to_columns(const lison_t* list, const char** tags, size_t n, lsn_columns_t* out)
+{
+	out->rows = 0;
+	out->len = 0;
+	out->columns = NULL;
+	if (!list || list->tag != LSN_Object || !tags || n == 0)
+		return false;
+	size_t rows = 0;
+	for (const lison_node_t* it = list->value.object.head; it; it = it->next)
+		rows++;
+	out->columns = (lsn_column_t*)malloc(n * sizeof(lsn_column_t));
+	out->len = n;
+	out->rows = rows;
+	for (size_t c = 0; c < n; c++)
+		lsn_col_reset(&out->columns[c], tags[c]);
+
+	// types and blob sizes
+	const lison_t** cells = (const lison_t**)malloc((rows ? rows : 1) * n * sizeof(lison_t*));
+	size_t* lens = (size_t*)calloc(n, sizeof(size_t));
+	lsn_key_t* keys = (lsn_key_t*)malloc(n * sizeof(lsn_key_t));
+	for (size_t c = 0; c < n; c++)
+		lsn_key_init(&keys[c], tags[c], tags[c] ? strlen(tags[c]) : 0);
+	bool res = true;
+	const lison_t** cell = cells;
+	for (const lison_node_t* it = list->value.object.head; it && res; it = it->next)
+	{
+		for (size_t c = 0; c < n && res; c++, cell++)
+		{
+			*cell = tags[c] ? lsn_key_get(it->value, &keys[c]) : NULL;
+			res = *cell && lsn_col_type(&out->columns[c], *cell);
+			if (res && ((*cell)->tag == LSN_String || (*cell)->tag == LSN_Tag))
+				lens[c] += lsn_str(*cell).len;
+		}
+	}
+	free(keys);
+	if (!res)
+	{
+		LOG("[LSN COLUMNS] A record without a tag or with a value of another kind\n");
+		free(cells);
+		free(lens);
+		lsn_columns_delete(out);
+		return false;
+	}
+
+	for (size_t c = 0; c < n; c++)
+	{
+		lsn_column_t* col = &out->columns[c];
+		if (col->type == LSN_Integer)
+			col->ints = (int32_t*)malloc((rows ? rows : 1) * sizeof(int32_t));
+		else if (col->type == LSN_Float)
+			col->floats = (float*)malloc((rows ? rows : 1) * sizeof(float));
+		else if (col->type != LSN_Object)
+		{
+			col->offsets = (size_t*)malloc((rows + 1) * sizeof(size_t));
+			col->offsets[0] = 0;
+			col->data = (char*)malloc(lens[c] ? lens[c] : 1);
+		}
+	}
+	free(lens);
+
+	// one column at a time, so every array is written in order
+	for (size_t c = 0; c < n; c++)
+	{
+		lsn_column_t* col = &out->columns[c];
+		for (size_t row = 0; row < rows; row++)
+		{
+			const lison_t* value = cells[row * n + c];
+			switch (col->type)
+			{
+			case LSN_Integer:
+				col->ints[row] = value->value.integer;
+				break;
+			case LSN_Float:
+				col->floats[row] = value->tag == LSN_Integer ? (float)value->value.integer : value->value.lsn_float;
+				break;
+			case LSN_String:
+			case LSN_Tag:
+			{
+				str_t str = lsn_str(value);
+				memcpy(col->data + col->offsets[row], str.data, str.len);
+				col->offsets[row + 1] = col->offsets[row] + str.len;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+	free(cells);
+	return true;
+}
+
+void lsn_columns_delete(lsn_columns_t* columns)
+{
+	if (!columns)
+		return;
+	for (size_t c = 0; c < columns->len; c++)
+	{
+		lsn_column_t* col = &columns->columns[c];
+		free(col->ints);
+		free(col->floats);
+		free(col->offsets);
+		free(col->data);
+	}
+	free(columns->columns);
+	columns->columns = NULL;
+	columns->len = 0;
+	columns->rows = 0;
+}
@@ -0,0 +1,290 @@
+// generated by lsngen, do not edit
+#include "records.h"
+
+static inline bool decode_string(const lsn_reader_t* reader, str_t* out)
+{
+	*out = reader->event.value.string;
+	return reader->event.tag == LSN_EV_String;
+}
+
+static inline bool decode_tag(const lsn_reader_t* reader, str_t* out)
+{
+	*out = reader->event.value.tag;
+	return reader->event.tag == LSN_EV_Tag;
+}
+
+static inline bool decode_int(const lsn_reader_t* reader, int32_t* out)
+{
+	*out = reader->event.value.integer;
+	return reader->event.tag == LSN_EV_Integer;
+}
+
+// integers are taken as floats too
+static inline bool decode_float(const lsn_reader_t* reader, float* out)
+{
+	if (reader->event.tag == LSN_EV_Integer)
+		*out = (float)reader->event.value.integer;
+	else
+		*out = reader->event.value.lsn_float;
+	return reader->event.tag == LSN_EV_Integer || reader->event.tag == LSN_EV_Float;
+}
+
+static int point_field(const str_t* tag)
+{
+	switch (tag->len)
+	{
+	case 1:
+		if (memcmp(tag->data, "x", 1) == 0)
+			return 0;
+		if (memcmp(tag->data, "y", 1) == 0)
+			return 1;
+		break;
+	default:
+		break;
+	}
+	return -1;
+}
+
+bool point_decode(lsn_reader_t* reader, point_t* out)
+{
+	memset(out, 0, sizeof(*out));
+	if (reader->event.tag != LSN_EV_ObjectStart)
+		return false;
+	uint64_t seen = 0;
+	bool ok = true;
+	while (ok && lsn_next(reader) == LSN_EV_Tag)
+	{
+		int field = point_field(&reader->event.value.tag);
+		ok = field >= 0 && !(seen >> field & 1);
+		if (!ok)
+			break;
+		seen |= (uint64_t)1 << field;
+		lsn_next(reader);
+		switch (field)
+		{
+		case 0:
+			ok = decode_float(reader, &out->x);
+			break;
+		case 1:
+			ok = decode_float(reader, &out->y);
+			break;
+		default:
+			break;
+		}
+	}
+	if (!ok || reader->event.tag != LSN_EV_ObjectEnd || seen != 0x3ull)
+	{
+		point_free(out);
+		return false;
+	}
+	return true;
+}
+
+bool point_parse(char* src, size_t len, point_t* out)
+{
+	lsn_reader_t reader;
+	lsn_reader_init(&reader, src, len, NULL);
+	lsn_next(&reader);
+	if (!point_decode(&reader, out))
+		return false;
+	if (lsn_next(&reader) != LSN_EV_End)
+	{
+		point_free(out);
+		return false;
+	}
+	return true;
+}
+
+void point_free(point_t* value)
+{
+	memset(value, 0, sizeof(*value));
+}
+
+void point_encode(lsn_writer_t* w, const point_t* value)
+{
+	lsn_writer_raw(w, "(:x ", 4);
+	lsn_writer_float(w, value->x);
+	lsn_writer_raw(w, " :y ", 4);
+	lsn_writer_float(w, value->y);
+	lsn_writer_raw(w, ")", 1);
+}
+
+bool point_write(int fd, const point_t* value)
+{
+	lsn_writer_t* w = lsn_writer_new(fd);
+	point_encode(w, value);
+	return lsn_writer_delete(&w);
+}
+
+static int person_field(const str_t* tag)
+{
+	switch (tag->len)
+	{
+	case 4:
+		if (memcmp(tag->data, "name", 4) == 0)
+			return 0;
+		if (memcmp(tag->data, "tags", 4) == 0)
+			return 2;
+		if (memcmp(tag->data, "home", 4) == 0)
+			return 3;
+		break;
+	case 3:
+		if (memcmp(tag->data, "age", 3) == 0)
+			return 1;
+		break;
+	case 6:
+		if (memcmp(tag->data, "visits", 6) == 0)
+			return 4;
+		if (memcmp(tag->data, "scores", 6) == 0)
+			return 5;
+		break;
+	default:
+		break;
+	}
+	return -1;
+}
+
+bool person_decode(lsn_reader_t* reader, person_t* out)
+{
+	memset(out, 0, sizeof(*out));
+	if (reader->event.tag != LSN_EV_ObjectStart)
+		return false;
+	uint64_t seen = 0;
+	bool ok = true;
+	while (ok && lsn_next(reader) == LSN_EV_Tag)
+	{
+		int field = person_field(&reader->event.value.tag);
+		ok = field >= 0 && !(seen >> field & 1);
+		if (!ok)
+			break;
+		seen |= (uint64_t)1 << field;
+		lsn_next(reader);
+		switch (field)
+		{
+		case 0:
+			ok = decode_string(reader, &out->name);
+			break;
+		case 1:
+			ok = decode_int(reader, &out->age);
+			break;
+		case 2:
+		{
+			ok = reader->event.tag == LSN_EV_ObjectStart;
+			for (size_t cap = 0; ok && lsn_next(reader) != LSN_EV_ObjectEnd; out->tags_len++)
+			{
+				if (out->tags_len == cap)
+				{
+					cap = cap ? 2 * cap : 8;
+					out->tags = (str_t*)realloc(out->tags, cap * sizeof(str_t));
+				}
+				ok = decode_tag(reader, &out->tags[out->tags_len]);
+			}
+			break;
+		}
+		case 3:
+			ok = point_decode(reader, &out->home);
+			break;
+		case 4:
+		{
+			ok = reader->event.tag == LSN_EV_ObjectStart;
+			for (size_t cap = 0; ok && lsn_next(reader) != LSN_EV_ObjectEnd; out->visits_len++)
+			{
+				if (out->visits_len == cap)
+				{
+					cap = cap ? 2 * cap : 8;
+					out->visits = (point_t*)realloc(out->visits, cap * sizeof(point_t));
+				}
+				ok = point_decode(reader, &out->visits[out->visits_len]);
+			}
+			break;
+		}
+		case 5:
+		{
+			ok = reader->event.tag == LSN_EV_ObjectStart;
+			for (size_t cap = 0; ok && lsn_next(reader) != LSN_EV_ObjectEnd; out->scores_len++)
+			{
+				if (out->scores_len == cap)
+				{
+					cap = cap ? 2 * cap : 8;
+					out->scores = (int32_t*)realloc(out->scores, cap * sizeof(int32_t));
+				}
+				ok = decode_int(reader, &out->scores[out->scores_len]);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+	if (!ok || reader->event.tag != LSN_EV_ObjectEnd || seen != 0x3full)
+	{
+		person_free(out);
+		return false;
+	}
+	return true;
+}
+
+bool person_parse(char* src, size_t len, person_t* out)
+{
+	lsn_reader_t reader;
+	lsn_reader_init(&reader, src, len, NULL);
+	lsn_next(&reader);
+	if (!person_decode(&reader, out))
+		return false;
+	if (lsn_next(&reader) != LSN_EV_End)
+	{
+		person_free(out);
+		return false;
+	}
+	return true;
+}
+
+void person_free(person_t* value)
+{
+	free(value->tags);
+	point_free(&value->home);
+	for (size_t i = 0; i < value->visits_len; i++)
+		point_free(&value->visits[i]);
+	free(value->visits);
+	free(value->scores);
+	memset(value, 0, sizeof(*value));
+}
+
+void person_encode(lsn_writer_t* w, const person_t* value)
+{
+	lsn_writer_raw(w, "(:name ", 7);
+	lsn_writer_string(w, &value->name);
+	lsn_writer_raw(w, " :age ", 6);
+	lsn_writer_integer(w, value->age);
+	lsn_writer_raw(w, " :tags (", 8);
+	for (size_t i = 0; i < value->tags_len; i++)
+	{
+		if (i)
+			lsn_writer_raw(w, " ", 1);
+		lsn_writer_tag(w, &value->tags[i]);
+	}
+	lsn_writer_raw(w, ") :home ", 8);
+	point_encode(w, &value->home);
+	lsn_writer_raw(w, " :visits (", 10);
+	for (size_t i = 0; i < value->visits_len; i++)
+	{
+		if (i)
+			lsn_writer_raw(w, " ", 1);
+		point_encode(w, &value->visits[i]);
+	}
+	lsn_writer_raw(w, ") :scores (", 11);
+	for (size_t i = 0; i < value->scores_len; i++)
+	{
+		if (i)
+			lsn_writer_raw(w, " ", 1);
+		lsn_writer_integer(w, value->scores[i]);
+	}
+	lsn_writer_raw(w, "))", 2);
+}
+
+bool person_write(int fd, const person_t* value)
+{
+	lsn_writer_t* w = lsn_writer_new(fd);
+	person_encode(w, value);
+	return lsn_writer_delete(&w);
+}
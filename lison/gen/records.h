@@ -0,0 +1,44 @@
+// generated by lsngen, do not edit
+#ifndef RECORDS_H
+#define RECORDS_H
+
+#include <lsn.h>
+
+typedef struct _point_t
+{
+	float x;
+	float y;
+} point_t;
+
+typedef struct _person_t
+{
+	str_t name; // slice of the source
+	int32_t age;
+	str_t* tags; // slices of the source
+	size_t tags_len;
+	point_t home;
+	point_t* visits;
+	size_t visits_len;
+	int32_t* scores;
+	size_t scores_len;
+} person_t;
+
+/**
+ * Decoders, strings and tags are slices of the source, which must outlive
+ * the records. _decode reads the object at the LSN_EV_ObjectStart of the
+ * reader, _parse a whole document. Both free what they decoded on failure.
+ */
+bool point_decode(lsn_reader_t* reader, point_t* out);
+bool point_parse(char* src, size_t len, point_t* out);
+void point_free(point_t* value);
+bool person_decode(lsn_reader_t* reader, person_t* out);
+bool person_parse(char* src, size_t len, person_t* out);
+void person_free(person_t* value);
+
+// encoders, false from _write as lsn_writer_delete
+void point_encode(lsn_writer_t* w, const point_t* value);
+bool point_write(int fd, const point_t* value);
+void person_encode(lsn_writer_t* w, const person_t* value);
+bool person_write(int fd, const person_t* value);
+
+#endif //RECORDS_H
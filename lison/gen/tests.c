@@ -0,0 +1,130 @@
+#include "records.h"
+
+#include <unitest.h>
+#include <unistd.h>
+
+// records.h and records.c are generated from schema.lsn by lsngen
+
+static char* person_src = "(:name 'John Doe' :tags (:a :bb) :age 22 (* c *) :home (:y 2.5 :x 1) :visits ((:x 1.5 :y 2) (:x 3 :y 4)) :scores (1 2 3))";
+
+static int check_person(const person_t* p)
+{
+	int res = p->name.len != 8 || strncmp(p->name.data, "John Doe", 8) != 0;
+	res += p->age != 22;
+	res += p->tags_len != 2 || p->tags[1].len != 2 || strncmp(p->tags[1].data, "bb", 2) != 0;
+	res += p->home.x != 1 || p->home.y != 2.5f;
+	res += p->visits_len != 2 || p->visits[0].x != 1.5f || p->visits[1].y != 4;
+	res += p->scores_len != 3 || p->scores[2] != 3;
+	return res;
+}
+
+int test_parse(void)
+{
+	char* src = strdup(person_src);
+	person_t p;
+	int res = !person_parse(src, strlen(src), &p);
+	if (!res)
+	{
+		res += check_person(&p);
+		person_free(&p);
+	}
+	free(src);
+	return res;
+}
+
+int test_round_trip(void)
+{
+	char* src = strdup(person_src);
+	char path[] = "/tmp/lsn_gen_XXXXXX";
+	int fd = mkstemp(path);
+	person_t p;
+	int res = fd < 0 || !person_parse(src, strlen(src), &p);
+	if (res)
+	{
+		free(src);
+		return res;
+	}
+	res += !person_write(fd, &p);
+	person_free(&p);
+	free(src);
+
+	// the written document parses into the same record
+	off_t len = lseek(fd, 0, SEEK_END);
+	char* written = (char*)malloc((size_t)len + 1);
+	res += pread(fd, written, (size_t)len, 0) != len;
+	written[len] = 0;
+	close(fd);
+	unlink(path);
+	person_t back;
+	res += !person_parse(written, (size_t)len, &back);
+	if (!res)
+	{
+		res += check_person(&back);
+		person_free(&back);
+	}
+	free(written);
+	return res;
+}
+
+static int count_accepted(const char** srcs, size_t n)
+{
+	int res = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		char* src = strdup(srcs[i]);
+		point_t q;
+		if (point_parse(src, strlen(src), &q))
+			res++;
+		free(src);
+	}
+	return res;
+}
+
+int test_unknown(void)
+{
+	const char* srcs[] = { "(:x 1 :y 2 :z 3)", "(:z 3 :x 1 :y 2)" };
+	return count_accepted(srcs, 2);
+}
+
+int test_missing(void)
+{
+	const char* srcs[] = { "(:x 1)", "(:x 1 :y)", "()" };
+	return count_accepted(srcs, 3);
+}
+
+int test_repeated(void)
+{
+	const char* srcs[] = { "(:x 1 :x 2 :y 1)", "(:x 1 :y 1 :y 1)" };
+	return count_accepted(srcs, 2);
+}
+
+int test_mistyped(void)
+{
+	const char* srcs[] = { "(:x 'a' :y 1)", "(:x :a :y 1)", "(:x (1) :y 1)" };
+	int res = count_accepted(srcs, 3);
+	// in nested records and lists too
+	const char* people[] = {
+		"(:name 'a' :age 1.5 :tags () :home (:x 1 :y 1) :visits () :scores ())",
+		"(:name 'a' :age 1 :tags (:a 1) :home (:x 1 :y 1) :visits () :scores ())",
+		"(:name 'a' :age 1 :tags () :home (:x 1 :y 1) :visits ((:x 1 :y 2) (:x 1)) :scores ())",
+		"(:name 'a' :age 1 :tags () :home (:x 1 :y 1) :visits () :scores (1 2 1.5))",
+	};
+	for (size_t i = 0; i < sizeof(people) / sizeof(people[0]); i++)
+	{
+		char* src = strdup(people[i]);
+		person_t p;
+		if (person_parse(src, strlen(src), &p))
+			res++;
+		free(src);
+	}
+	return res;
+}
+
+RUN_TESTS(
+	TEST (parse),
+	TEST (round_trip),
+	TEST (unknown),
+	TEST (missing),
+	TEST (repeated),
+	TEST (mistyped),
+)
@@ -0,0 +1,202 @@
+#include "lsn.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Lazy access to mapped documents.
+ * Opening builds the structural index of the file and matches its parens.
+ * The first access to an object splits it into its children by walking
+ * the offsets directly inside it, jumping over nested objects, so nothing
+ * below is looked at until it is accessed itself. Syntax errors inside a
+ * value show up when it is split or materialized.
+ */
+
+#define LSN_LAZY_INIT_CHILDREN 16
+
+#define LSN_IS_SPACE(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r')
+
+/**
+ * Adds the values that start at offset idx of the index: a whole object,
+ * or the atoms of one run (1-2 holds two numbers).
+ * Returns the index of the next value, 0 on a lexer error.
+ */
+static size_t lsn_lazy_values(lsn_lazy_t* lazy, size_t idx, lsn_lazy_node_t** children, size_t* len, size_t* cap)
+{
+	const uint32_t* offsets = lazy->index.offsets;
+	char* src = lazy->data;
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, lazy->len);
+	lex.pos = offsets[idx];
+	size_t next = idx + 1 < lazy->index.len ? offsets[idx + 1] : lazy->len;
+	do
+	{
+		lsn_lazy_node_t node = {
+			.src = src + lex.pos, .len = 0, .at = (uint32_t)idx,
+			.children = NULL, .children_len = 0, .value = NULL,
+			.scanned = false, .failed = false,
+		};
+		lsn_token_t tkn;
+		switch (lsn_lex_next(&lex, &tkn))
+		{
+		case LSN_TKN_String:  node.tag = LSN_String; break;
+		case LSN_TKN_Tag:     node.tag = LSN_Tag; break;
+		case LSN_TKN_Integer: node.tag = LSN_Integer; break;
+		case LSN_TKN_Float:   node.tag = LSN_Float; break;
+		case LSN_TKN_LParen:
+			node.tag = LSN_Object;
+			lex.pos = offsets[lazy->match[idx]] + 1;
+			idx = lazy->match[idx];
+			break;
+		default:
+			return 0;
+		}
+		node.len = (size_t)(src + lex.pos - node.src);
+		if (*len == *cap)
+		{
+			*cap *= 2;
+			*children = (lsn_lazy_node_t*)realloc(*children, *cap * sizeof(lsn_lazy_node_t));
+		}
+		(*children)[(*len)++] = node;
+		if (node.tag == LSN_Object)
+			break;
+	} while (lex.pos < next && !LSN_IS_SPACE(src[lex.pos]) && src[lex.pos] != '(');
+	return idx + 1;
+}
+
+static bool lsn_lazy_split(lsn_lazy_t* lazy, lsn_lazy_node_t* node)
+{
+	node->scanned = true;
+	if (node->tag != LSN_Object)
+		return true;
+	size_t cap = LSN_LAZY_INIT_CHILDREN;
+	size_t len = 0;
+	lsn_lazy_node_t* children = (lsn_lazy_node_t*)malloc(cap * sizeof(lsn_lazy_node_t));
+
+	// only the offsets directly inside the parens are visited
+	size_t end = lazy->match[node->at];
+	for (size_t idx = node->at + 1; idx < end; )
+	{
+		idx = lsn_lazy_values(lazy, idx, &children, &len, &cap);
+		if (!idx)
+		{
+			LOG("[LSN LAZY] Invalid value in the object at %zu\n", (size_t)(node->src - lazy->data));
+			node->failed = true;
+			len = 0;
+			break;
+		}
+	}
+
+	node->children_len = len;
+	if (len)
+	{
+		node->children = (lsn_lazy_node_t*)lsn_ar_alloc(&lazy->arena, len * sizeof(lsn_lazy_node_t));
+		memcpy(node->children, children, len * sizeof(lsn_lazy_node_t));
+	}
+	free(children);
+	return !node->failed;
+}
+
+// API --------------------------------------------------
+
+lsn_lazy_t* lsn_open_lazy(char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	size_t len = (size_t)st.st_size;
+	void* data = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	lsn_lazy_t* lazy = (lsn_lazy_t*)malloc(sizeof(lsn_lazy_t));
+	lazy->data = (char*)data;
+	lazy->len = len;
+	lazy->match = NULL;
+	lsn_ar_init(&lazy->arena, 0, 0);
+	lsn_structural_init(&lazy->index);
+
+	// the root, then nothing but whitespace and comments
+	size_t cap = 1;
+	size_t count = 0;
+	lsn_lazy_node_t* root = (lsn_lazy_node_t*)malloc(sizeof(lsn_lazy_node_t));
+	if (!lsn_structural_index(lazy->data, len, &lazy->index)
+		|| !(lazy->match = lsn_structural_match(lazy->data, &lazy->index))
+		|| lazy->index.len == 0 || lsn_lazy_values(lazy, 0, &root, &count, &cap) != lazy->index.len || count != 1)
+	{
+		free(root);
+		lsn_close_lazy(&lazy);
+		return NULL;
+	}
+	lazy->root = *root;
+	free(root);
+	return lazy;
+}
+
+void lsn_close_lazy(lsn_lazy_t** lazy)
+{
+	if (!lazy || !*lazy)
+		return;
+	munmap((*lazy)->data, (*lazy)->len);
+	lsn_structural_delete(&(*lazy)->index);
+	free((*lazy)->match);
+	lsn_ar_delete(&(*lazy)->arena);
+	free(*lazy);
+	*lazy = NULL;
+}
+
+lsn_lazy_node_t* lsn_lazy_root(lsn_lazy_t* lazy)
+{
+	return lazy ? &lazy->root : NULL;
+}
+
+size_t lsn_lazy_len(lsn_lazy_t* lazy, lsn_lazy_node_t* node)
+{
+	if (!lazy || !node)
+		return 0;
+	if (!node->scanned)
+		lsn_lazy_split(lazy, node);
+	return node->children_len;
+}
+
+lsn_lazy_node_t* lsn_lazy_child(lsn_lazy_t* lazy, lsn_lazy_node_t* node, size_t idx)
+{
+	if (idx >= lsn_lazy_len(lazy, node))
+		return NULL;
+	return &node->children[idx];
+}
+
+lsn_lazy_node_t* lsn_lazy_get(lsn_lazy_t* lazy, lsn_lazy_node_t* node, const char* tag)
+{
+	size_t len = lsn_lazy_len(lazy, node);
+	size_t tag_len = strlen(tag);
+	for (size_t i = 0; i + 1 < len; i += 2)
+	{
+		const lsn_lazy_node_t* key = &node->children[i];
+		// the range of a tag is the colon and the name
+		if (key->tag == LSN_Tag && key->len == tag_len + 1 && memcmp(key->src + 1, tag, tag_len) == 0)
+			return &node->children[i + 1];
+	}
+	return NULL;
+}
+
+lison_t* lsn_lazy_value(lsn_lazy_t* lazy, lsn_lazy_node_t* node)
+{
+	if (!lazy || !node)
+		return NULL;
+	if (!node->value && !node->failed)
+	{
+		node->value = lsn_compile_in(&lazy->arena, node->src, node->len, NULL);
+		node->failed = node->value == NULL;
+	}
+	return node->value;
+}
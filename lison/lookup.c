@@ -0,0 +1,183 @@
+#include "lsn.h"
+
+#include <stdarg.h>
+
+/**
+ * Key lookup in property lists: (:key value :key value ...).
+ * Keys are the items at even positions, so a tag that is a value is never
+ * taken for a key, as the second :b in (:a :b :b 1).
+ * Short lists are scanned. Lists with at least LSN_INDEX_MIN entries get
+ * an open addressing table from the key to its tag node, built on the
+ * first lookup and published atomically, so concurrent readers at worst
+ * build it twice. Arena objects cannot free an index later, so their
+ * indices are built in the arena while parsing with LSN_OPT_Index.
+ * The table is kept in the first node of the list, the only node with
+ * room for it, so the value nodes stay small.
+ * Keys interned in the same table as the looked up tag are compared by
+ * id, the others by name.
+ */
+
+static size_t lsn_lst_len(const lison_list_t* list)
+{
+	size_t len = 0;
+	for (const lison_node_t* it = list->head; it; it = it->next)
+		len++;
+	return len;
+}
+
+/**
+ * True if the tag is the key: by id if both are interned in the same
+ * table, by name otherwise. key may be NULL to compare by name.
+ */
+static bool lsn_key_eq(const lison_t* tag, const lison_t* key, const char* name, size_t len)
+{
+	if (tag->tag != LSN_Tag)
+		return false;
+	if (key && (tag->flags & key->flags & LSN_F_Interned) && lsn_sym_table(tag) == lsn_sym_table(key))
+		return tag->value.sym.id == key->value.sym.id;
+	str_t str = lsn_str(tag);
+	return str.len == len && memcmp(str.data, name, len) == 0;
+}
+
+static lison_t* lsn_lookup(const lison_t* object, const lison_t* key, const char* tag, size_t len)
+{
+	if (!object || object->tag != LSN_Object || !tag)
+		return NULL;
+	lison_list_t* list = (lison_list_t*)&object->value.object;
+	if (!list->head)
+		return NULL;
+	lsn_index_t* index = __atomic_load_n(&LSN_LST_INDEX(list), __ATOMIC_ACQUIRE);
+	if (!index && !(object->flags & LSN_F_Arena))
+	{
+		size_t count = 0;
+		for (lison_node_t* it = list->head; it && count < LSN_INDEX_MIN; it = it->next)
+			count++;
+		if (count == LSN_INDEX_MIN)
+		{
+			lsn_index_t* built = lsn_index_build(NULL, list);
+			lsn_index_t* expected = NULL;
+			if (__atomic_compare_exchange_n(&LSN_LST_INDEX(list), &expected, built, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+				index = built;
+			else
+			{
+				free(built);
+				index = expected;
+			}
+		}
+	}
+
+	if (index)
+	{
+		uint32_t idx = lsn_hash(tag, len) & index->mask;
+		while (index->slots[idx])
+		{
+			lison_node_t* node = index->slots[idx];
+			if (lsn_key_eq(node->value, key, tag, len))
+				return node->next->value;
+			idx = (idx + 1) & index->mask;
+		}
+		return NULL;
+	}
+
+	for (lison_node_t* it = list->head; it && it->next; it = it->next->next)
+		if (lsn_key_eq(it->value, key, tag, len))
+			return it->next->value;
+	return NULL;
+}
+
+// API --------------------------------------------------
+
+lsn_index_t* lsn_index_build(lsn_arena_t* arena, const lison_list_t* list)
+{
+	size_t len = lsn_lst_len(list);
+	if (len < LSN_INDEX_MIN)
+		return NULL;
+	size_t slots = 16;
+	while (slots < len)
+		slots *= 2;
+	size_t size = sizeof(lsn_index_t) + slots * sizeof(lison_node_t*);
+	lsn_index_t* index = arena ? (lsn_index_t*)lsn_ar_alloc(arena, size) : (lsn_index_t*)malloc(size);
+	index->mask = (uint32_t)(slots - 1);
+	memset(index->slots, 0, slots * sizeof(lison_node_t*));
+
+	// every key with a value after it, the first one of a key wins
+	for (lison_node_t* it = list->head; it && it->next; it = it->next->next)
+	{
+		if (it->value->tag != LSN_Tag)
+			continue;
+		str_t key = lsn_str(it->value);
+		uint32_t idx = lsn_hash(key.data, key.len) & index->mask;
+		while (index->slots[idx] && !lsn_key_eq(index->slots[idx]->value, it->value, key.data, key.len))
+			idx = (idx + 1) & index->mask;
+		if (!index->slots[idx])
+			index->slots[idx] = it;
+	}
+	return index;
+}
+
+void lsn_index_attach(lsn_arena_t* arena, lison_list_t* list)
+{
+	lsn_index_t* index = lsn_index_build(arena, list);
+	if (index)
+		LSN_LST_INDEX(list) = index;
+}
+
+lison_t* lsn_get_n(const lison_t* object, const char* tag, size_t len)
+{
+	return lsn_lookup(object, NULL, tag, len);
+}
+
+lison_t* lsn_get(const lison_t* object, const char* tag)
+{
+	return tag ? lsn_get_n(object, tag, strlen(tag)) : NULL;
+}
+
+lison_t* lsn_get_path(const lison_t* object, ...)
+{
+	va_list args;
+	va_start(args, object);
+	lison_t* res = (lison_t*)object;
+	const char* tag;
+	while (res && (tag = va_arg(args, const char*)))
+		res = lsn_get(res, tag);
+	va_end(args);
+	return res;
+}
+
+lison_t* lsn_get_sym(const lison_t* object, lsn_symtab_t* tab, uint32_t id)
+{
+	const char* name = tab ? lsn_sym_name(tab, id) : NULL;
+	if (!name)
+		return NULL;
+	// the name of a symbol is that of an interned tag
+	lison_t key = { .tag = LSN_Tag, .flags = LSN_F_Interned };
+	key.value.sym.name = name;
+	key.value.sym.id = id;
+	key.value.sym.len = (uint32_t)strlen(name);
+	return lsn_lookup(object, &key, name, key.value.sym.len);
+}
+
+void lsn_key_init(lsn_key_t* key, const char* tag, size_t len)
+{
+	key->name = (str_t) { .data = (char*)tag, .len = len };
+	key->tag = (lison_t) { .tag = LSN_Tag, .flags = LSN_F_Borrowed };
+	key->tag.value.slice = key->name;
+}
+
+lison_t* lsn_key_get(const lison_t* object, lsn_key_t* key)
+{
+	if (!object || object->tag != LSN_Object || !object->value.object.head)
+		return NULL;
+	// the first key tells the table of the object
+	lsn_symtab_t* tab = lsn_sym_table(object->value.object.head->value);
+	uint32_t id;
+	if (tab && tab != lsn_sym_table(&key->tag) && lsn_sym_find(tab, key->name.data, key->name.len, &id))
+	{
+		key->tag.flags = LSN_F_Interned;
+		key->tag.value.sym.name = lsn_sym_name(tab, id);
+		key->tag.value.sym.id = id;
+		key->tag.value.sym.len = (uint32_t)key->name.len;
+	}
+	return lsn_lookup(object, &key->tag, key->name.data, key->name.len);
+}
+
@@ -4,7 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <unilog.h>
 #include <rgx.h>
@@ -41,9 +43,9 @@
  *          ;
  *
  * <string> = /'(\c|\w|\d)*'/;
- * <integer> = /\d+/;
- * <float> = /\d+.\d+/;
- * <tag> = /:(\c|\d)+/;
+ * <integer> = /-?\d+/;
+ * <float> = /-?\d+.\d+/;
+ * <tag> = /:(\c|\d)+/; (parens end the tag)
  * 
  * Comment ::= '(*' '*)'
  */
@@ -58,6 +60,25 @@ typedef struct _lison_node_t
 
 } lison_node_t;
 
+typedef struct _lsn_index_t
+{
+	uint32_t mask;
+	lison_node_t* slots[]; // tag nodes by the hash of their name
+} lsn_index_t;
+
+// lists shorter than this are scanned by lsn_get
+#define LSN_INDEX_MIN 16
+
+// the first node of a list, it also holds the index of the list
+typedef struct _lsn_list_head_t
+{
+	lison_node_t node;
+	lsn_index_t* index; // built by lsn_get, dropped on append
+} lsn_list_head_t;
+
+// index slot of a non-empty list
+#define LSN_LST_INDEX(list) (((lsn_list_head_t*)(list)->head)->index)
+
 typedef struct _lison_list_t
 {
 	lison_node_t* head;
@@ -72,21 +93,185 @@ typedef enum _lison_tag_t
 	LSN_Integer,
 	LSN_Float,
 	LSN_Tag,
+	LSN_IntArray, // packed list of integers, see LSN_OPT_Pack
+	LSN_FloatArray, // packed list of floats
 } lison_tag_t;
 
+// lison_t flags
+#define LSN_F_Arena 1 // allocated from a document arena, freed with it
+#define LSN_F_Borrowed 2 // string or tag in value.slice, points into the source
+#define LSN_F_Interned 4 // tag in value.sym, the name belongs to a symbol table
+
 typedef struct _lison_t
 {
 	lison_tag_t tag;
+	uint8_t flags;
 	union
 	{
 		lison_list_t object;
-		char* string; // these strings must be dynamically allocated and stored by the lison_t
+		char* string; // these strings must be dynamically allocated and stored by the lison_t (unless borrowed)
 		int32_t integer;
 		float lsn_float;
 		char* tag;
+		str_t slice; // borrowed strings and tags, not NUL terminated
+		struct
+		{
+			const char* name; // same place as tag, NUL terminated
+			uint32_t id;
+			uint32_t len;
+		} sym; // interned tags
+		struct
+		{
+			union
+			{
+				int32_t* ints; // LSN_IntArray
+				float* floats; // LSN_FloatArray
+			};
+			size_t len;
+		} array; // packed lists, owned like strings
 	} value;
 } lison_t;
 
+// arena
+typedef struct _lsn_ar_block_t
+{
+	struct _lsn_ar_block_t* next;
+	size_t size;
+	size_t used;
+	bool mapped;
+	_Alignas(8) char data[];
+} lsn_ar_block_t;
+
+// arena flags
+#define LSN_AR_HugePages 1 // back blocks of 2 MiB and more with huge pages
+
+#define LSN_AR_MIN_BLOCK (64u << 10)
+#define LSN_AR_MAX_BLOCK (64u << 20)
+
+typedef struct _lsn_arena_t
+{
+	lsn_ar_block_t* head;
+	size_t next_size;
+	uint8_t flags;
+} lsn_arena_t;
+
+// interned tags
+typedef struct _lsn_symbol_t
+{
+	const char* name;
+	uint32_t len;
+} lsn_symbol_t;
+
+typedef struct _lsn_symtab_t
+{
+	lsn_arena_t names;
+	lsn_symbol_t* symbols; // indexed by id
+	uint32_t len;
+	uint32_t cap;
+	uint32_t* slots; // id + 1, 0 if empty
+	uint32_t mask;
+	bool shared;
+	pthread_mutex_t lock;
+} lsn_symtab_t;
+
+// a tag looked up in many objects, see lsn_key_get
+typedef struct _lsn_key_t
+{
+	str_t name;
+	lison_t tag; // interned once an object with interned keys was seen
+} lsn_key_t;
+
+// a tree allocated from its own arena
+typedef struct _lsn_doc_t
+{
+	lsn_arena_t arena;
+	lison_t* root;
+	lsn_symtab_t* symbols; // tags are interned here if not NULL
+	bool owns_symbols;
+} lsn_doc_t;
+
+// offsets of the tokens in a source, see lsn_structural_index
+typedef struct _lsn_structural_t
+{
+	uint32_t* offsets;
+	size_t len;
+	size_t cap;
+} lsn_structural_t;
+
+// lazy document: a mapped file, split into children on first access
+typedef struct _lsn_lazy_node_t
+{
+	char* src; // the range of the value in the file
+	size_t len;
+	lison_tag_t tag;
+	uint32_t at; // position in the structural index
+	struct _lsn_lazy_node_t* children; // NULL until the node is scanned
+	size_t children_len;
+	lison_t* value; // materialized tree, NULL until asked for
+	bool scanned;
+	bool failed;
+} lsn_lazy_node_t;
+
+typedef struct _lsn_lazy_t
+{
+	char* data;
+	size_t len;
+	lsn_structural_t index;
+	uint32_t* match; // for the open parens in the index, their closing one
+	lsn_arena_t arena; // children and materialized values
+	lsn_lazy_node_t root;
+} lsn_lazy_t;
+
+// growable byte buffer
+typedef struct _lsn_buffer_t
+{
+	char* data;
+	size_t len;
+	size_t cap;
+} lsn_buffer_t;
+
+// columns of records, see lsn_to_columns
+typedef struct _lsn_column_t
+{
+	const char* tag; // the tag asked for, not copied
+	lison_tag_t type; // LSN_Integer, LSN_Float, LSN_String or LSN_Tag
+	int32_t* ints; // LSN_Integer, a value per row
+	float* floats; // LSN_Float
+	size_t* offsets; // LSN_String and LSN_Tag, row i is data[offsets[i], offsets[i + 1])
+	char* data; // the strings one after the other, not NUL terminated
+} lsn_column_t;
+
+typedef struct _lsn_columns_t
+{
+	size_t rows;
+	size_t len;
+	lsn_column_t* columns; // in the order of the tags
+} lsn_columns_t;
+
+// tape: the document as a flat preorder array
+typedef struct _lsn_tape_entry_t
+{
+	uint32_t tag; // lison_tag_t
+	uint32_t len; // objects: number of children, strings and tags: length
+	union
+	{
+		uint64_t end;    // objects: index just past the last descendant
+		uint64_t offset; // strings and tags: offset in the strings blob
+		int32_t integer;
+		float lsn_float;
+	} value;
+} lsn_tape_entry_t;
+
+typedef struct _lsn_tape_t
+{
+	lsn_tape_entry_t* entries;
+	size_t len;
+	size_t cap;
+	char* strings; // NUL terminated values of strings and tags
+	size_t strings_len;
+	size_t strings_cap;
+} lsn_tape_t;
+
 typedef enum _lsn_token_tag_t
 {
 	LSN_TKN_CommStart = 0,  // comments must be before parentheses.
@@ -99,6 +284,7 @@ typedef enum _lsn_token_tag_t
 	LSN_TKN_String = 7,
 	LSN_TKN_Tag = 8,
 	LSN_TKN_EOF = 9,
+	LSN_TKN_Error = 10, // unrecognisible input, never stored in a stream
 } lsn_token_tag_t;
 
 typedef struct _lsn_token_t
@@ -113,22 +299,159 @@ typedef struct _lsn_token_t
 	} value;
 } lsn_token_t;
 
-typedef struct _lsn_token_node
-{
-	lsn_token_t value;
-	struct _lsn_token_node* next;
-	struct _lsn_token_node* prev;
-} lsn_token_node_t;
-
+// contiguous tokens, tokens[len] is always the EOF sentinel
 typedef struct _lsn_token_stream
 {
-	lsn_token_node_t* head;
-	lsn_token_node_t* tail;
+	lsn_token_t* tokens;
+	size_t len;
+	size_t cap;
 } lsn_token_stream_t;
 
+#define LSN_TS_INIT_CAP 64
+
+// deepest nesting of parens accepted by default
+#define LSN_MAX_DEPTH 1024
+// nesting levels the parser keeps on the C stack before allocating
+#define LSN_LOCAL_DEPTH 32
+
+// option flags
+#define LSN_OPT_HugePages 1 // arena documents use LSN_AR_HugePages
+#define LSN_OPT_ZeroCopy 2 // strings and tags borrow the source, see lsn_detach
+#define LSN_OPT_Intern 4 // documents intern their tags into an own table
+#define LSN_OPT_Index 8 // build the lookup indices while parsing (needed for arena documents)
+#define LSN_OPT_Pack 16 // lists of only integers or only floats become LSN_IntArray and LSN_FloatArray
+
+typedef struct _lsn_options_t
+{
+	size_t max_depth; // 0 means LSN_MAX_DEPTH
+	uint32_t flags;
+	lsn_symtab_t* symbols; // tags are interned into it, it must outlive the trees
+} lsn_options_t;
+
+// buffered writer of serde.c, see lsn_writer_new
+typedef struct _lsn_writer_t lsn_writer_t;
+
+// iterator over a source with many documents, see lsn_docs_next
+typedef struct _lsn_docs_t
+{
+	char* src;
+	size_t len;
+	size_t pos; // where the next document starts (sequential mode)
+	bool mapped;
+	bool failed; // a document was invalid, the iteration stopped there
+	lsn_options_t opt;
+	lsn_token_stream_t stream;
+	struct _lsn_docs_pool_t* pool; // batch mode, NULL otherwise
+} lsn_docs_t;
+
+// single pass lexer over an explicit length source
+typedef struct _lsn_lexer_t
+{
+	char* src;
+	size_t len;
+	size_t pos;
+} lsn_lexer_t;
+
+// pull reader events, see lsn_next
+typedef enum _lsn_event_tag_t
+{
+	LSN_EV_ObjectStart = 0,
+	LSN_EV_ObjectEnd = 1,
+	LSN_EV_String = 2,
+	LSN_EV_Tag = 3,
+	LSN_EV_Integer = 4,
+	LSN_EV_Float = 5,
+	LSN_EV_End = 6, // the document is complete
+	LSN_EV_Error = 7,
+} lsn_event_tag_t;
+
+typedef struct _lsn_event_t
+{
+	lsn_event_tag_t tag;
+	size_t depth; // objects around the value, 0 for the root itself
+	union
+	{
+		int32_t integer;
+		float lsn_float;
+		str_t string; // slices of the source
+		str_t tag;
+	} value;
+} lsn_event_t;
+
+typedef struct _lsn_reader_t
+{
+	lsn_lexer_t lex;
+	size_t depth; // open objects
+	size_t max_depth;
+	bool started;
+	lsn_event_t event; // the last one returned by lsn_next
+} lsn_reader_t;
+
+// push parser, see lsn_push_feed
+typedef void (*lsn_push_cb)(const lsn_event_t* ev, void* user);
+
+typedef struct _lsn_push_t
+{
+	char* carry; // the start of a token split across chunks
+	size_t carry_len;
+	size_t carry_cap;
+	size_t depth;
+	size_t max_depth;
+	lsn_symtab_t* symbols;
+	bool index;
+	bool pack;
+	bool failed;
+	bool done; // the root is complete
+	lsn_push_cb on_event; // NULL builds the tree
+	void* user;
+	lison_list_t* stack; // the open lists of the tree
+	size_t stack_cap;
+	lison_t* root;
+} lsn_push_t;
+
+// compiled path query, see lsn_query_compile
+typedef enum _lsn_query_kind_t
+{
+	LSN_Q_Tag, // the value after the tag
+	LSN_Q_Any, // every item
+	LSN_Q_Index, // the item at the index
+} lsn_query_kind_t;
+
+typedef enum _lsn_query_op_t
+{
+	LSN_Q_Exists,
+	LSN_Q_Eq,
+	LSN_Q_Ne,
+	LSN_Q_Lt,
+	LSN_Q_Le,
+	LSN_Q_Gt,
+	LSN_Q_Ge,
+} lsn_query_op_t;
+
+typedef struct _lsn_query_step_t
+{
+	lsn_query_kind_t kind;
+	str_t tag; // slices of the text of the query
+	size_t index;
+	bool has_pred;
+	str_t pred_tag;
+	lsn_query_op_t op;
+	lison_t* pred_value; // malloc'd atom, NULL for LSN_Q_Exists
+} lsn_query_step_t;
+
+typedef struct _lsn_query_t
+{
+	lsn_query_step_t* steps;
+	size_t len;
+	char* text;
+} lsn_query_t;
+
+// called for every match, returns false to stop the query
+typedef bool (*lsn_query_cb)(const lison_t* match, void* user);
+
 typedef struct _lsn_parse_res
 {
-	lsn_token_node_t* stream;
+	lsn_token_t* stream;
 	lison_t* lison;
 } lsn_parse_res_t;
 
@@ -146,31 +469,483 @@ lison_t* lsn_tag_str(const str_t* str);
 lison_t* lsn_integer(int value);
 lison_t* lsn_float(float value);
 lison_t* lsn_object(lison_list_t list);
+// packed arrays, the values are copied
+lison_t* lsn_int_array(const int32_t* values, size_t len);
+lison_t* lsn_float_array(const float* values, size_t len);
+
+// Same as above, allocated from the arena (or malloc with NULL).
+// Objects of an arena cannot be mixed with malloc'd ones.
+void lsn_ar_lst_append(lsn_arena_t* arena, lison_list_t* list, lison_t* object);
+lison_t* lsn_ar_string_str(lsn_arena_t* arena, const str_t* str);
+lison_t* lsn_ar_tag_str(lsn_arena_t* arena, const str_t* str);
+lison_t* lsn_ar_integer(lsn_arena_t* arena, int value);
+// borrowed string or tag (tag is LSN_String or LSN_Tag), str is not copied
+lison_t* lsn_ar_string_ref(lsn_arena_t* arena, lison_tag_t tag, const str_t* str);
+lison_t* lsn_ar_float(lsn_arena_t* arena, float value);
+lison_t* lsn_ar_object(lsn_arena_t* arena, lison_list_t list);
+// with NULL values the array is left for the caller to fill
+lison_t* lsn_ar_int_array(lsn_arena_t* arena, const int32_t* values, size_t len);
+lison_t* lsn_ar_float_array(lsn_arena_t* arena, const float* values, size_t len);
+
+/**
+ * Function to pack a list of only integers or only floats into an array,
+ * the list itself is left as it is.
+ * Errors:
+ * - NULL for empty lists and lists of anything else
+ */
+lison_t* lsn_ar_pack(lsn_arena_t* arena, const lison_list_t* list);
+
+// arena.c
+/**
+ * Function to initialize an empty arena. The first block is hint bytes
+ * (at least LSN_AR_MIN_BLOCK), every later one doubles up to
+ * LSN_AR_MAX_BLOCK.
+ */
+void lsn_ar_init(lsn_arena_t* arena, size_t hint, uint8_t flags);
+// 8 byte aligned, NULL if the system is out of memory
+void* lsn_ar_alloc(lsn_arena_t* arena, size_t size);
+char* lsn_ar_strndup(lsn_arena_t* arena, const char* src, size_t len);
+// frees everything but the largest block, which is reused
+void lsn_ar_reset(lsn_arena_t* arena);
+void lsn_ar_delete(lsn_arena_t* arena);
+// bytes reserved by the blocks
+size_t lsn_ar_size(const lsn_arena_t* arena);
+// moves the blocks of from into arena, from is left empty
+void lsn_ar_merge(lsn_arena_t* arena, lsn_arena_t* from);
 
 // parser.c
 // Token Stream driver
 void lsn_ts_init(lsn_token_stream_t* stream);
 void lsn_ts_delete(lsn_token_stream_t* stream);
+void lsn_ts_reserve(lsn_token_stream_t* stream, size_t len);
 void lsn_ts_append(lsn_token_stream_t* stream, lsn_token_t tkn);
 void lsn_ts_print(lsn_token_stream_t* stream);
 
+// Lexer
+void lsn_lex_init(lsn_lexer_t* lex, char* src, size_t len);
+
+/**
+ * Function to read the next token, skipping whitespace and comments.
+ * Returns the tag of the token, which is also stored in tkn. String and
+ * tag values are slices of the source.
+ * Errors:
+ * - LSN_TKN_Error on unrecognisible input, the position is left at it
+ * - LSN_TKN_EOF at the end of the source (every call after that too)
+ */
+lsn_token_tag_t lsn_lex_next(lsn_lexer_t* lex, lsn_token_t* tkn);
+// true if the lexer reads the text back as the inside of a string / a tag name
+bool lsn_lex_string_ok(const str_t* str);
+bool lsn_lex_tag_ok(const str_t* name);
+
 // Parser util
-void lsn_tokenize(char* src, lsn_token_stream_t* stream);
+/**
+ * Function to append the tokens of src to the stream.
+ * Returns false on an unrecognisible token; the tokens before it are
+ * kept in the stream.
+ */
+bool lsn_tokenize(char* src, lsn_token_stream_t* stream);
+bool lsn_tokenize_n(char* src, size_t len, lsn_token_stream_t* stream);
+// same, lexing only at the offsets of the structural index of src
+bool lsn_tokenize_structural(char* src, size_t len, const lsn_structural_t* index, lsn_token_stream_t* stream);
 void lsn_print_token(const lsn_token_t* tkn);
 
-// Recursive descent parser functions
-lsn_parse_res_t lsn_p_object(lsn_token_node_t* lkd);
-lsn_parse_res_t lsn_p_list(lsn_token_node_t* lkd);
-lsn_token_node_t* lsn_p_expect(lsn_token_node_t* lkd, lsn_token_tag_t tkn);
+// Parser functions
+// iterative, nesting is limited by LSN_MAX_DEPTH instead of the C stack
+lsn_parse_res_t lsn_p_object(lsn_token_t* tkn);
+lsn_parse_res_t lsn_p_list(lsn_token_t* tkn);
+lsn_token_t* lsn_p_expect(lsn_token_t* tkn, lsn_token_tag_t tag);
 
 // API
 // parser.c
 lison_t* lsn_compile(char* src);
+
+/**
+ * Function to compile with options, NULL means the defaults.
+ * Important: with LSN_OPT_ZeroCopy src must outlive the result.
+ * Errors:
+ * - NULL if the nesting is deeper than opt->max_depth
+ */
+lison_t* lsn_compile_opt(char* src, const lsn_options_t* opt);
+// same, src has len bytes and needs no terminating NUL
+lison_t* lsn_compile_n(char* src, size_t len, const lsn_options_t* opt);
+// same, allocated from the arena (it must outlive the tree)
+lison_t* lsn_compile_in(lsn_arena_t* arena, char* src, size_t len, const lsn_options_t* opt);
+/**
+ * Function to compile a sequence of values, e.g. the inside of a list,
+ * into items. depth is the number of lists around them, which count
+ * towards opt->max_depth. Tags are interned into opt->symbols if set.
+ * Errors:
+ * - false on the same errors as lsn_compile_opt
+ */
+bool lsn_compile_items(lsn_arena_t* arena, char* src, size_t len, const lsn_options_t* opt, size_t depth, lison_list_t* items);
+/**
+ * Function to compile the value at *pos (after whitespace and comments)
+ * and move *pos past it. The stream is reused for the tokens.
+ * Errors:
+ * - NULL with *pos set to len if only whitespace and comments are left
+ * - NULL with *pos unchanged if the value is invalid
+ */
+lison_t* lsn_compile_next(lsn_token_stream_t* stream, char* src, size_t len, size_t* pos, const lsn_options_t* opt);
+
+/**
+ * Function to compile into a document whose tree, strings and the
+ * lsn_doc_t itself live in one arena. lsn_delete is a no-op on its
+ * objects, the whole document is freed by lsn_doc_delete.
+ * Errors:
+ * - NULL on the same errors as lsn_compile_opt
+ */
+lsn_doc_t* lsn_compile_doc(char* src, const lsn_options_t* opt);
+void lsn_doc_delete(lsn_doc_t** doc);
+// empty document (root is NULL) with the arena and symbols of the options
+lsn_doc_t* lsn_doc_new(size_t hint, const lsn_options_t* opt);
+
+// symbols.c
+/**
+ * Function to initialize an empty symbol table. Shared tables can be used
+ * by several threads at once, they lock a mutex in every call.
+ */
+void lsn_sym_init(lsn_symtab_t* tab, bool shared);
+void lsn_sym_delete(lsn_symtab_t* tab);
+// id of the name, added if it is new; ids are dense from 0
+uint32_t lsn_sym_intern(lsn_symtab_t* tab, const char* name, size_t len);
+// false if the name was never interned
+bool lsn_sym_find(lsn_symtab_t* tab, const char* name, size_t len, uint32_t* id);
+// NUL terminated name of the id, valid until the table is deleted
+const char* lsn_sym_name(lsn_symtab_t* tab, uint32_t id);
+// interned tag object (malloc'd if arena is NULL)
+lison_t* lsn_ar_tag_sym(lsn_arena_t* arena, lsn_symtab_t* tab, const str_t* str);
+// table the tag is interned in, NULL if it is not an interned tag
+lsn_symtab_t* lsn_sym_table(const lison_t* tag);
+
+// FNV-1a hash of the name
+uint32_t lsn_hash(const char* name, size_t len);
+
+// lookup.c
+/**
+ * Function to get the value after the first occurrence of the tag as a
+ * key (at an even position) in a property list, e.g. 22 for :age in
+ * (:name 'John' :age 22).
+ * Important: the first lookup in a list of LSN_INDEX_MIN or more entries
+ * builds a hash index of it (except in arena documents, see LSN_OPT_Index).
+ * Errors:
+ * - NULL if object is not a list or the tag has no value in it
+ */
+lison_t* lsn_get(const lison_t* object, const char* tag);
+lison_t* lsn_get_n(const lison_t* object, const char* tag, size_t len);
+
+/**
+ * Same as lsn_get, with the id of a symbol of the table: keys interned in
+ * the same table are compared by id, the others by name.
+ * Errors:
+ * - NULL if object is not a list, id is not in the table or the tag has
+ *   no value in it
+ */
+lison_t* lsn_get_sym(const lison_t* object, lsn_symtab_t* tab, uint32_t id);
+
+/**
+ * Same as lsn_get, for a tag looked up in many objects: once an object
+ * has interned keys, the tag is resolved in their table and compared by
+ * id from then on.
+ */
+lison_t* lsn_key_get(const lison_t* object, lsn_key_t* key);
+void lsn_key_init(lsn_key_t* key, const char* tag, size_t len);
+
+/**
+ * Function to follow a path of tags, terminated by NULL:
+ * lsn_get_path(root, "address", "city", NULL)
+ * Errors:
+ * - NULL if any step fails
+ */
+lison_t* lsn_get_path(const lison_t* object, ...);
+
+// index of the list in the arena (malloc'd if NULL), NULL for short lists
+lsn_index_t* lsn_index_build(lsn_arena_t* arena, const lison_list_t* list);
+// builds the index of the list and keeps it in its first node
+void lsn_index_attach(lsn_arena_t* arena, lison_list_t* list);
+
+// binary.c
+/**
+ * Function to append the binary encoding of the tree to out: a header,
+ * the table of tag names, then the values in preorder with a type byte,
+ * varint lengths and little endian 32 bit numbers.
+ * Free the buffer with lsn_buffer_delete.
+ */
+bool lsn_encode_binary(const lison_t* lison, lsn_buffer_t* out);
+
+/**
+ * Function to decode a binary document into malloc'd objects.
+ * Errors:
+ * - NULL on a bad header, truncated or trailing data, unknown type bytes
+ *   or tag ids, and nesting deeper than LSN_MAX_DEPTH
+ */
+lison_t* lsn_decode_binary(const char* data, size_t len);
+// same into an arena document, interning tags as the options say
+lsn_doc_t* lsn_decode_binary_doc(const char* data, size_t len, const lsn_options_t* opt);
+void lsn_buffer_delete(lsn_buffer_t* buf);
+
+// converters between files, false on any error
+bool lsn_text_to_binary(char* in_path, char* out_path);
+bool lsn_binary_to_text(char* in_path, char* out_path);
+
+// parallel.c
+/**
+ * Function to compile a large document with up to threads threads into
+ * an arena document, like lsn_compile_doc. The children of the root (or
+ * of the list inside it that holds most of the source) are compiled in
+ * ranges of about the same size, one thread each.
+ * Important: with LSN_OPT_Intern the document gets a shared symbol
+ * table; a table given in opt->symbols must be shared as well.
+ * Errors:
+ * - NULL on the same errors as lsn_compile_opt
+ */
+lsn_doc_t* lsn_compile_parallel(char* src, size_t threads, const lsn_options_t* opt);
+
+// reader.c
+// reader over src, opt may be NULL (only max_depth is used)
+void lsn_reader_init(lsn_reader_t* reader, char* src, size_t len, const lsn_options_t* opt);
+
+/**
+ * Function to read the next event of the document, with its payload in
+ * reader->event. Nothing is allocated and only the depth is kept, so a
+ * document of any size is read in constant memory.
+ * Errors:
+ * - LSN_EV_Error on invalid tokens, unbalanced parens, nesting deeper
+ *   than max_depth and values after the root; every later call too
+ * - LSN_EV_End after the root (every later call too)
+ */
+lsn_event_tag_t lsn_next(lsn_reader_t* reader);
+
+/**
+ * Function to skip the rest of the innermost open object (the whole of it
+ * right after its LSN_EV_ObjectStart), returning its LSN_EV_ObjectEnd.
+ * Errors:
+ * - LSN_EV_Error as lsn_next
+ * - the last tag again if no object is open
+ */
+lsn_event_tag_t lsn_reader_skip(lsn_reader_t* reader);
+
+// push.c
+/**
+ * Function to start a push parser. With on_event every token is passed
+ * to it as an event (string and tag payloads only live until it returns),
+ * otherwise the parser builds a malloc'd tree.
+ */
+void lsn_push_init(lsn_push_t* push, const lsn_options_t* opt, lsn_push_cb on_event, void* user);
+
+/**
+ * Function to parse the next chunk of the input, of any size. Tokens,
+ * strings and comments may be split anywhere across chunks.
+ * Errors:
+ * - false once the input is invalid, later chunks are ignored
+ */
+bool lsn_push_feed(lsn_push_t* push, const char* chunk, size_t len);
+
+/**
+ * Function to end the input and free the parser, which can then be used
+ * for the next document. The tree goes to root if it is not NULL, free it
+ * with lsn_delete.
+ * Errors:
+ * - false if the input was invalid or is incomplete
+ */
+bool lsn_push_finish(lsn_push_t* push, lison_t** root);
+
+// query.c
+/**
+ * Function to compile a path query like ":persons/0/:name". Steps are
+ * separated by '/': ':tag' is the value after the tag (as lsn_get), '*'
+ * every item of an object and a number the item at that index. A step
+ * may end with a predicate on its value, [:tag] if the value has the tag
+ * or [:tag op literal] with op one of = != < <= > >= and the literal a
+ * number, a 'string' or a :tag. Numbers compare as numbers, strings and
+ * tags by their bytes.
+ * Errors:
+ * - NULL on a syntax error
+ */
+lsn_query_t* lsn_query_compile(const char* text);
+void lsn_query_delete(lsn_query_t** query);
+
+// calls cb for every match in the tree, in document order (the numbers
+// of packed arrays as atoms that only live until cb returns)
+void lsn_query_run(const lsn_query_t* query, const lison_t* root, lsn_query_cb cb, void* user);
+
+/**
+ * Function to run the query while reading src, without compiling the
+ * document. Objects that cannot match are skipped unread, and only the
+ * matches and the values tested by predicates are built (freed after the
+ * callback returns).
+ * Errors:
+ * - false if src is not a valid document, which may be found after some
+ *   matches were reported; a source is read until its end unless cb
+ *   stops the query
+ */
+bool lsn_query_scan(const lsn_query_t* query, char* src, size_t len, lsn_query_cb cb, void* user);
+
+// columns.c
+/**
+ * Function to turn a list of records (objects with the same tags, like
+ * the items of :persons) into a column per tag, the value after the tag
+ * in every record (as lsn_get). Integer columns with floats in them are
+ * float columns. Nothing points into the tree, free the columns with
+ * lsn_columns_delete.
+ * Errors:
+ * - false if a record does not have one of the tags or its value is a list
+ *   or packed array, or the values of a tag are of different kinds
+ */
+bool lsn_to_columns(const lison_t* list, const char** tags, size_t n, lsn_columns_t* out);
+void lsn_columns_delete(lsn_columns_t* columns);
+
+// stream.c
+/**
+ * Function to iterate over the documents of src, one after the other
+ * with only whitespace and comments between them. Nothing is copied, the
+ * source must outlive the iterator.
+ */
+void lsn_docs_init(lsn_docs_t* docs, char* src, size_t len, const lsn_options_t* opt);
+// same over a mapped file, false if it cannot be mapped
+bool lsn_docs_open(lsn_docs_t* docs, char* path, const lsn_options_t* opt);
+
+/**
+ * Function to compile the rest of the documents with a pool of threads
+ * in blocks of batch documents each. lsn_docs_next still returns them in
+ * order, but docs->pos no longer follows it.
+ * Important: a table in the options must be shared (see lsn_sym_init).
+ * Errors:
+ * - false (and nothing changes) if the parens of the rest do not match
+ *   up or no thread could be started
+ */
+bool lsn_docs_parallel(lsn_docs_t* docs, size_t threads, size_t batch);
+
+/**
+ * Function to get the next document, free it with lsn_delete.
+ * Errors:
+ * - NULL at the end, and with docs->failed set at an invalid document
+ */
+lison_t* lsn_docs_next(lsn_docs_t* docs);
+// stops the pool, frees what was not handed out and unmaps the file
+void lsn_docs_close(lsn_docs_t* docs);
+
+// structural.c
+/**
+ * Function to find where the tokens of the source start: parens, opening
+ * quotes and the first byte of every tag or number, skipping strings and
+ * comments. Uses AVX2 or SSE2 when the CPU has them.
+ * Important: the offsets say nothing about the validity of the tokens,
+ * that is left to the lexer (see lsn_tokenize_structural).
+ * Errors:
+ * - false for sources of 4 GiB and more
+ */
+bool lsn_structural_index(const char* src, size_t len, lsn_structural_t* out);
+/**
+ * Function to match the parens of an index: for the position of every
+ * '(' in it, the position of its ')'. Free the result.
+ * Errors:
+ * - NULL if the parens do not match up
+ */
+uint32_t* lsn_structural_match(const char* src, const lsn_structural_t* index);
+void lsn_structural_init(lsn_structural_t* out);
+void lsn_structural_delete(lsn_structural_t* out);
+
+// tape.c
+/**
+ * Function to compile straight into a tape, without tokens or a tree.
+ * The root is entry 0; the children of the object at idx are
+ * for (c = idx + 1; c < entries[idx].value.end; c = lsn_tape_next(tape, c))
+ * Errors:
+ * - false on the same errors as lsn_compile_opt, the tape is left empty
+ */
+bool lsn_tape_compile(char* src, lsn_tape_t* tape, const lsn_options_t* opt);
+void lsn_tape_init(lsn_tape_t* tape);
+void lsn_tape_delete(lsn_tape_t* tape);
+// index of the next sibling (may be the end of the parent)
+size_t lsn_tape_next(const lsn_tape_t* tape, size_t idx);
+// value of a string or tag entry, NULL for other entries
+const char* lsn_tape_str(const lsn_tape_t* tape, size_t idx);
+// copies the subtree at idx into a malloc'd tree
+lison_t* lsn_tape_to_lison(const lsn_tape_t* tape, size_t idx);
 // ast.c
 void lsn_delete(lison_t** object);
 void lsn_print(lison_t* object);
+
+/**
+ * Function to get the value of a string or tag, owned or borrowed.
+ * Important: the slice of an owned value is NUL terminated, the slice of
+ * a borrowed one (LSN_F_Borrowed) is not.
+ * Errors:
+ * - empty slice with NULL data for other objects
+ */
+str_t lsn_str(const lison_t* object);
+
+/**
+ * Function to deep copy a tree into malloc'd objects that own their
+ * strings, independent of the source buffer and of any arena.
+ * Free the result with lsn_delete.
+ */
+lison_t* lsn_detach(const lison_t* object);
+// lazy.c
+/**
+ * Function to open a file for lazy access. Only the range of the root is
+ * found, objects are split into their children when first accessed.
+ * Important: nodes and values stay valid until lsn_close_lazy.
+ * Errors:
+ * - NULL if the file cannot be mapped, its parens do not match or it does
+ *   not hold exactly one value (the inside of the root is not checked)
+ */
+lsn_lazy_t* lsn_open_lazy(char* path);
+void lsn_close_lazy(lsn_lazy_t** lazy);
+lsn_lazy_node_t* lsn_lazy_root(lsn_lazy_t* lazy);
+// number of children, 0 for atoms and objects that fail to split
+size_t lsn_lazy_len(lsn_lazy_t* lazy, lsn_lazy_node_t* node);
+lsn_lazy_node_t* lsn_lazy_child(lsn_lazy_t* lazy, lsn_lazy_node_t* node, size_t idx);
+// node after the first occurrence of the tag as a key, like lsn_get
+lsn_lazy_node_t* lsn_lazy_get(lsn_lazy_t* lazy, lsn_lazy_node_t* node, const char* tag);
+
+/**
+ * Function to parse the node into a tree in the arena of the document,
+ * cached for later calls. lsn_delete is a no-op on it.
+ * Errors:
+ * - NULL if the range of the node is not a valid document
+ */
+lison_t* lsn_lazy_value(lsn_lazy_t* lazy, lsn_lazy_node_t* node);
 // serde.c
+/**
+ * Function to load a document from a file, mapped into memory if it can
+ * be (read otherwise) and parsed without copying the file.
+ * Errors:
+ * - NULL if the file cannot be read or is not a valid document
+ */
 lison_t* lsn_deserialize(char* filepath);
-void lsn_serialize(char* filepath, lison_t* lison);
+
+/**
+ * Function to write the document to the file, replacing its contents.
+ * Lists are written as (a b c), floats in the shortest fixed notation
+ * that reads back to the same value.
+ * Errors:
+ * - false on I/O errors, for infinite or NaN floats and for strings and
+ *   tags the lexer would not read back (see lsn_lex_string_ok)
+ */
+bool lsn_serialize(char* filepath, lison_t* lison);
+// same, into an open file descriptor
+bool lsn_write(int fd, const lison_t* lison);
+
+/**
+ * Function to write a document value by value, the way lsn_write does,
+ * for encoders that have no tree. Parens and separators go in with
+ * lsn_writer_raw.
+ */
+lsn_writer_t* lsn_writer_new(int fd);
+void lsn_writer_raw(lsn_writer_t* w, const char* data, size_t len);
+void lsn_writer_integer(lsn_writer_t* w, int32_t value);
+void lsn_writer_float(lsn_writer_t* w, float value);
+void lsn_writer_string(lsn_writer_t* w, const str_t* value);
+// the name without the colon
+void lsn_writer_tag(lsn_writer_t* w, const str_t* name);
+
+/**
+ * Function to flush and free the writer.
+ * Errors:
+ * - false on I/O errors, for infinite or NaN floats and for strings and
+ *   tags the lexer would not read back (see lsn_lex_string_ok)
+ */
+bool lsn_writer_delete(lsn_writer_t** w);
 
 #endif //LISON_H
@@ -0,0 +1,574 @@
+#include "lsn.h"
+
+/**
+ * LSNGEN: C code for typed records from a LiSON schema.
+ * The schema is a document of record names and their fields, every
+ * record is used only after it is defined:
+ *
+ *   (:point (:x :float :y :float)
+ *    :person (:name :string :age :int :tags (:list :tag) :home :point))
+ *
+ * Field types are :string, :tag, :int, :float, a record, or a list of
+ * any of these. Record names must not be taken by the types lsn.h brings
+ * in (str, lison, regex, ...), and a list x leaves no room for a field
+ * x_len. For every record the generator writes a struct (strings and
+ * tags are slices of the source, lists are arrays with a length) and
+ * functions that decode it straight from the events of the pull reader
+ * and encode it with the value writer, with no lison_t in between.
+ * Tags are resolved to fields by a switch on their length generated from
+ * the schema. Unknown, repeated or missing fields and values of the wrong
+ * type fail the decoding.
+ *
+ * --------------------------------------------------------------
+ * Usage:
+ * $> lsngen schema.lsn out
+ * writes out.h and out.c
+ */
+
+#define MAX_FIELDS 64
+#define MAX_NAME 100
+
+typedef enum _kind_t
+{
+	Kind_String,
+	Kind_Tag,
+	Kind_Int,
+	Kind_Float,
+	Kind_Record,
+} kind_t;
+
+typedef struct _field_t
+{
+	str_t name;
+	kind_t kind;
+	size_t record; // Kind_Record
+	bool list;
+} field_t;
+
+typedef struct _record_t
+{
+	str_t name;
+	field_t fields[MAX_FIELDS];
+	size_t fields_len;
+} record_t;
+
+typedef struct _schema_t
+{
+	record_t* records;
+	size_t len;
+} schema_t;
+
+// constant text of the encoders, written in one call before every value
+typedef struct _raw_t
+{
+	char data[256];
+	size_t len;
+} raw_t;
+
+static const char* builtins[] = { "string", "tag", "int", "float", "list" };
+
+static const char* keywords[] = {
+	"auto", "bool", "break", "case", "char", "const", "continue", "default", "do",
+	"double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int",
+	"long", "register", "restrict", "return", "short", "signed", "sizeof", "static",
+	"struct", "switch", "typedef", "union", "unsigned", "void", "volatile", "while",
+};
+
+// records become <name>_t next to the types of lsn.h and the headers it includes
+static const char* taken[] = {
+	"str", "cstring", "regex", "regex_type", "regex_pair", "regex_inter", "regex_negate", "match_res",
+	"parse_res", "token", "token_stream", "token_node", "size", "ssize", "ptrdiff", "wchar", "intptr",
+	"uintptr", "intmax", "uintmax", "int8", "int16", "int32", "int64", "uint8", "uint16", "uint32",
+	"uint64", "max_align", "fpos", "off", "div", "ldiv", "lldiv", "mbstate", "locale", "time", "clock",
+	"clockid", "timer", "sigset", "pid", "uid", "gid", "id", "mode", "dev", "ino", "key",
+};
+
+static const char* taken_prefixes[] = { "_", "lsn_", "lison", "rgx_", "pthread", "int_", "uint_" };
+
+static bool is_word(const str_t* name, const char** words, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		if (strlen(words[i]) == name->len && memcmp(words[i], name->data, name->len) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool has_prefix(const str_t* name, const char** prefixes, size_t len)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		size_t prefix_len = strlen(prefixes[i]);
+		if (prefix_len <= name->len && memcmp(prefixes[i], name->data, prefix_len) == 0)
+			return true;
+	}
+	return false;
+}
+
+static bool is_identifier(const str_t* name)
+{
+	if (name->len == 0 || (name->data[0] >= '0' && name->data[0] <= '9'))
+		return false;
+	for (size_t i = 0; i < name->len; i++)
+	{
+		char c = name->data[i];
+		if (!(c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')))
+			return false;
+	}
+	return !is_word(name, keywords, sizeof(keywords) / sizeof(keywords[0]));
+}
+
+static bool same(const str_t* a, const str_t* b)
+{
+	return a->len == b->len && memcmp(a->data, b->data, a->len) == 0;
+}
+
+// lists get a <name>_len member
+static bool is_len_of(const field_t* field, const field_t* list)
+{
+	return list->list && field->name.len == list->name.len + 4 && memcmp(field->name.data, list->name.data, list->name.len) == 0 &&
+		memcmp(field->name.data + list->name.len, "_len", 4) == 0;
+}
+
+static bool fail(const char* what, const str_t* name)
+{
+	if (name)
+		fprintf(stderr, "lsngen: %s: %.*s\n", what, (int)name->len, name->data);
+	else
+		fprintf(stderr, "lsngen: %s\n", what);
+	return false;
+}
+
+static bool read_type(const schema_t* schema, const lison_t* type, field_t* field)
+{
+	if (type->tag == LSN_Object)
+	{
+		// (:list :type)
+		const lison_node_t* head = type->value.object.head;
+		str_t list = { "list", 4 };
+		if (!head || !head->next || head->next->next || head->value->tag != LSN_Tag)
+			return fail("invalid list type of field", &field->name);
+		str_t name = lsn_str(head->value);
+		if (!same(&name, &list) || head->next->value->tag == LSN_Object)
+			return fail("invalid list type of field", &field->name);
+		field->list = true;
+		type = head->next->value;
+	}
+	if (type->tag != LSN_Tag)
+		return fail("invalid type of field", &field->name);
+
+	str_t name = lsn_str(type);
+	for (size_t i = 0; i < 4; i++)
+	{
+		if (strlen(builtins[i]) == name.len && memcmp(builtins[i], name.data, name.len) == 0)
+		{
+			field->kind = (kind_t)i;
+			return true;
+		}
+	}
+	for (size_t i = 0; i < schema->len; i++)
+	{
+		if (same(&schema->records[i].name, &name))
+		{
+			field->kind = Kind_Record;
+			field->record = i;
+			return true;
+		}
+	}
+	return fail("unknown type (records must be defined before use)", &name);
+}
+
+static bool read_record(schema_t* schema, const lison_t* fields, record_t* record)
+{
+	if (fields->tag != LSN_Object || !fields->value.object.head)
+		return fail("a record needs a list of fields", &record->name);
+	for (const lison_node_t* it = fields->value.object.head; it; it = it->next->next)
+	{
+		if (it->value->tag != LSN_Tag || !it->next)
+			return fail("fields are tags with a type in record", &record->name);
+		if (record->fields_len == MAX_FIELDS)
+			return fail("too many fields in record", &record->name);
+		field_t* field = &record->fields[record->fields_len];
+		*field = (field_t) { .name = lsn_str(it->value), .kind = Kind_String, .record = 0, .list = false };
+		if (!is_identifier(&field->name))
+			return fail("field name is not a C identifier", &field->name);
+		if (field->name.len > MAX_NAME)
+			return fail("field name too long", &field->name);
+		for (size_t i = 0; i < record->fields_len; i++)
+		{
+			if (same(&record->fields[i].name, &field->name))
+				return fail("repeated field", &field->name);
+		}
+		if (!read_type(schema, it->next->value, field))
+			return false;
+		for (size_t i = 0; i < record->fields_len; i++)
+		{
+			if (is_len_of(field, &record->fields[i]) || is_len_of(&record->fields[i], field))
+				return fail("field clashes with the length of a list", &field->name);
+		}
+		record->fields_len++;
+	}
+	return true;
+}
+
+static bool read_schema(const lison_t* root, schema_t* schema)
+{
+	if (!root || root->tag != LSN_Object || !root->value.object.head)
+		return fail("the schema must be a list of records", NULL);
+	size_t cap = 0;
+	for (const lison_node_t* it = root->value.object.head; it; it = it->next->next)
+	{
+		if (it->value->tag != LSN_Tag || !it->next)
+			return fail("records are tags with a list of fields", NULL);
+		if (schema->len == cap)
+		{
+			cap = cap ? 2 * cap : 8;
+			schema->records = (record_t*)realloc(schema->records, cap * sizeof(record_t));
+		}
+		record_t* record = &schema->records[schema->len];
+		record->name = lsn_str(it->value);
+		record->fields_len = 0;
+		if (!is_identifier(&record->name))
+			return fail("record name is not a C identifier", &record->name);
+		if (record->name.len > MAX_NAME)
+			return fail("record name too long", &record->name);
+		if (is_word(&record->name, builtins, sizeof(builtins) / sizeof(builtins[0])))
+			return fail("record name is a type", &record->name);
+		if (is_word(&record->name, taken, sizeof(taken) / sizeof(taken[0])) ||
+			has_prefix(&record->name, taken_prefixes, sizeof(taken_prefixes) / sizeof(taken_prefixes[0])))
+			return fail("record name is taken by lsn.h", &record->name);
+		for (size_t i = 0; i < schema->len; i++)
+		{
+			if (same(&schema->records[i].name, &record->name))
+				return fail("repeated record", &record->name);
+		}
+		if (!read_record(schema, it->next->value, record))
+			return false;
+		schema->len++;
+	}
+	return true;
+}
+
+// writing ----------------------------------------------
+
+static const char* c_types[] = { "str_t", "str_t", "int32_t", "float" };
+static const char* decoders[] = { "decode_string", "decode_tag", "decode_int", "decode_float" };
+static const char* encoders[] = { "lsn_writer_string", "lsn_writer_tag", "lsn_writer_integer", "lsn_writer_float" };
+
+#define NAME(s) (int)(s).len, (s).data
+
+static void write_header(FILE* out, const schema_t* schema, const char* guard)
+{
+	fprintf(out, "// generated by lsngen, do not edit\n");
+	fprintf(out, "#ifndef %s_H\n#define %s_H\n\n#include <lsn.h>\n", guard, guard);
+	for (size_t r = 0; r < schema->len; r++)
+	{
+		const record_t* rec = &schema->records[r];
+		fprintf(out, "\ntypedef struct _%.*s_t\n{\n", NAME(rec->name));
+		for (size_t f = 0; f < rec->fields_len; f++)
+		{
+			const field_t* field = &rec->fields[f];
+			const str_t* type = field->kind == Kind_Record ? &schema->records[field->record].name : NULL;
+			if (type)
+				fprintf(out, "\t%.*s_t", NAME(*type));
+			else
+				fprintf(out, "\t%s", c_types[field->kind]);
+			fprintf(out, "%s %.*s;", field->list ? "*" : "", NAME(field->name));
+			if (field->kind == Kind_String || field->kind == Kind_Tag)
+				fprintf(out, " // slice%s of the source", field->list ? "s" : "");
+			if (field->list)
+				fprintf(out, "\n\tsize_t %.*s_len;", NAME(field->name));
+			fprintf(out, "\n");
+		}
+		fprintf(out, "} %.*s_t;\n", NAME(rec->name));
+	}
+
+	fprintf(out, "\n/**\n * Decoders, strings and tags are slices of the source, which must outlive\n");
+	fprintf(out, " * the records. _decode reads the object at the LSN_EV_ObjectStart of the\n");
+	fprintf(out, " * reader, _parse a whole document. Both free what they decoded on failure.\n */\n");
+	for (size_t r = 0; r < schema->len; r++)
+	{
+		str_t name = schema->records[r].name;
+		fprintf(out, "bool %.*s_decode(lsn_reader_t* reader, %.*s_t* out);\n", NAME(name), NAME(name));
+		fprintf(out, "bool %.*s_parse(char* src, size_t len, %.*s_t* out);\n", NAME(name), NAME(name));
+		fprintf(out, "void %.*s_free(%.*s_t* value);\n", NAME(name), NAME(name));
+	}
+	fprintf(out, "\n// encoders, false from _write as lsn_writer_delete\n");
+	for (size_t r = 0; r < schema->len; r++)
+	{
+		str_t name = schema->records[r].name;
+		fprintf(out, "void %.*s_encode(lsn_writer_t* w, const %.*s_t* value);\n", NAME(name), NAME(name));
+		fprintf(out, "bool %.*s_write(int fd, const %.*s_t* value);\n", NAME(name), NAME(name));
+	}
+	fprintf(out, "\n#endif //%s_H\n", guard);
+}
+
+static const char* helpers =
+	"\nstatic inline bool decode_string(const lsn_reader_t* reader, str_t* out)\n"
+	"{\n"
+	"\t*out = reader->event.value.string;\n"
+	"\treturn reader->event.tag == LSN_EV_String;\n"
+	"}\n"
+	"\nstatic inline bool decode_tag(const lsn_reader_t* reader, str_t* out)\n"
+	"{\n"
+	"\t*out = reader->event.value.tag;\n"
+	"\treturn reader->event.tag == LSN_EV_Tag;\n"
+	"}\n"
+	"\nstatic inline bool decode_int(const lsn_reader_t* reader, int32_t* out)\n"
+	"{\n"
+	"\t*out = reader->event.value.integer;\n"
+	"\treturn reader->event.tag == LSN_EV_Integer;\n"
+	"}\n"
+	"\n// integers are taken as floats too\n"
+	"static inline bool decode_float(const lsn_reader_t* reader, float* out)\n"
+	"{\n"
+	"\tif (reader->event.tag == LSN_EV_Integer)\n"
+	"\t\t*out = (float)reader->event.value.integer;\n"
+	"\telse\n"
+	"\t\t*out = reader->event.value.lsn_float;\n"
+	"\treturn reader->event.tag == LSN_EV_Integer || reader->event.tag == LSN_EV_Float;\n"
+	"}\n";
+
+static void write_field_switch(FILE* out, const record_t* rec)
+{
+	fprintf(out, "\nstatic int %.*s_field(const str_t* tag)\n{\n\tswitch (tag->len)\n\t{\n", NAME(rec->name));
+	bool done[MAX_FIELDS] = { false };
+	for (size_t f = 0; f < rec->fields_len; f++)
+	{
+		if (done[f])
+			continue;
+		size_t len = rec->fields[f].name.len;
+		fprintf(out, "\tcase %zu:\n", len);
+		for (size_t g = f; g < rec->fields_len; g++)
+		{
+			if (rec->fields[g].name.len != len)
+				continue;
+			done[g] = true;
+			fprintf(out, "\t\tif (memcmp(tag->data, \"%.*s\", %zu) == 0)\n\t\t\treturn %zu;\n",
+				NAME(rec->fields[g].name), len, g);
+		}
+		fprintf(out, "\t\tbreak;\n");
+	}
+	fprintf(out, "\tdefault:\n\t\tbreak;\n\t}\n\treturn -1;\n}\n");
+}
+
+// the decoder of one value at the current event into target
+static void write_decode_value(FILE* out, const schema_t* schema, const field_t* field, const char* target, const char* indent)
+{
+	if (field->kind == Kind_Record)
+		fprintf(out, "%sok = %.*s_decode(reader, %s);\n", indent, NAME(schema->records[field->record].name), target);
+	else
+		fprintf(out, "%sok = %s(reader, %s);\n", indent, decoders[field->kind], target);
+}
+
+static void write_decoder(FILE* out, const schema_t* schema, const record_t* rec)
+{
+	str_t name = rec->name;
+	uint64_t all = rec->fields_len == 64 ? ~(uint64_t)0 : ((uint64_t)1 << rec->fields_len) - 1;
+	fprintf(out, "\nbool %.*s_decode(lsn_reader_t* reader, %.*s_t* out)\n{\n", NAME(name), NAME(name));
+	fprintf(out, "\tmemset(out, 0, sizeof(*out));\n");
+	fprintf(out, "\tif (reader->event.tag != LSN_EV_ObjectStart)\n\t\treturn false;\n");
+	fprintf(out, "\tuint64_t seen = 0;\n\tbool ok = true;\n");
+	fprintf(out, "\twhile (ok && lsn_next(reader) == LSN_EV_Tag)\n\t{\n");
+	fprintf(out, "\t\tint field = %.*s_field(&reader->event.value.tag);\n", NAME(name));
+	fprintf(out, "\t\tok = field >= 0 && !(seen >> field & 1);\n\t\tif (!ok)\n\t\t\tbreak;\n");
+	fprintf(out, "\t\tseen |= (uint64_t)1 << field;\n");
+	fprintf(out, "\t\tlsn_next(reader);\n");
+	fprintf(out, "\t\tswitch (field)\n\t\t{\n");
+	for (size_t f = 0; f < rec->fields_len; f++)
+	{
+		const field_t* field = &rec->fields[f];
+		char target[300];
+		fprintf(out, "\t\tcase %zu:\n", f);
+		if (!field->list)
+		{
+			snprintf(target, sizeof(target), "&out->%.*s", NAME(field->name));
+			write_decode_value(out, schema, field, target, "\t\t\t");
+			fprintf(out, "\t\t\tbreak;\n");
+			continue;
+		}
+		// a failed item is counted, it is already freed and zeroed
+		str_t type = field->kind == Kind_Record ? schema->records[field->record].name : (str_t) { NULL, 0 };
+		char c_type[300];
+		if (type.data)
+			snprintf(c_type, sizeof(c_type), "%.*s_t", NAME(type));
+		else
+			snprintf(c_type, sizeof(c_type), "%s", c_types[field->kind]);
+		snprintf(target, sizeof(target), "&out->%.*s[out->%.*s_len]", NAME(field->name), NAME(field->name));
+		fprintf(out, "\t\t{\n\t\t\tok = reader->event.tag == LSN_EV_ObjectStart;\n");
+		fprintf(out, "\t\t\tfor (size_t cap = 0; ok && lsn_next(reader) != LSN_EV_ObjectEnd; out->%.*s_len++)\n\t\t\t{\n",
+			NAME(field->name));
+		fprintf(out, "\t\t\t\tif (out->%.*s_len == cap)\n\t\t\t\t{\n", NAME(field->name));
+		fprintf(out, "\t\t\t\t\tcap = cap ? 2 * cap : 8;\n");
+		fprintf(out, "\t\t\t\t\tout->%.*s = (%s*)realloc(out->%.*s, cap * sizeof(%s));\n",
+			NAME(field->name), c_type, NAME(field->name), c_type);
+		fprintf(out, "\t\t\t\t}\n");
+		write_decode_value(out, schema, field, target, "\t\t\t\t");
+		fprintf(out, "\t\t\t}\n\t\t\tbreak;\n\t\t}\n");
+	}
+	fprintf(out, "\t\tdefault:\n\t\t\tbreak;\n\t\t}\n\t}\n");
+	fprintf(out, "\tif (!ok || reader->event.tag != LSN_EV_ObjectEnd || seen != 0x%llxull)\n", (unsigned long long)all);
+	fprintf(out, "\t{\n\t\t%.*s_free(out);\n\t\treturn false;\n\t}\n\treturn true;\n}\n", NAME(name));
+
+	fprintf(out, "\nbool %.*s_parse(char* src, size_t len, %.*s_t* out)\n{\n", NAME(name), NAME(name));
+	fprintf(out, "\tlsn_reader_t reader;\n\tlsn_reader_init(&reader, src, len, NULL);\n\tlsn_next(&reader);\n");
+	fprintf(out, "\tif (!%.*s_decode(&reader, out))\n\t\treturn false;\n", NAME(name));
+	fprintf(out, "\tif (lsn_next(&reader) != LSN_EV_End)\n\t{\n\t\t%.*s_free(out);\n\t\treturn false;\n\t}\n", NAME(name));
+	fprintf(out, "\treturn true;\n}\n");
+
+	fprintf(out, "\nvoid %.*s_free(%.*s_t* value)\n{\n", NAME(name), NAME(name));
+	for (size_t f = 0; f < rec->fields_len; f++)
+	{
+		const field_t* field = &rec->fields[f];
+		str_t type = schema->records[field->record].name;
+		if (field->kind == Kind_Record && field->list)
+		{
+			fprintf(out, "\tfor (size_t i = 0; i < value->%.*s_len; i++)\n", NAME(field->name));
+			fprintf(out, "\t\t%.*s_free(&value->%.*s[i]);\n", NAME(type), NAME(field->name));
+		}
+		else if (field->kind == Kind_Record)
+			fprintf(out, "\t%.*s_free(&value->%.*s);\n", NAME(type), NAME(field->name));
+		if (field->list)
+			fprintf(out, "\tfree(value->%.*s);\n", NAME(field->name));
+	}
+	fprintf(out, "\tmemset(value, 0, sizeof(*value));\n}\n");
+}
+
+static void raw_add(raw_t* raw, const char* text, const str_t* name)
+{
+	size_t len = strlen(text);
+	memcpy(raw->data + raw->len, text, len);
+	raw->len += len;
+	if (name)
+	{
+		memcpy(raw->data + raw->len, name->data, name->len);
+		raw->len += name->len;
+	}
+}
+
+static void raw_flush(FILE* out, raw_t* raw, const char* indent)
+{
+	if (raw->len)
+		fprintf(out, "%slsn_writer_raw(w, \"%.*s\", %zu);\n", indent, (int)raw->len, raw->data, raw->len);
+	raw->len = 0;
+}
+
+static void write_encode_value(FILE* out, const schema_t* schema, const field_t* field, const char* source, const char* indent)
+{
+	if (field->kind == Kind_Record)
+		fprintf(out, "%s%.*s_encode(w, %s);\n", indent, NAME(schema->records[field->record].name), source);
+	else if (field->kind == Kind_String || field->kind == Kind_Tag)
+		fprintf(out, "%s%s(w, &%s);\n", indent, encoders[field->kind], source);
+	else
+		fprintf(out, "%s%s(w, %s);\n", indent, encoders[field->kind], source);
+}
+
+static void write_encoder(FILE* out, const schema_t* schema, const record_t* rec)
+{
+	str_t name = rec->name;
+	fprintf(out, "\nvoid %.*s_encode(lsn_writer_t* w, const %.*s_t* value)\n{\n", NAME(name), NAME(name));
+	raw_t raw = { .len = 0 };
+	for (size_t f = 0; f < rec->fields_len; f++)
+	{
+		const field_t* field = &rec->fields[f];
+		raw_add(&raw, f ? " :" : "(:", &field->name);
+		raw_add(&raw, field->list ? " (" : " ", NULL);
+		raw_flush(out, &raw, "\t");
+		char source[300];
+		if (field->list)
+		{
+			fprintf(out, "\tfor (size_t i = 0; i < value->%.*s_len; i++)\n\t{\n", NAME(field->name));
+			fprintf(out, "\t\tif (i)\n\t\t\tlsn_writer_raw(w, \" \", 1);\n");
+			snprintf(source, sizeof(source), "%svalue->%.*s[i]", field->kind == Kind_Record ? "&" : "", NAME(field->name));
+			write_encode_value(out, schema, field, source, "\t\t");
+			fprintf(out, "\t}\n");
+			raw_add(&raw, ")", NULL);
+		}
+		else
+		{
+			snprintf(source, sizeof(source), "%svalue->%.*s", field->kind == Kind_Record ? "&" : "", NAME(field->name));
+			write_encode_value(out, schema, field, source, "\t");
+		}
+	}
+	raw_add(&raw, ")", NULL);
+	raw_flush(out, &raw, "\t");
+	fprintf(out, "}\n");
+
+	fprintf(out, "\nbool %.*s_write(int fd, const %.*s_t* value)\n{\n", NAME(name), NAME(name));
+	fprintf(out, "\tlsn_writer_t* w = lsn_writer_new(fd);\n\t%.*s_encode(w, value);\n", NAME(name));
+	fprintf(out, "\treturn lsn_writer_delete(&w);\n}\n");
+}
+
+static void write_source(FILE* out, const schema_t* schema, const char* header)
+{
+	fprintf(out, "// generated by lsngen, do not edit\n#include \"%s\"\n", header);
+	fprintf(out, "%s", helpers);
+	for (size_t r = 0; r < schema->len; r++)
+	{
+		write_field_switch(out, &schema->records[r]);
+		write_decoder(out, schema, &schema->records[r]);
+		write_encoder(out, schema, &schema->records[r]);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: lsngen schema.lsn out (writes out.h and out.c)\n");
+}
+
+int main(int argc, char** argv)
+{
+	if (argc != 3)
+	{
+		usage();
+		return 2;
+	}
+	lison_t* root = lsn_deserialize(argv[1]);
+	if (!root)
+	{
+		fprintf(stderr, "lsngen: cannot read %s\n", argv[1]);
+		return 1;
+	}
+	schema_t schema = { .records = NULL, .len = 0 };
+	bool ok = read_schema(root, &schema);
+
+	// the guard from the file name of the output
+	const char* base = strrchr(argv[2], '/');
+	base = base ? base + 1 : argv[2];
+	size_t base_len = strlen(base);
+	char* guard = (char*)malloc(base_len + 1);
+	for (size_t i = 0; i <= base_len; i++)
+	{
+		char c = base[i];
+		guard[i] = c >= 'a' && c <= 'z' ? (char)(c - 'a' + 'A') : ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || !c ? c : '_');
+	}
+
+	size_t path_len = strlen(argv[2]) + 3;
+	char* header = (char*)malloc(path_len);
+	char* source = (char*)malloc(path_len);
+	snprintf(header, path_len, "%s.h", argv[2]);
+	snprintf(source, path_len, "%s.c", argv[2]);
+	FILE* h = ok ? fopen(header, "w") : NULL;
+	FILE* c = ok ? fopen(source, "w") : NULL;
+	if (ok && (!h || !c))
+		ok = fail("cannot write the output", NULL);
+	if (ok)
+	{
+		// the source includes the header from its own directory
+		size_t header_base = strlen(header) - base_len - 2;
+		write_header(h, &schema, guard);
+		write_source(c, &schema, header + header_base);
+	}
+	if (h && fclose(h) != 0)
+		ok = fail("cannot write the output", NULL);
+	if (c && fclose(c) != 0)
+		ok = fail("cannot write the output", NULL);
+
+	free(guard);
+	free(header);
+	free(source);
+	free(schema.records);
+	lsn_delete(&root);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+#include "lsn.h"
+
+/**
+ * Parallel compilation of large documents.
+ * The structural index gives the children of every list without parsing
+ * them. Starting at the root, the parser descends into a child while it
+ * holds most of the bytes of its parent (the record list of a document
+ * like (:persons (...))). The children of that list are cut into ranges
+ * of about the same size at value boundaries, and every range is compiled
+ * by its own thread into its own arena. The lists are then linked in
+ * order and the arenas merged into the document. The few values around
+ * the path of the descent are compiled on the calling thread.
+ */
+
+// ranges smaller than this are not worth a thread
+#define LSN_PAR_MIN_RANGE (16u << 10)
+
+typedef struct _lsn_par_job_t
+{
+	char* src;
+	size_t len;
+	size_t depth;
+	const lsn_options_t* opt;
+	lsn_arena_t arena;
+	lison_list_t items;
+	bool ok;
+	pthread_t thread;
+} lsn_par_job_t;
+
+static void* lsn_par_worker(void* arg)
+{
+	lsn_par_job_t* job = (lsn_par_job_t*)arg;
+	job->ok = lsn_compile_items(&job->arena, job->src, job->len, job->opt, job->depth, &job->items);
+	return NULL;
+}
+
+static void lsn_par_link(lison_list_t* list, const lison_list_t* tail)
+{
+	if (!tail->head)
+		return;
+	if (list->head)
+	{
+		list->tail->next = tail->head;
+		tail->head->prev = list->tail;
+	}
+	else
+		list->head = tail->head;
+	list->tail = tail->tail;
+	LSN_LST_INDEX(list) = NULL;
+}
+
+/**
+ * Position after the value at idx in the index, jumping over objects.
+ */
+static size_t lsn_par_skip(const char* src, const lsn_structural_t* index, const uint32_t* match, size_t idx)
+{
+	return src[index->offsets[idx]] == '(' ? match[idx] + 1 : idx + 1;
+}
+
+/**
+ * The child of the object at idx that holds more than half of its bytes,
+ * 0 if there is none.
+ */
+static size_t lsn_par_dominant(const char* src, const lsn_structural_t* index, const uint32_t* match, size_t idx)
+{
+	size_t end = match[idx];
+	size_t bytes = index->offsets[end] - index->offsets[idx];
+	for (size_t it = idx + 1; it < end; it = lsn_par_skip(src, index, match, it))
+	{
+		if (src[index->offsets[it]] == '(' && 2 * (size_t)(index->offsets[match[it]] - index->offsets[it]) > bytes)
+			return it;
+	}
+	return 0;
+}
+
+/**
+ * Compiles the children of the object at idx with up to threads threads.
+ */
+static bool lsn_par_split(lsn_doc_t* doc, char* src, const lsn_structural_t* index, const uint32_t* match, size_t idx,
+	size_t threads, const lsn_options_t* opt, size_t depth, lison_list_t* items)
+{
+	size_t begin = index->offsets[idx] + 1;
+	size_t end = index->offsets[match[idx]];
+	size_t ranges = (end - begin) / LSN_PAR_MIN_RANGE;
+	if (ranges > threads)
+		ranges = threads;
+	if (ranges < 2)
+		return lsn_compile_items(&doc->arena, src + begin, end - begin, opt, depth, items);
+
+	// cut at the first value that starts after every share of the bytes
+	lsn_par_job_t* jobs = (lsn_par_job_t*)calloc(ranges, sizeof(lsn_par_job_t));
+	size_t count = 0;
+	size_t start = begin;
+	size_t it = idx + 1;
+	for (size_t r = 1; r <= ranges; r++)
+	{
+		size_t stop = end;
+		if (r < ranges)
+		{
+			size_t share = begin + r * (end - begin) / ranges;
+			while (it < match[idx] && index->offsets[it] < share)
+				it = lsn_par_skip(src, index, match, it);
+			stop = index->offsets[it];
+		}
+		if (stop == start)
+			continue;
+		lsn_par_job_t* job = &jobs[count++];
+		job->src = src + start;
+		job->len = stop - start;
+		job->depth = depth;
+		job->opt = opt;
+		lsn_ar_init(&job->arena, 2 * job->len, doc->arena.flags);
+		start = stop;
+	}
+
+	size_t started = 0;
+	for (; started < count; started++)
+	{
+		if (pthread_create(&jobs[started].thread, NULL, lsn_par_worker, &jobs[started]) != 0)
+			break;
+	}
+	// whatever could not get a thread runs here
+	for (size_t i = started; i < count; i++)
+		lsn_par_worker(&jobs[i]);
+
+	bool res = true;
+	lsn_lst_init(items);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (i < started)
+			pthread_join(jobs[i].thread, NULL);
+		res = res && jobs[i].ok;
+		if (jobs[i].ok)
+			lsn_par_link(items, &jobs[i].items);
+		lsn_ar_merge(&doc->arena, &jobs[i].arena);
+	}
+	free(jobs);
+	return res;
+}
+
+/**
+ * Compiles the object at idx: its dominant child recursively, the values
+ * around it in one go each, and otherwise its children in parallel.
+ */
+static lison_t* lsn_par_object(lsn_doc_t* doc, char* src, const lsn_structural_t* index, const uint32_t* match, size_t idx,
+	size_t threads, const lsn_options_t* opt, size_t depth)
+{
+	size_t max_depth = opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	if (depth >= max_depth)
+	{
+		LOG("[LSN PARALLEL] Nesting deeper than %zu\n", max_depth);
+		return NULL;
+	}
+	lison_list_t items;
+	size_t child = lsn_par_dominant(src, index, match, idx);
+	if (child)
+	{
+		lison_list_t before, after;
+		size_t begin = index->offsets[idx] + 1;
+		size_t child_begin = index->offsets[child];
+		size_t child_end = index->offsets[match[child]] + 1;
+		size_t end = index->offsets[match[idx]];
+		if (!lsn_compile_items(&doc->arena, src + begin, child_begin - begin, opt, depth + 1, &before))
+			return NULL;
+		lison_t* inner = lsn_par_object(doc, src, index, match, child, threads, opt, depth + 1);
+		if (!inner || !lsn_compile_items(&doc->arena, src + child_end, end - child_end, opt, depth + 1, &after))
+			return NULL;
+		items = before;
+		lsn_ar_lst_append(&doc->arena, &items, inner);
+		lsn_par_link(&items, &after);
+	}
+	else if (!lsn_par_split(doc, src, index, match, idx, threads, opt, depth + 1, &items))
+		return NULL;
+
+	// the split list is built from ranges, its values are packed here
+	lison_t* packed = (opt->flags & LSN_OPT_Pack) ? lsn_ar_pack(&doc->arena, &items) : NULL;
+	if (packed)
+		return packed;
+	if (opt->flags & LSN_OPT_Index)
+		lsn_index_attach(&doc->arena, &items);
+	return lsn_ar_object(&doc->arena, items);
+}
+
+// API --------------------------------------------------
+
+lsn_doc_t* lsn_compile_parallel(char* src, size_t threads, const lsn_options_t* opt)
+{
+	size_t len = strlen(src);
+	if (threads < 2 || len < 2 * LSN_PAR_MIN_RANGE)
+		return lsn_compile_doc(src, opt);
+
+	// the root must be one object with nothing after it
+	lsn_structural_t index;
+	lsn_structural_init(&index);
+	if (!lsn_structural_index(src, len, &index) || index.len == 0 || src[index.offsets[0]] != '(')
+	{
+		// atoms, empty and huge sources
+		lsn_structural_delete(&index);
+		return lsn_compile_doc(src, opt);
+	}
+	uint32_t* match = lsn_structural_match(src, &index);
+	if (!match || match[0] + 1 != index.len)
+	{
+		LOG("[LSN PARALLEL] Unbalanced parens or values after the root\n");
+		lsn_structural_delete(&index);
+		free(match);
+		return NULL;
+	}
+
+	lsn_options_t local = opt ? *opt : (lsn_options_t) { .max_depth = 0, .flags = 0, .symbols = NULL };
+	lsn_options_t without_intern = local;
+	without_intern.flags &= ~(uint32_t)LSN_OPT_Intern;
+	// the tree goes into the arenas of the workers
+	lsn_doc_t* doc = lsn_doc_new(0, &without_intern);
+	// the workers intern into one table
+	if (!local.symbols && (local.flags & LSN_OPT_Intern))
+	{
+		doc->symbols = (lsn_symtab_t*)lsn_ar_alloc(&doc->arena, sizeof(lsn_symtab_t));
+		lsn_sym_init(doc->symbols, true);
+		doc->owns_symbols = true;
+		local.symbols = doc->symbols;
+	}
+
+	doc->root = lsn_par_object(doc, src, &index, match, 0, threads, &local, 0);
+	lsn_structural_delete(&index);
+	free(match);
+	if (!doc->root)
+		lsn_doc_delete(&doc);
+	return doc;
+}
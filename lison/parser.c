@@ -1,58 +1,47 @@
 #include "lsn.h"
-#include <rgx.h>
 
 
 // Token Stream driver
 void lsn_ts_init(lsn_token_stream_t* stream)
 {
 	if (!stream) return;
-	if (stream->head)
+	if (stream->tokens)
 		lsn_ts_delete(stream);
 
-	// continue with init
-	stream->head = (lsn_token_node_t*)malloc(sizeof(lsn_token_node_t));
-	stream->head->next = NULL;
-	stream->head->prev = NULL;
-	stream->head->value.tag = LSN_TKN_EOF;
-	stream->tail = stream->head;
+	// continue with init, the array always ends with the EOF sentinel
+	stream->cap = LSN_TS_INIT_CAP;
+	stream->tokens = (lsn_token_t*)malloc(stream->cap * sizeof(lsn_token_t));
+	stream->len = 0;
+	stream->tokens[0].tag = LSN_TKN_EOF;
 }
 
 void lsn_ts_delete(lsn_token_stream_t* stream)
 {
 	if (stream == NULL) return;
-	lsn_token_node_t* del = stream->head;
-	lsn_token_node_t* next = del;
+	LOG("[LISON STREAM] Deleting %zu tokens\n", stream->len);
+	free(stream->tokens);
+	stream->tokens = NULL;
+	stream->len = 0;
+	stream->cap = 0;
+}
 
-	while (del != NULL)
-	{
-		next = del->next;
-		LOG("[LISON STREAM] Deleting token(%d)\n", del->value.tag);
-		free(del);
-		del = next;
-	} 
-	stream->head = NULL;
-	stream->tail = NULL;
+void lsn_ts_reserve(lsn_token_stream_t* stream, size_t len)
+{
+	if (len + 1 <= stream->cap)
+		return;
+	size_t cap = stream->cap ? stream->cap : LSN_TS_INIT_CAP;
+	while (cap < len + 1)
+		cap *= 2;
+	stream->tokens = (lsn_token_t*)realloc(stream->tokens, cap * sizeof(lsn_token_t));
+	stream->cap = cap;
 }
 
 void lsn_ts_append(lsn_token_stream_t* stream, lsn_token_t tkn)
 {
-	lsn_token_node_t* new = 
-		(lsn_token_node_t*)malloc(sizeof(lsn_token_node_t));
-	new->value = tkn;
-	if (stream->head == stream->tail)
-	{
-		new->prev = NULL;
-		new->next = stream->tail;
-		stream->head = new;
-		stream->tail->prev = new;
-	}
-	else
-	{
-		stream->tail->prev->next = new;
-		new->prev = stream->tail->prev;
-		stream->tail->prev = new;
-		new->next = stream->tail;
-	}
+	if (stream->len + 2 > stream->cap)
+		lsn_ts_reserve(stream, stream->len + 1);
+	stream->tokens[stream->len++] = tkn;
+	stream->tokens[stream->len].tag = LSN_TKN_EOF;
 }
 
 void print_str(const str_t* str)
@@ -97,6 +86,7 @@ void lsn_print_token(const lsn_token_t* tkn)
 		printf("[*)]");
 		break;
 	case LSN_TKN_Whitespace:
+	case LSN_TKN_Error:
 		break;
 	}
 }
@@ -104,224 +94,439 @@ void lsn_print_token(const lsn_token_t* tkn)
 void lsn_ts_print(lsn_token_stream_t* stream)
 {
 	printf("{");
-	lsn_token_node_t* it = stream->head;
-	while (it != NULL)
+	// the sentinel is printed as well
+	for (size_t i = 0; i <= stream->len; i++)
 	{
-		lsn_print_token(&it->value);
-		if (it->next)printf(", ");
-		it = it->next;
+		lsn_print_token(&stream->tokens[i]);
+		if (i < stream->len) printf(", ");
 	}
 	printf("}\n");
 }
 
-// Parser 
-void lsn_tokenize(char* src, lsn_token_stream_t* stream)
-{
-	// list of regexes (the poor C programmer's static map)
-	regex_t* regex[LSN_TKN_EOF] = {
-		[LSN_TKN_CommStart] = rgx_compile("\\(\\*"),
-		[LSN_TKN_CommEnd] = rgx_compile("\\*\\)"),
-		[LSN_TKN_LParen] = rgx_compile("\\("),
-		[LSN_TKN_RParen] = rgx_compile("\\)"),
-		[LSN_TKN_String] = rgx_compile("'(\\c|\\w|\\d)*'"),
-		[LSN_TKN_Tag] = rgx_compile(":(\\c|\\d)+"),
-		[LSN_TKN_Float] = rgx_compile("\\d+.\\d+"),
-		[LSN_TKN_Integer] = rgx_compile("\\d+"),
-		[LSN_TKN_Whitespace] = rgx_compile("\\w"),
-	};
+// Lexer
+/*
+ * Character classes of the lexer, indexed by byte:
+ * - LSN_CH_String: may appear between quotes (\c, \w, \d)
+ * - LSN_CH_Tag: may follow the colon of a tag (\c without the parens, \d)
+ * - LSN_CH_Space: skipped between tokens
+ * - LSN_CH_Digit: 0-9
+ */
+#define LSN_CH_String 1
+#define LSN_CH_Tag 2
+#define LSN_CH_Space 4
+#define LSN_CH_Digit 8
+
+static const uint8_t lsn_char_class[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 5, 5, 0, 0, 4, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	5, 3, 0, 0, 3, 3, 3, 0, 1, 1, 0, 0, 3, 3, 3, 3,
+	11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 3, 0, 0,
+	0, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,
+	3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 0, 0, 0, 0, 0,
+	// the rest is 0
+};
+
+#define LSN_IS(c, cls) (lsn_char_class[(unsigned char)(c)] & (cls))
 
-	/* for (size_t i=0;i<LSN_TKN_EOF;i++) */
-	/* { */
-	/* 	printf("Regex No. %lu\n", i); */
-	/* 	rgx_print_regex(regex[i], 0); */
-	/* 	printf("\n\n"); */
-	/* } */
-
-	char* pointer = src;
-	size_t regex_idx = 0;
-	str_t res;
-	bool in_comment = false;
-	// While there is remaining string
-	while (*pointer != 0)
+// exact powers of ten for the fast float path
+static const double lsn_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/**
+ * Converts the digits of a float token. With at most 15 significant
+ * digits both the mantissa and the power of ten are exact doubles, so a
+ * single division rounds correctly; longer literals go through strtod.
+ */
+static float lsn_lex_float(const char* data, size_t len, size_t dot)
+{
+	if (len - 1 <= 15)
 	{
-		regex_idx = 0;
-		// find the first matching string
-		while (regex_idx < LSN_TKN_EOF)
-		{
-			res = rgx_match(pointer, regex[regex_idx]);
-			if (res.len != 0)
-				break;
-			regex_idx++;
-		}
-		lsn_token_t token;
-		token.tag = regex_idx;
-		switch (token.tag) {
-		case LSN_TKN_String:
+		uint64_t mantissa = 0;
+		for (size_t i = 0; i < len; i++)
+			if (i != dot)
+				mantissa = mantissa * 10 + (uint64_t)(data[i] - '0');
+		return (float)((double)mantissa / lsn_pow10[len - dot - 1]);
+	}
+	char local[64];
+	char* buff = len < sizeof(local) ? local : (char*)malloc(len + 1);
+	memcpy(buff, data, len);
+	buff[len] = 0;
+	float res = (float)strtod(buff, NULL);
+	if (buff != local)
+		free(buff);
+	return res;
+}
+
+bool lsn_lex_string_ok(const str_t* str)
+{
+	for (size_t i = 0; i < str->len; i++)
+		if (!LSN_IS(str->data[i], LSN_CH_String))
+			return false;
+	return true;
+}
+
+bool lsn_lex_tag_ok(const str_t* name)
+{
+	for (size_t i = 0; i < name->len; i++)
+		if (!LSN_IS(name->data[i], LSN_CH_Tag))
+			return false;
+	return name->len > 0;
+}
+
+void lsn_lex_init(lsn_lexer_t* lex, char* src, size_t len)
+{
+	lex->src = src;
+	lex->len = len;
+	lex->pos = 0;
+}
+
+lsn_token_tag_t lsn_lex_next(lsn_lexer_t* lex, lsn_token_t* tkn)
+{
+	char* src = lex->src;
+	size_t len = lex->len;
+	size_t pos = lex->pos;
+
+	// whitespace and comments
+	while (pos < len)
+	{
+		if (LSN_IS(src[pos], LSN_CH_Space))
+			pos++;
+		else if (src[pos] == '(' && pos + 1 < len && src[pos + 1] == '*')
 		{
-			str_t strval = { .data = res.data + 1, .len = res.len - 2 };
-			token.value.string = strval;
-			break;
+			// the search starts at the star, so (*) is a whole comment
+			const char* it = src + pos + 1;
+			const char* end = src + len;
+			while ((it = memchr(it, '*', (size_t)(end - it))) && it + 1 < end && it[1] != ')')
+				it++;
+			// an unterminated comment runs until the end
+			pos = it && it + 1 < end ? (size_t)(it - src) + 2 : len;
 		}
-		case LSN_TKN_Float:
-			token.value.lsn_float = str_to_float(&res);
-			break;
-		case LSN_TKN_Integer:
-			token.value.integer = str_to_int(&res);
+		else
 			break;
-		case LSN_TKN_Tag:
+	}
+	lex->pos = pos;
+	if (pos == len)
+	{
+		tkn->tag = LSN_TKN_EOF;
+		return tkn->tag;
+	}
+
+	char c = src[pos];
+	tkn->tag = LSN_TKN_Error;
+	if (c == '(')
+	{
+		tkn->tag = LSN_TKN_LParen;
+		pos++;
+	}
+	else if (c == ')')
+	{
+		tkn->tag = LSN_TKN_RParen;
+		pos++;
+	}
+	else if (c == '\'')
+	{
+		size_t begin = ++pos;
+		while (pos < len && LSN_IS(src[pos], LSN_CH_String))
+			pos++;
+		if (pos == len || src[pos] != '\'')
+			return tkn->tag;
+		tkn->tag = LSN_TKN_String;
+		tkn->value.string = (str_t) { .data = src + begin, .len = pos - begin };
+		pos++;
+	}
+	else if (c == ':')
+	{
+		size_t begin = ++pos;
+		while (pos < len && LSN_IS(src[pos], LSN_CH_Tag))
+			pos++;
+		if (pos == begin)
+			return tkn->tag;
+		tkn->tag = LSN_TKN_Tag;
+		tkn->value.tag = (str_t) { .data = src + begin, .len = pos - begin };
+	}
+	else if (LSN_IS(c, LSN_CH_Digit) || (c == '-' && pos + 1 < len && LSN_IS(src[pos + 1], LSN_CH_Digit)))
+	{
+		bool negative = c == '-';
+		pos += negative;
+		size_t begin = pos;
+		uint32_t integer = 0;
+		while (pos < len && LSN_IS(src[pos], LSN_CH_Digit))
+			integer = integer * 10 + (uint32_t)(src[pos++] - '0');
+		if (pos + 1 < len && src[pos] == '.' && LSN_IS(src[pos + 1], LSN_CH_Digit))
 		{
-			str_t tokval = { .data = res.data + 1, .len = res.len - 1 };
-			token.value.tag = tokval;
-			break;
+			size_t dot = pos - begin;
+			pos++;
+			while (pos < len && LSN_IS(src[pos], LSN_CH_Digit))
+				pos++;
+			tkn->tag = LSN_TKN_Float;
+			tkn->value.lsn_float = lsn_lex_float(src + begin, pos - begin, dot);
+			if (negative)
+				tkn->value.lsn_float = -tkn->value.lsn_float;
 		}
-		case LSN_TKN_CommStart:
-			in_comment = true;
-			break;
-		case LSN_TKN_CommEnd:
-			in_comment = false;
-			break;
-		default:
-			break;
-		}
-		// Comment handling
-		if (in_comment)
+		else
 		{
-			pointer = pointer + 1;
-			continue;
+			tkn->tag = LSN_TKN_Integer;
+			tkn->value.integer = (int)(negative ? 0u - integer : integer);
 		}
+	}
+	else
+		LOG("[LSN TOKEN] Unrecognisible token at %zu\n", pos);
 
-		// Unrecognisible Token Handling
-		if (token.tag == LSN_TKN_EOF)
-		{
-			LOG("[LSN TOKEN] Unrecognisible token, rem: %s\n", res.data);
-			break;
-		}
+	if (tkn->tag != LSN_TKN_Error)
+		lex->pos = pos;
+	return tkn->tag;
+}
 
-		// Adding the new token to the stream
-		if (!(token.tag == LSN_TKN_Whitespace
-			  || token.tag == LSN_TKN_CommEnd
-			  || token.tag == LSN_TKN_CommStart))
+bool lsn_tokenize_n(char* src, size_t len, lsn_token_stream_t* stream)
+{
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, len);
+	lsn_token_t token;
+	lsn_token_tag_t tag;
+	while ((tag = lsn_lex_next(&lex, &token)) != LSN_TKN_EOF)
+	{
+		if (tag == LSN_TKN_Error)
+			return false;
+		lsn_ts_append(stream, token);
+	}
+	return true;
+}
+
+bool lsn_tokenize_structural(char* src, size_t len, const lsn_structural_t* index, lsn_token_stream_t* stream)
+{
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, len);
+	lsn_ts_reserve(stream, stream->len + index->len);
+	lsn_token_t token;
+	for (size_t i = 0; i < index->len; i++)
+	{
+		size_t next = i + 1 < index->len ? index->offsets[i + 1] : len;
+		lex.pos = index->offsets[i];
+		// a run like 1-2 or 1:a holds several tokens; anything else up to
+		// the next offset is whitespace or a comment
+		do
+		{
+			if (lsn_lex_next(&lex, &token) == LSN_TKN_Error)
+				return false;
 			lsn_ts_append(stream, token);
+		} while (lex.pos < next && !LSN_IS(src[lex.pos], LSN_CH_Space) && src[lex.pos] != '(');
+	}
+	return true;
+}
+
+bool lsn_tokenize(char* src, lsn_token_stream_t* stream)
+{
+	return lsn_tokenize_n(src, strlen(src), stream);
+}
 
-		// Updating them pointer and continue
-		pointer = pointer + res.len;
+// how the parser builds the tree
+typedef struct _lsn_p_ctx_t
+{
+	lsn_arena_t* arena;
+	size_t max_depth;
+	bool borrow; // strings and tags are slices of the source
+	lsn_symtab_t* symbols; // tags are interned into it
+	bool index; // long lists get their lookup index right away
+	bool pack; // lists of one kind of number become packed arrays
+} lsn_p_ctx_t;
+
+static lison_t* lsn_p_atom(const lsn_p_ctx_t* ctx, const lsn_token_t* tkn)
+{
+	lsn_arena_t* arena = ctx->arena;
+	switch (tkn->tag)
+	{
+	case LSN_TKN_String:
+		LOG("[LSN PARSER] Object found string\n");
+		if (ctx->borrow)
+			return lsn_ar_string_ref(arena, LSN_String, &tkn->value.string);
+		return lsn_ar_string_str(arena, &tkn->value.string);
+	case LSN_TKN_Integer:
+		LOG("[LSN PARSER] Object found integer\n");
+		return lsn_ar_integer(arena, tkn->value.integer);
+	case LSN_TKN_Float:
+		LOG("[LSN PARSER] Object found float\n");
+		return lsn_ar_float(arena, tkn->value.lsn_float);
+	case LSN_TKN_Tag:
+		LOG("[LSN PARSER] Object found tag\n");
+		if (ctx->symbols)
+			return lsn_ar_tag_sym(arena, ctx->symbols, &tkn->value.tag);
+		if (ctx->borrow)
+			return lsn_ar_string_ref(arena, LSN_Tag, &tkn->value.tag);
+		return lsn_ar_tag_str(arena, &tkn->value.tag);
+	default:
+		return NULL;
 	}
+}
 
+/**
+ * The list opened at tkn as a packed array if it holds only integers or
+ * only floats, NULL otherwise. The tokens are looked at ahead, so no
+ * nodes are built for the values.
+ */
+static lison_t* lsn_p_packed(const lsn_p_ctx_t* ctx, const lsn_token_t* tkn)
+{
+	lsn_token_tag_t kind = tkn[1].tag;
+	if (kind != LSN_TKN_Integer && kind != LSN_TKN_Float)
+		return NULL;
+	// streams end with EOF or with the paren closing the value, either stops this
+	size_t len = 1;
+	while (tkn[len + 1].tag == kind)
+		len++;
+	if (tkn[len + 1].tag != LSN_TKN_RParen)
+		return NULL;
 
-	// Clearing the regex map
-	for (size_t i=0;i<LSN_TKN_EOF;i++)
+	if (kind == LSN_TKN_Integer)
 	{
-		rgx_delete(&regex[i]);
+		lison_t* res = lsn_ar_int_array(ctx->arena, NULL, len);
+		for (size_t i = 0; i < len; i++)
+			res->value.array.ints[i] = tkn[i + 1].value.integer;
+		return res;
 	}
+	lison_t* res = lsn_ar_float_array(ctx->arena, NULL, len);
+	for (size_t i = 0; i < len; i++)
+		res->value.array.floats[i] = tkn[i + 1].value.lsn_float;
+	return res;
 }
 
-lsn_parse_res_t lsn_p_object(lsn_token_node_t* lkd)
+/**
+ * Explicit stack parser: every open paren pushes a list, every close
+ * paren pops one and appends it to the enclosing list. With as_list the
+ * bottom list is implicit and ends at the first token that cannot start
+ * an object, otherwise the result is a single object.
+ */
+static lsn_parse_res_t lsn_p_run(const lsn_p_ctx_t* ctx, lsn_token_t* tkn, bool as_list)
 {
-	LOG("[LSN PARSER] Object\n");
-	lsn_token_node_t* lparen = lsn_p_expect(lkd, LSN_TKN_LParen);
-	if (lparen)
+	lsn_arena_t* arena = ctx->arena;
+	lison_list_t local[LSN_LOCAL_DEPTH];
+	lison_list_t* stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	lsn_parse_res_t res = { .stream = NULL, .lison = NULL };
+
+	if (as_list)
+		lsn_lst_init(&stack[top++]);
+	else if (tkn->tag != LSN_TKN_LParen)
+	{
+		lison_t* atom = lsn_p_atom(ctx, tkn);
+		if (atom)
+			return (lsn_parse_res_t) { .lison = atom, .stream = tkn + 1 };
+		LOG("[LSN PARSER] Object Assumes empty\n");
+		return res;
+	}
+
+	while (true)
 	{
-		LOG("[LSN PARSER] Object Found Left Paren\n");
-		lsn_parse_res_t list = lsn_p_list(lparen);
-		if (list.stream)
+		if (tkn->tag == LSN_TKN_LParen)
 		{
-			lsn_token_node_t* rparen =
-				lsn_p_expect(list.stream, LSN_TKN_RParen);
-			if (rparen)
+			// the implicit bottom list is not a level
+			if (top - as_list >= ctx->max_depth)
 			{
-				LOG("[LSN PARSER] Object Found Right Paren\n");
-				return (lsn_parse_res_t) { .lison = list.lison, .stream = rparen };
+				LOG("[LSN PARSER] Object Compile Error, nesting deeper than %zu\n", ctx->max_depth);
+				break;
 			}
-			else
+			lison_t* packed = ctx->pack ? lsn_p_packed(ctx, tkn) : NULL;
+			if (packed)
 			{
-				LOG("[LSN PARSER] Object Compile Error, expected Right Paren\n");
-				lsn_delete(&list.lison);
+				LOG("[LSN PARSER] Object Found Packed Array\n");
+				tkn += packed->value.array.len + 2;
+				if (top == 0)
+				{
+					res = (lsn_parse_res_t) { .lison = packed, .stream = tkn };
+					break;
+				}
+				lsn_ar_lst_append(arena, &stack[top - 1], packed);
+				continue;
 			}
+			if (top == cap)
+			{
+				lison_list_t* grown = (lison_list_t*)malloc(2 * cap * sizeof(lison_list_t));
+				memcpy(grown, stack, top * sizeof(lison_list_t));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+			LOG("[LSN PARSER] Object Found Left Paren\n");
+			lsn_lst_init(&stack[top++]);
+			tkn++;
 		}
-		else
-		{
-			LOG("[LSN PARSER] Object Compile error, wrong list (unreachable)\n");
-		}
-	}
-	else
-	{
-		lsn_token_node_t* string = lsn_p_expect(lkd, LSN_TKN_String);
-		if (string)
+		else if (tkn->tag == LSN_TKN_RParen && top > (size_t)as_list)
 		{
-			LOG("[LSN PARSER] Object found string\n");
-			return (lsn_parse_res_t) { .lison = lsn_string_str(&lkd->value.value.string), .stream =  string };
+			LOG("[LSN PARSER] Object Found Right Paren\n");
+			if (ctx->index)
+				lsn_index_attach(arena, &stack[top - 1]);
+			lison_t* object = lsn_ar_object(arena, stack[--top]);
+			tkn++;
+			if (top == 0)
+			{
+				res = (lsn_parse_res_t) { .lison = object, .stream = tkn };
+				break;
+			}
+			lsn_ar_lst_append(arena, &stack[top - 1], object);
 		}
 		else
 		{
-			lsn_token_node_t* integer = lsn_p_expect(lkd, LSN_TKN_Integer);
-			if (integer)
+			lison_t* atom = lsn_p_atom(ctx, tkn);
+			if (atom)
+			{
+				lsn_ar_lst_append(arena, &stack[top - 1], atom);
+				tkn++;
+			}
+			else if (as_list && top == 1)
 			{
-				LOG("[LSN PARSER] Object found integer\n");
-				return (lsn_parse_res_t) { .lison = lsn_integer(lkd->value.value.integer), .stream = integer };
+				res = (lsn_parse_res_t) { .lison = lsn_ar_object(arena, stack[--top]), .stream = tkn };
+				break;
 			}
 			else
 			{
-				lsn_token_node_t* floating = lsn_p_expect(lkd, LSN_TKN_Float);
-				if (floating)
-				{
-					LOG("[LSN PARSER] Object found float\n");
-					return (lsn_parse_res_t) { .lison = lsn_float(lkd->value.value.lsn_float), .stream = floating };
-				}
-				else
-				{
-					lsn_token_node_t* tag = lsn_p_expect(lkd, LSN_TKN_Tag);
-					if (tag)
-					{
-						LOG("[LSN PARSER] Object found tag\n");
-						return (lsn_parse_res_t) { .lison = lsn_tag_str(&lkd->value.value.tag), .stream = tag};
-					}
-				}
+				LOG("[LSN PARSER] Object Compile Error, expected Right Paren\n");
+				break;
 			}
 		}
-		LOG("[LSN PARSER] Object Assumes empty\n");
 	}
-	return (lsn_parse_res_t) { .lison = NULL, .stream = NULL };
+
+	// on error the unfinished lists are dropped, arena ones with the arena
+	while (top > 0 && !arena)
+		lsn_lst_delete(&stack[--top]);
+	if (stack != local)
+		free(stack);
+	return res;
 }
 
-lsn_parse_res_t lsn_p_list(lsn_token_node_t* lkd)
+lsn_parse_res_t lsn_p_object(lsn_token_t* tkn)
 {
-	LOG("[LSN PARSER] List\n");
-	lison_list_t list = {NULL, NULL};
-	lsn_lst_init(&list);
-
-	lsn_parse_res_t obj1 = lsn_p_object(lkd);
-	lsn_parse_res_t obj2 = {NULL, NULL};
+	LOG("[LSN PARSER] Object\n");
+	if (!tkn)
+		return (lsn_parse_res_t) { .lison = NULL, .stream = NULL };
+	lsn_p_ctx_t ctx = { .arena = NULL, .max_depth = LSN_MAX_DEPTH, .borrow = false, .symbols = NULL, .index = false, .pack = false };
+	return lsn_p_run(&ctx, tkn, false);
+}
 
-	while (obj1.stream)
-	{
-		if (obj1.stream)
-		{
-			lsn_lst_append(&list, obj1.lison);
-			obj2 = obj1;
-			obj1 = lsn_p_object(obj2.stream);
-		}
-	}
-	if (obj2.stream)
-	{
-		return (lsn_parse_res_t) {.stream = obj2.stream, .lison = lsn_object(list)};
-	}
-	
-	LOG("[LSN PARSER] List Assumes Empty\n");
-	return (lsn_parse_res_t) { .stream = lkd, .lison = lsn_object(list)};
+lsn_parse_res_t lsn_p_list(lsn_token_t* tkn)
+{
+	LOG("[LSN PARSER] List\n");
+	if (!tkn)
+		return (lsn_parse_res_t) { .lison = NULL, .stream = NULL };
+	lsn_p_ctx_t ctx = { .arena = NULL, .max_depth = LSN_MAX_DEPTH, .borrow = false, .symbols = NULL, .index = false, .pack = false };
+	return lsn_p_run(&ctx, tkn, true);
 }
 
-lsn_token_node_t* lsn_p_expect(lsn_token_node_t* lkd, lsn_token_tag_t tkn)
+lsn_token_t* lsn_p_expect(lsn_token_t* tkn, lsn_token_tag_t tag)
 {
-	if (lkd == NULL)
+	if (tkn == NULL)
 		return NULL;
-	if (lkd->value.tag == tkn) 
+	if (tkn->tag == tag)
 	{
-		LOG("[LSN PARSER] Expectation passed %d\n", tkn);
-		return lkd->next;
+		LOG("[LSN PARSER] Expectation passed %d\n", tag);
+		return tkn + 1;
 	}
-	else 						
+	else
 	{
-		LOG("[LSN PARSER] Expectation failed %d\n", tkn);
+		LOG("[LSN PARSER] Expectation failed %d\n", tag);
 		return NULL;
 	}
 }
@@ -330,25 +535,160 @@ lsn_token_node_t* lsn_p_expect(lsn_token_node_t* lkd, lsn_token_tag_t tkn)
 // API
 lison_t* lsn_compile(char* src)
 {
-	lsn_token_stream_t stream = { .head = NULL, .tail = NULL };
+	return lsn_compile_opt(src, NULL);
+}
+
+static lison_t* lsn_compile_into(lsn_arena_t* arena, lsn_symtab_t* symbols, char* src, size_t len, const lsn_options_t* opt)
+{
+	lsn_p_ctx_t ctx = {
+		.arena = arena,
+		.max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH,
+		.borrow = opt && (opt->flags & LSN_OPT_ZeroCopy),
+		.symbols = symbols,
+		.index = opt && (opt->flags & LSN_OPT_Index),
+		.pack = opt && (opt->flags & LSN_OPT_Pack),
+	};
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
 	lsn_ts_init(&stream);
-	lsn_tokenize(src, &stream);
-	lsn_parse_res_t res = lsn_p_object(stream.head);
-	if (res.stream == NULL)
+	if (!lsn_tokenize_n(src, len, &stream))
 	{
-		lsn_delete(&res.lison);
 		lsn_ts_delete(&stream);
 		return NULL;
 	}
-	else if (res.stream->value.tag == LSN_TKN_EOF)
+	lsn_parse_res_t res = lsn_p_run(&ctx, stream.tokens, false);
+	if (res.stream == NULL || res.stream->tag != LSN_TKN_EOF)
 	{
+		lsn_delete(&res.lison);
 		lsn_ts_delete(&stream);
-		return res.lison;
+		return NULL;
 	}
-	else
+	lsn_ts_delete(&stream);
+	return res.lison;
+}
+
+lison_t* lsn_compile_opt(char* src, const lsn_options_t* opt)
+{
+	return lsn_compile_into(NULL, opt ? opt->symbols : NULL, src, strlen(src), opt);
+}
+
+lison_t* lsn_compile_n(char* src, size_t len, const lsn_options_t* opt)
+{
+	return lsn_compile_into(NULL, opt ? opt->symbols : NULL, src, len, opt);
+}
+
+lison_t* lsn_compile_in(lsn_arena_t* arena, char* src, size_t len, const lsn_options_t* opt)
+{
+	return lsn_compile_into(arena, opt ? opt->symbols : NULL, src, len, opt);
+}
+
+bool lsn_compile_items(lsn_arena_t* arena, char* src, size_t len, const lsn_options_t* opt, size_t depth, lison_list_t* items)
+{
+	size_t max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	lsn_p_ctx_t ctx = {
+		.arena = arena,
+		// the enclosing lists count towards the limit
+		.max_depth = max_depth > depth ? max_depth - depth : 0,
+		.borrow = opt && (opt->flags & LSN_OPT_ZeroCopy),
+		.symbols = opt ? opt->symbols : NULL,
+		.index = opt && (opt->flags & LSN_OPT_Index),
+		.pack = opt && (opt->flags & LSN_OPT_Pack),
+	};
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
+	lsn_ts_init(&stream);
+	bool res = lsn_tokenize_n(src, len, &stream);
+	lsn_parse_res_t parsed = { .stream = NULL, .lison = NULL };
+	if (res)
+		parsed = lsn_p_run(&ctx, stream.tokens, true);
+	res = res && parsed.stream && parsed.stream->tag == LSN_TKN_EOF;
+	lsn_ts_delete(&stream);
+	if (!res)
 	{
-		lsn_ts_delete(&stream);
-		lsn_delete(&res.lison);
-		return NULL;
+		lsn_delete(&parsed.lison);
+		return false;
 	}
+	*items = parsed.lison->value.object;
+	// the list is taken over, only the object around it goes
+	if (!arena)
+		free(parsed.lison);
+	return true;
+}
+
+lison_t* lsn_compile_next(lsn_token_stream_t* stream, char* src, size_t len, size_t* pos, const lsn_options_t* opt)
+{
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, len);
+	lex.pos = *pos;
+	stream->len = 0;
+	// the tokens of exactly one value
+	size_t depth = 0;
+	lsn_token_t tkn;
+	do
+	{
+		lsn_token_tag_t tag = lsn_lex_next(&lex, &tkn);
+		if (tag == LSN_TKN_EOF && stream->len == 0)
+			*pos = len;
+		if (tag == LSN_TKN_EOF || tag == LSN_TKN_Error || (tag == LSN_TKN_RParen && depth == 0))
+			return NULL;
+		lsn_ts_append(stream, tkn);
+		if (tag == LSN_TKN_LParen)
+			depth++;
+		else if (tag == LSN_TKN_RParen)
+			depth--;
+	} while (depth > 0);
+
+	lsn_p_ctx_t ctx = {
+		.arena = NULL,
+		.max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH,
+		.borrow = opt && (opt->flags & LSN_OPT_ZeroCopy),
+		.symbols = opt ? opt->symbols : NULL,
+		.index = opt && (opt->flags & LSN_OPT_Index),
+		.pack = opt && (opt->flags & LSN_OPT_Pack),
+	};
+	lison_t* res = lsn_p_run(&ctx, stream->tokens, false).lison;
+	if (res)
+		*pos = lex.pos;
+	return res;
+}
+
+lsn_doc_t* lsn_doc_new(size_t hint, const lsn_options_t* opt)
+{
+	lsn_arena_t arena;
+	uint8_t flags = opt && (opt->flags & LSN_OPT_HugePages) ? LSN_AR_HugePages : 0;
+	lsn_ar_init(&arena, hint, flags);
+	// the document lives in its own arena
+	lsn_doc_t* doc = (lsn_doc_t*)lsn_ar_alloc(&arena, sizeof(lsn_doc_t));
+	doc->arena = arena;
+	doc->root = NULL;
+	doc->symbols = opt ? opt->symbols : NULL;
+	doc->owns_symbols = false;
+	if (!doc->symbols && opt && (opt->flags & LSN_OPT_Intern))
+	{
+		doc->symbols = (lsn_symtab_t*)lsn_ar_alloc(&doc->arena, sizeof(lsn_symtab_t));
+		lsn_sym_init(doc->symbols, false);
+		doc->owns_symbols = true;
+	}
+	return doc;
+}
+
+lsn_doc_t* lsn_compile_doc(char* src, const lsn_options_t* opt)
+{
+	size_t len = strlen(src);
+	// the tree takes about twice the source
+	lsn_doc_t* doc = lsn_doc_new(2 * len, opt);
+	doc->root = lsn_compile_into(&doc->arena, doc->symbols, src, len, opt);
+	if (!doc->root)
+		lsn_doc_delete(&doc);
+	return doc;
+}
+
+void lsn_doc_delete(lsn_doc_t** doc)
+{
+	if (!doc || !*doc)
+		return;
+	if ((*doc)->owns_symbols)
+		lsn_sym_delete((*doc)->symbols);
+	// the document is inside its own arena
+	lsn_arena_t arena = (*doc)->arena;
+	lsn_ar_delete(&arena);
+	*doc = NULL;
 }
@@ -0,0 +1,324 @@
+#include "lsn.h"
+
+/**
+ * Push parser for input that arrives in chunks.
+ * Chunks are lexed in place. A token that may go on in the next chunk (a
+ * string without its closing quote, an unfinished comment, a run of tag
+ * or number bytes up to the end, or a lone '(' that may open a comment)
+ * is kept in a carry buffer. The next chunk is appended to it only up to
+ * where that token ends, and the rest of the chunk is lexed in place
+ * again. Chunks that do not end the token are appended whole, without
+ * lexing the carry again, so only new bytes are searched. Tokens go to
+ * the callback as events, or into a stack of open lists that builds the
+ * tree.
+ */
+
+#define LSN_PUSH_INIT_CARRY 64
+
+#define LSN_PUSH_DELIM(c) ((c) == ' ' || (c) == '\t' || (c) == '\n' || (c) == '\r' || (c) == '(' || (c) == ')' || (c) == '\'')
+
+static void lsn_push_fail(lsn_push_t* push, const char* what)
+{
+	// only used by debug builds
+	(void)what;
+	LOG("[LSN PUSH] %s\n", what);
+	push->failed = true;
+}
+
+// the value goes into the innermost open list, or becomes the root
+static void lsn_push_value(lsn_push_t* push, lison_t* value)
+{
+	if (push->depth)
+		lsn_lst_append(&push->stack[push->depth - 1], value);
+	else
+		push->root = value;
+}
+
+static void lsn_push_token(lsn_push_t* push, const lsn_token_t* tkn)
+{
+	if (push->done)
+	{
+		lsn_push_fail(push, "Value after the root");
+		return;
+	}
+	lsn_event_t ev = { .tag = LSN_EV_Error, .depth = push->depth };
+	lison_t* atom = NULL;
+	switch (tkn->tag)
+	{
+	case LSN_TKN_LParen:
+		if (push->depth >= push->max_depth)
+		{
+			lsn_push_fail(push, "Nesting too deep");
+			return;
+		}
+		if (!push->on_event)
+		{
+			if (push->depth == push->stack_cap)
+			{
+				push->stack_cap = push->stack_cap ? 2 * push->stack_cap : LSN_LOCAL_DEPTH;
+				push->stack = (lison_list_t*)realloc(push->stack, push->stack_cap * sizeof(lison_list_t));
+			}
+			lsn_lst_init(&push->stack[push->depth]);
+		}
+		push->depth++;
+		ev.tag = LSN_EV_ObjectStart;
+		break;
+	case LSN_TKN_RParen:
+		if (push->depth == 0)
+		{
+			lsn_push_fail(push, "Unexpected right paren");
+			return;
+		}
+		ev.depth = --push->depth;
+		ev.tag = LSN_EV_ObjectEnd;
+		push->done = push->depth == 0;
+		if (!push->on_event)
+		{
+			lison_list_t* list = &push->stack[push->depth];
+			lison_t* packed = push->pack ? lsn_ar_pack(NULL, list) : NULL;
+			if (packed)
+				lsn_lst_delete(list);
+			else if (push->index)
+				lsn_index_attach(NULL, list);
+			lsn_push_value(push, packed ? packed : lsn_ar_object(NULL, *list));
+		}
+		break;
+	case LSN_TKN_String:
+		ev.tag = LSN_EV_String;
+		ev.value.string = tkn->value.string;
+		if (!push->on_event)
+			atom = lsn_ar_string_str(NULL, &tkn->value.string);
+		break;
+	case LSN_TKN_Tag:
+		ev.tag = LSN_EV_Tag;
+		ev.value.tag = tkn->value.tag;
+		if (!push->on_event)
+			atom = push->symbols
+				? lsn_ar_tag_sym(NULL, push->symbols, &tkn->value.tag)
+				: lsn_ar_tag_str(NULL, &tkn->value.tag);
+		break;
+	case LSN_TKN_Integer:
+		ev.tag = LSN_EV_Integer;
+		ev.value.integer = tkn->value.integer;
+		if (!push->on_event)
+			atom = lsn_ar_integer(NULL, tkn->value.integer);
+		break;
+	case LSN_TKN_Float:
+		ev.tag = LSN_EV_Float;
+		ev.value.lsn_float = tkn->value.lsn_float;
+		if (!push->on_event)
+			atom = lsn_ar_float(NULL, tkn->value.lsn_float);
+		break;
+	default:
+		lsn_push_fail(push, "Invalid token");
+		return;
+	}
+	// an atom can be the whole document
+	if (ev.tag != LSN_EV_ObjectStart && ev.tag != LSN_EV_ObjectEnd)
+		push->done = push->depth == 0;
+	if (atom)
+		lsn_push_value(push, atom);
+	if (push->on_event)
+		push->on_event(&ev, push->user);
+}
+
+/**
+ * Lexes buf up to the first token that may go on after it (unless final).
+ * Returns the number of bytes consumed.
+ */
+static size_t lsn_push_scan(lsn_push_t* push, char* buf, size_t len, bool final)
+{
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, buf, len);
+	size_t pos = 0;
+	while (!push->failed)
+	{
+		while (pos < len && (buf[pos] == ' ' || buf[pos] == '\t' || buf[pos] == '\n' || buf[pos] == '\r'))
+			pos++;
+		if (pos == len)
+			return len;
+		char c = buf[pos];
+		size_t end = pos + 1;
+		if (c == '(')
+		{
+			if (pos + 1 == len)
+			{
+				if (!final)
+					return pos;
+			}
+			else if (buf[pos + 1] == '*')
+			{
+				// the search starts at the star, so (*) is a whole comment
+				const char* it = buf + pos + 1;
+				const char* stop = buf + len;
+				while ((it = memchr(it, '*', (size_t)(stop - it))) && it + 1 < stop && it[1] != ')')
+					it++;
+				if (!it || it + 1 == stop)
+				{
+					if (!final)
+						return pos;
+					// an unterminated comment runs until the end
+					return len;
+				}
+				pos = (size_t)(it - buf) + 2;
+				continue;
+			}
+		}
+		else if (c == '\'')
+		{
+			const char* quote = memchr(buf + pos + 1, '\'', len - pos - 1);
+			if (!quote && !final)
+				return pos;
+			end = quote ? (size_t)(quote - buf) + 1 : len;
+		}
+		else if (c != ')')
+		{
+			// a run of tag and number bytes, which may hold several tokens
+			while (end < len && !LSN_PUSH_DELIM(buf[end]))
+				end++;
+			if (end == len && !final)
+				return pos;
+		}
+
+		lex.pos = pos;
+		while (lex.pos < end && !push->failed)
+		{
+			lsn_token_t tkn;
+			if (lsn_lex_next(&lex, &tkn) == LSN_TKN_Error)
+				lsn_push_fail(push, "Invalid token");
+			else
+				lsn_push_token(push, &tkn);
+		}
+		pos = lex.pos;
+	}
+	return len;
+}
+
+/**
+ * Bytes of the chunk that finish the token in the carry buffer, or 0 if
+ * it goes on past the chunk.
+ */
+static size_t lsn_push_need(const lsn_push_t* push, const char* chunk, size_t len)
+{
+	const char* carry = push->carry;
+	// a comment or a paren, either way one more byte tells
+	if (carry[0] == '(' && push->carry_len == 1)
+		return 1;
+	if (carry[0] == '(')
+	{
+		// a comment, its star may be the last byte of the carry
+		if (carry[push->carry_len - 1] == '*' && chunk[0] == ')')
+			return 1;
+		for (size_t i = 0; i + 1 < len; i++)
+			if (chunk[i] == '*' && chunk[i + 1] == ')')
+				return i + 2;
+		return 0;
+	}
+	if (carry[0] == '\'')
+	{
+		const char* quote = memchr(chunk, '\'', len);
+		return quote ? (size_t)(quote - chunk) + 1 : 0;
+	}
+	// the run and the byte that ends it
+	size_t i = 0;
+	while (i < len && !LSN_PUSH_DELIM(chunk[i]))
+		i++;
+	return i < len ? i + 1 : 0;
+}
+
+static void lsn_push_carry(lsn_push_t* push, const char* data, size_t len)
+{
+	// the carry is still NULL before the first token is kept
+	if (len == 0)
+		return;
+	if (push->carry_len + len > push->carry_cap)
+	{
+		size_t cap = push->carry_cap ? push->carry_cap : LSN_PUSH_INIT_CARRY;
+		while (cap < push->carry_len + len)
+			cap *= 2;
+		push->carry = (char*)realloc(push->carry, cap);
+		push->carry_cap = cap;
+	}
+	memcpy(push->carry + push->carry_len, data, len);
+	push->carry_len += len;
+}
+
+// lexes the carry buffer, keeping what is left of it
+static void lsn_push_drain(lsn_push_t* push, bool final)
+{
+	if (push->carry_len == 0)
+		return;
+	size_t used = lsn_push_scan(push, push->carry, push->carry_len, final);
+	if (used == 0)
+		return;
+	memmove(push->carry, push->carry + used, push->carry_len - used);
+	push->carry_len -= used;
+}
+
+// API --------------------------------------------------
+
+void lsn_push_init(lsn_push_t* push, const lsn_options_t* opt, lsn_push_cb on_event, void* user)
+{
+	push->carry = NULL;
+	push->carry_len = 0;
+	push->carry_cap = 0;
+	push->depth = 0;
+	push->max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	push->symbols = opt ? opt->symbols : NULL;
+	push->index = opt && (opt->flags & LSN_OPT_Index);
+	push->pack = opt && (opt->flags & LSN_OPT_Pack);
+	push->failed = false;
+	push->done = false;
+	push->on_event = on_event;
+	push->user = user;
+	push->stack = NULL;
+	push->stack_cap = 0;
+	push->root = NULL;
+}
+
+bool lsn_push_feed(lsn_push_t* push, const char* chunk, size_t len)
+{
+	// the lexer takes no const source, but never writes to it
+	char* src = (char*)chunk;
+	while (len > 0 && push->carry_len > 0 && !push->failed)
+	{
+		size_t need = lsn_push_need(push, src, len);
+		if (need == 0)
+		{
+			// still open, only the new bytes were searched
+			lsn_push_carry(push, src, len);
+			return true;
+		}
+		lsn_push_carry(push, src, need);
+		src += need;
+		len -= need;
+		lsn_push_drain(push, false);
+	}
+	if (len > 0 && !push->failed)
+	{
+		size_t used = lsn_push_scan(push, src, len, false);
+		lsn_push_carry(push, src + used, len - used);
+	}
+	return !push->failed;
+}
+
+bool lsn_push_finish(lsn_push_t* push, lison_t** root)
+{
+	if (!push->failed)
+		lsn_push_drain(push, true);
+	bool res = !push->failed && push->done;
+	if (!res)
+		LOG("[LSN PUSH] Incomplete document\n");
+
+	// the open lists of an unfinished document
+	while (push->depth > 0 && !push->on_event)
+		lsn_lst_delete(&push->stack[--push->depth]);
+	if (root && res)
+		*root = push->root;
+	else
+		lsn_delete(&push->root);
+	free(push->stack);
+	free(push->carry);
+	lsn_push_init(push, NULL, NULL, NULL);
+	return res;
+}
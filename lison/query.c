@@ -0,0 +1,450 @@
+#include "lsn.h"
+
+/**
+ * Path queries.
+ * A query is a list of steps separated by '/': ':tag' takes the value
+ * after the tag (like lsn_get), '*' every item and a number the item at
+ * that index. A step may have one predicate in brackets on the value it
+ * takes, [:tag] (the tag has a value) or [:tag op literal] with one of
+ * = != < <= > >= and a number, 'string' or :tag literal.
+ * Queries run over a tree, or over the events of the pull reader with a
+ * frame per open object that holds the step it is matched against. Items
+ * that cannot match are skipped without building anything, and once a
+ * tag or index step has taken its item, the rest of the object is skipped
+ * as well. Matches, and values that a predicate has to look into, are
+ * built from the events and freed after the callback.
+ * Over a tree, the tags of the steps are looked up as keys (see
+ * lsn_key_get), so trees with interned tags are matched by id.
+ */
+
+#define LSN_Q_INIT_STEPS 4
+
+typedef struct _lsn_q_frame_t
+{
+	size_t step;
+	size_t item;
+	bool take_next; // the tag of a tag step was the last item
+	bool finished; // the step has taken its item
+} lsn_q_frame_t;
+
+static bool lsn_q_is_name(char c)
+{
+	return c && !strchr("/[]=!<>()' \t\n\r", c);
+}
+
+static size_t lsn_q_name(const char* it)
+{
+	size_t len = 0;
+	while (lsn_q_is_name(it[len]))
+		len++;
+	return len;
+}
+
+static bool lsn_q_literal(const char** it, lison_t** value)
+{
+	const char* start = *it;
+	size_t len = 0;
+	if (*start == '\'')
+	{
+		const char* quote = strchr(start + 1, '\'');
+		if (!quote)
+			return false;
+		len = (size_t)(quote - start) + 1;
+	}
+	else
+		len = lsn_q_name(start);
+	if (!len)
+		return false;
+
+	// one token, read by the lexer itself
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, (char*)start, len);
+	lsn_token_t tkn;
+	lsn_token_tag_t tag = lsn_lex_next(&lex, &tkn);
+	if (lex.pos != len)
+		return false;
+	switch (tag)
+	{
+	case LSN_TKN_String:  *value = lsn_ar_string_str(NULL, &tkn.value.string); break;
+	case LSN_TKN_Tag:     *value = lsn_ar_tag_str(NULL, &tkn.value.tag); break;
+	case LSN_TKN_Integer: *value = lsn_ar_integer(NULL, tkn.value.integer); break;
+	case LSN_TKN_Float:   *value = lsn_ar_float(NULL, tkn.value.lsn_float); break;
+	default:              return false;
+	}
+	*it += len;
+	return true;
+}
+
+static bool lsn_q_predicate(const char** it, lsn_query_step_t* step)
+{
+	const char* c = *it + 1;
+	if (*c++ != ':')
+		return false;
+	step->pred_tag = (str_t) { .data = (char*)c, .len = lsn_q_name(c) };
+	if (!step->pred_tag.len)
+		return false;
+	c += step->pred_tag.len;
+	step->has_pred = true;
+	step->op = LSN_Q_Exists;
+	if (*c != ']')
+	{
+		if (c[0] == '=')
+			step->op = LSN_Q_Eq;
+		else if (c[0] == '!' && c[1] == '=')
+			step->op = LSN_Q_Ne;
+		else if (c[0] == '<')
+			step->op = c[1] == '=' ? LSN_Q_Le : LSN_Q_Lt;
+		else if (c[0] == '>')
+			step->op = c[1] == '=' ? LSN_Q_Ge : LSN_Q_Gt;
+		else
+			return false;
+		c += (step->op == LSN_Q_Eq || step->op == LSN_Q_Lt || step->op == LSN_Q_Gt) ? 1 : 2;
+		if (!lsn_q_literal(&c, &step->pred_value) || *c != ']')
+			return false;
+	}
+	*it = c + 1;
+	return true;
+}
+
+static int lsn_q_compare(const lison_t* value, const lison_t* literal, bool* comparable)
+{
+	*comparable = true;
+	bool numbers = (value->tag == LSN_Integer || value->tag == LSN_Float)
+		&& (literal->tag == LSN_Integer || literal->tag == LSN_Float);
+	if (numbers)
+	{
+		double a = value->tag == LSN_Integer ? value->value.integer : value->value.lsn_float;
+		double b = literal->tag == LSN_Integer ? literal->value.integer : literal->value.lsn_float;
+		return (a > b) - (a < b);
+	}
+	if (value->tag != literal->tag || (value->tag != LSN_String && value->tag != LSN_Tag))
+	{
+		*comparable = false;
+		return 0;
+	}
+	str_t a = lsn_str(value);
+	str_t b = lsn_str(literal);
+	int res = memcmp(a.data, b.data, a.len < b.len ? a.len : b.len);
+	return res ? res : (a.len > b.len) - (a.len < b.len);
+}
+
+// key is the tag of the predicate, NULL to look it up by name
+static bool lsn_q_test(const lsn_query_step_t* step, lsn_key_t* key, const lison_t* value)
+{
+	if (!step->has_pred)
+		return true;
+	const lison_t* field = key
+		? lsn_key_get(value, key)
+		: lsn_get_n(value, step->pred_tag.data, step->pred_tag.len);
+	if (!field)
+		return false;
+	if (step->op == LSN_Q_Exists)
+		return true;
+	bool comparable;
+	int cmp = lsn_q_compare(field, step->pred_value, &comparable);
+	switch (step->op)
+	{
+	case LSN_Q_Eq: return comparable && cmp == 0;
+	case LSN_Q_Ne: return !comparable || cmp != 0;
+	case LSN_Q_Lt: return comparable && cmp < 0;
+	case LSN_Q_Le: return comparable && cmp <= 0;
+	case LSN_Q_Gt: return comparable && cmp > 0;
+	case LSN_Q_Ge: return comparable && cmp >= 0;
+	default:       return false;
+	}
+}
+
+/**
+ * Runs the steps from step on over the tree. keys holds the tag and the
+ * predicate tag of every step, or is NULL to look them up by name.
+ * Returns false if the callback asked to stop.
+ */
+static bool lsn_q_eval(const lsn_query_t* query, lsn_key_t* keys, size_t step, const lison_t* value, lsn_query_cb cb, void* user)
+{
+	if (step == query->len)
+		return cb(value, user);
+	if (!value)
+		return true;
+	const lsn_query_step_t* s = &query->steps[step];
+	lsn_key_t* pred = keys ? &keys[2 * step + 1] : NULL;
+	if ((value->tag == LSN_IntArray || value->tag == LSN_FloatArray) && s->kind != LSN_Q_Tag)
+	{
+		// the numbers of packed arrays are matched as atoms on the stack
+		size_t len = value->value.array.len;
+		for (size_t idx = s->kind == LSN_Q_Index ? s->index : 0; idx < len; idx++)
+		{
+			lison_t item = { .tag = LSN_Integer, .flags = 0 };
+			if (value->tag == LSN_IntArray)
+				item.value.integer = value->value.array.ints[idx];
+			else
+			{
+				item.tag = LSN_Float;
+				item.value.lsn_float = value->value.array.floats[idx];
+			}
+			if (lsn_q_test(s, pred, &item) && !lsn_q_eval(query, keys, step + 1, &item, cb, user))
+				return false;
+			if (s->kind == LSN_Q_Index)
+				break;
+		}
+		return true;
+	}
+	if (value->tag != LSN_Object)
+		return true;
+	if (s->kind == LSN_Q_Tag)
+	{
+		const lison_t* next = keys
+			? lsn_key_get(value, &keys[2 * step])
+			: lsn_get_n(value, s->tag.data, s->tag.len);
+		return !next || !lsn_q_test(s, pred, next) || lsn_q_eval(query, keys, step + 1, next, cb, user);
+	}
+	size_t idx = 0;
+	for (const lison_node_t* it = value->value.object.head; it; it = it->next, idx++)
+	{
+		if (s->kind == LSN_Q_Index && idx != s->index)
+			continue;
+		if (lsn_q_test(s, pred, it->value) && !lsn_q_eval(query, keys, step + 1, it->value, cb, user))
+			return false;
+		if (s->kind == LSN_Q_Index)
+			break;
+	}
+	return true;
+}
+
+/**
+ * Builds the value of the last event of the reader, reading the rest of
+ * it if it is an object.
+ */
+static lison_t* lsn_q_build(lsn_reader_t* reader)
+{
+	const lsn_event_t* ev = &reader->event;
+	switch (ev->tag)
+	{
+	case LSN_EV_String:  return lsn_ar_string_str(NULL, &ev->value.string);
+	case LSN_EV_Tag:     return lsn_ar_tag_str(NULL, &ev->value.tag);
+	case LSN_EV_Integer: return lsn_ar_integer(NULL, ev->value.integer);
+	case LSN_EV_Float:   return lsn_ar_float(NULL, ev->value.lsn_float);
+	case LSN_EV_ObjectStart: break;
+	default:             return NULL;
+	}
+
+	size_t base = reader->depth;
+	size_t cap = LSN_LOCAL_DEPTH;
+	lison_list_t* stack = (lison_list_t*)malloc(cap * sizeof(lison_list_t));
+	size_t top = 0;
+	lsn_lst_init(&stack[top++]);
+	lison_t* res = NULL;
+	while (!res)
+	{
+		lsn_event_tag_t tag = lsn_next(reader);
+		lison_t* value = NULL;
+		if (tag == LSN_EV_Error || tag == LSN_EV_End)
+			break;
+		if (tag == LSN_EV_ObjectStart)
+		{
+			if (top == cap)
+			{
+				cap *= 2;
+				stack = (lison_list_t*)realloc(stack, cap * sizeof(lison_list_t));
+			}
+			lsn_lst_init(&stack[top++]);
+			continue;
+		}
+		if (tag == LSN_EV_ObjectEnd)
+		{
+			value = lsn_ar_object(NULL, stack[--top]);
+			if (reader->depth == base - 1)
+			{
+				res = value;
+				break;
+			}
+		}
+		else
+			value = lsn_q_build(reader);
+		lsn_lst_append(&stack[top - 1], value);
+	}
+	while (!res && top > 0)
+		lsn_lst_delete(&stack[--top]);
+	free(stack);
+	return res;
+}
+
+// API --------------------------------------------------
+
+lsn_query_t* lsn_query_compile(const char* text)
+{
+	if (!text || !*text)
+		return NULL;
+	lsn_query_t* query = (lsn_query_t*)malloc(sizeof(lsn_query_t));
+	// the names are slices of a copy of the text
+	query->text = strdup(text);
+	query->len = 0;
+	size_t cap = LSN_Q_INIT_STEPS;
+	query->steps = (lsn_query_step_t*)malloc(cap * sizeof(lsn_query_step_t));
+
+	const char* it = query->text;
+	bool ok = true;
+	while (ok)
+	{
+		if (query->len == cap)
+		{
+			cap *= 2;
+			query->steps = (lsn_query_step_t*)realloc(query->steps, cap * sizeof(lsn_query_step_t));
+		}
+		lsn_query_step_t* step = &query->steps[query->len++];
+		*step = (lsn_query_step_t) {
+			.kind = LSN_Q_Any, .tag = { NULL, 0 }, .index = 0,
+			.has_pred = false, .pred_tag = { NULL, 0 }, .op = LSN_Q_Exists, .pred_value = NULL,
+		};
+		if (*it == '*')
+			it++;
+		else if (*it == ':')
+		{
+			step->kind = LSN_Q_Tag;
+			step->tag = (str_t) { .data = (char*)it + 1, .len = lsn_q_name(it + 1) };
+			ok = step->tag.len > 0;
+			it += 1 + step->tag.len;
+		}
+		else if (*it >= '0' && *it <= '9')
+		{
+			step->kind = LSN_Q_Index;
+			char* end;
+			step->index = (size_t)strtoul(it, &end, 10);
+			it = end;
+		}
+		else
+			ok = false;
+		if (ok && *it == '[')
+			ok = lsn_q_predicate(&it, step);
+		if (!ok || *it == 0)
+			break;
+		ok = *it++ == '/';
+	}
+	if (!ok)
+	{
+		LOG("[LSN QUERY] Syntax error at %zu in %s\n", (size_t)(it - query->text), text);
+		lsn_query_delete(&query);
+	}
+	return query;
+}
+
+void lsn_query_delete(lsn_query_t** query)
+{
+	if (!query || !*query)
+		return;
+	for (size_t i = 0; i < (*query)->len; i++)
+		lsn_delete(&(*query)->steps[i].pred_value);
+	free((*query)->steps);
+	free((*query)->text);
+	free(*query);
+	*query = NULL;
+}
+
+void lsn_query_run(const lsn_query_t* query, const lison_t* root, lsn_query_cb cb, void* user)
+{
+	if (!query || !root)
+		return;
+	lsn_key_t local[2 * LSN_Q_INIT_STEPS];
+	lsn_key_t* keys = query->len <= LSN_Q_INIT_STEPS
+		? local
+		: (lsn_key_t*)malloc(2 * query->len * sizeof(lsn_key_t));
+	for (size_t i = 0; i < query->len; i++)
+	{
+		const lsn_query_step_t* step = &query->steps[i];
+		lsn_key_init(&keys[2 * i], step->tag.data, step->tag.len);
+		lsn_key_init(&keys[2 * i + 1], step->pred_tag.data, step->pred_tag.len);
+	}
+	lsn_q_eval(query, keys, 0, root, cb, user);
+	if (keys != local)
+		free(keys);
+}
+
+bool lsn_query_scan(const lsn_query_t* query, char* src, size_t len, lsn_query_cb cb, void* user)
+{
+	lsn_reader_t reader;
+	lsn_reader_init(&reader, src, len, NULL);
+	lsn_event_tag_t tag = lsn_next(&reader);
+	if (tag != LSN_EV_ObjectStart)
+	{
+		// an atom root has nothing to match, but must be valid
+		return tag != LSN_EV_Error && lsn_next(&reader) == LSN_EV_End;
+	}
+
+	lsn_q_frame_t local[LSN_LOCAL_DEPTH];
+	lsn_q_frame_t* frames = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	frames[top++] = (lsn_q_frame_t) { .step = 0, .item = 0, .take_next = false, .finished = false };
+	bool go = true;
+	while (top > 0 && go)
+	{
+		tag = lsn_next(&reader);
+		if (tag == LSN_EV_Error)
+			break;
+		lsn_q_frame_t* frame = &frames[top - 1];
+		if (tag == LSN_EV_ObjectEnd)
+		{
+			top--;
+		}
+		else
+		{
+			// the event is an item of the object of the frame
+			const lsn_query_step_t* step = &query->steps[frame->step];
+			bool taken = false;
+			if (step->kind == LSN_Q_Any)
+				taken = true;
+			else if (step->kind == LSN_Q_Index)
+				taken = frame->finished = frame->item == step->index;
+			else if (frame->take_next)
+				taken = frame->finished = true;
+			else if (frame->item % 2 == 0 && tag == LSN_EV_Tag && reader.event.value.tag.len == step->tag.len
+				&& memcmp(reader.event.value.tag.data, step->tag.data, step->tag.len) == 0)
+				frame->take_next = true;
+			frame->item++;
+
+			if (!taken)
+			{
+				if (tag == LSN_EV_ObjectStart)
+					lsn_reader_skip(&reader);
+			}
+			else if (step->has_pred || frame->step + 1 == query->len)
+			{
+				// the value is needed as a whole
+				lison_t* value = lsn_q_build(&reader);
+				// built values are not interned, their tags are compared by name
+				if (value && lsn_q_test(step, NULL, value))
+					go = lsn_q_eval(query, NULL, frame->step + 1, value, cb, user);
+				lsn_delete(&value);
+			}
+			else if (tag == LSN_EV_ObjectStart)
+			{
+				size_t next = frame->step + 1;
+				if (top == cap)
+				{
+					lsn_q_frame_t* grown = (lsn_q_frame_t*)malloc(2 * cap * sizeof(lsn_q_frame_t));
+					memcpy(grown, frames, top * sizeof(lsn_q_frame_t));
+					if (frames != local)
+						free(frames);
+					frames = grown;
+					cap *= 2;
+				}
+				frames[top++] = (lsn_q_frame_t) { .step = next, .item = 0, .take_next = false, .finished = false };
+				continue;
+			}
+		}
+
+		// objects whose step has taken its item have nothing more to give
+		while (top > 0 && frames[top - 1].finished && reader.event.tag != LSN_EV_Error)
+		{
+			lsn_reader_skip(&reader);
+			top--;
+		}
+	}
+	if (frames != local)
+		free(frames);
+	if (!go)
+		return true;
+	// the rest must still be read to know the source is valid
+	while ((tag = lsn_next(&reader)) != LSN_EV_End && tag != LSN_EV_Error)
+		;
+	return tag == LSN_EV_End;
+}
@@ -0,0 +1,99 @@
+#include "lsn.h"
+
+/**
+ * Pull reader.
+ * Every call lexes one token and turns it into an event, checking the
+ * parens with a depth counter instead of building lists, so nothing is
+ * allocated and string and tag payloads stay slices of the source.
+ */
+
+static lsn_event_tag_t lsn_reader_fail(lsn_reader_t* reader, const char* what)
+{
+	// only used by debug builds
+	(void)what;
+	LOG("[LSN READER] %s at %zu\n", what, reader->lex.pos);
+	reader->event.tag = LSN_EV_Error;
+	return reader->event.tag;
+}
+
+// API --------------------------------------------------
+
+void lsn_reader_init(lsn_reader_t* reader, char* src, size_t len, const lsn_options_t* opt)
+{
+	lsn_lex_init(&reader->lex, src, len);
+	reader->depth = 0;
+	reader->max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	reader->started = false;
+	reader->event.tag = LSN_EV_ObjectStart;
+	reader->event.depth = 0;
+}
+
+lsn_event_tag_t lsn_next(lsn_reader_t* reader)
+{
+	lsn_event_t* ev = &reader->event;
+	if (reader->started && (ev->tag == LSN_EV_Error || ev->tag == LSN_EV_End))
+		return ev->tag;
+	// the root is complete once the depth is back to 0
+	bool complete = reader->started && reader->depth == 0;
+	reader->started = true;
+
+	lsn_token_t tkn;
+	lsn_token_tag_t tag = lsn_lex_next(&reader->lex, &tkn);
+	if (complete)
+	{
+		if (tag != LSN_TKN_EOF)
+			return lsn_reader_fail(reader, "Value after the root");
+		ev->tag = LSN_EV_End;
+		return ev->tag;
+	}
+
+	ev->depth = reader->depth;
+	switch (tag)
+	{
+	case LSN_TKN_LParen:
+		if (reader->depth >= reader->max_depth)
+			return lsn_reader_fail(reader, "Nesting too deep");
+		reader->depth++;
+		ev->tag = LSN_EV_ObjectStart;
+		break;
+	case LSN_TKN_RParen:
+		if (reader->depth == 0)
+			return lsn_reader_fail(reader, "Unexpected right paren");
+		ev->depth = --reader->depth;
+		ev->tag = LSN_EV_ObjectEnd;
+		break;
+	case LSN_TKN_String:
+		ev->tag = LSN_EV_String;
+		ev->value.string = tkn.value.string;
+		break;
+	case LSN_TKN_Tag:
+		ev->tag = LSN_EV_Tag;
+		ev->value.tag = tkn.value.tag;
+		break;
+	case LSN_TKN_Integer:
+		ev->tag = LSN_EV_Integer;
+		ev->value.integer = tkn.value.integer;
+		break;
+	case LSN_TKN_Float:
+		ev->tag = LSN_EV_Float;
+		ev->value.lsn_float = tkn.value.lsn_float;
+		break;
+	case LSN_TKN_EOF:
+		return lsn_reader_fail(reader, reader->depth ? "Missing right paren" : "Empty document");
+	default:
+		return lsn_reader_fail(reader, "Invalid token");
+	}
+	return ev->tag;
+}
+
+lsn_event_tag_t lsn_reader_skip(lsn_reader_t* reader)
+{
+	if (reader->depth == 0 || reader->event.tag == LSN_EV_Error)
+		return reader->event.tag;
+	size_t target = reader->depth - 1;
+	lsn_event_tag_t tag;
+	do
+		tag = lsn_next(reader);
+	while (tag != LSN_EV_Error && !(tag == LSN_EV_ObjectEnd && reader->depth == target));
+	return tag;
+}
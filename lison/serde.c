@@ -1,14 +1,430 @@
 #include "lsn.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
 
-lison_t* lsn_deserialize(char* filepath)
+/**
+ * File I/O of LiSON documents.
+ * Files are mapped into memory and parsed in place, with a read() loop
+ * for files that cannot be mapped. The serializer writes into a buffer
+ * of LSN_WRITE_BUFFER bytes flushed with write(); strings longer than
+ * half of it go out together with the buffer in one writev().
+ * The same writer takes single values for encoders that write without a
+ * tree.
+ */
+
+#define LSN_WRITE_BUFFER (64u << 10)
+
+typedef struct _lsn_writer_t
+{
+	int fd;
+	size_t len;
+	bool failed;
+	char buf[LSN_WRITE_BUFFER];
+} lsn_writer_t;
+
+static bool lsn_write_all(int fd, struct iovec* iov, int iovcnt)
+{
+	while (iovcnt > 0)
+	{
+		ssize_t res = writev(fd, iov, iovcnt);
+		if (res < 0)
+			return false;
+		size_t done = (size_t)res;
+		while (iovcnt > 0 && done >= iov->iov_len)
+		{
+			done -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char*)iov->iov_base + done;
+			iov->iov_len -= done;
+		}
+	}
+	return true;
+}
+
+static void lsn_w_flush(lsn_writer_t* w)
 {
-	(void)filepath;
-	return NULL;
+	if (w->len && !w->failed)
+	{
+		struct iovec iov = { .iov_base = w->buf, .iov_len = w->len };
+		w->failed = !lsn_write_all(w->fd, &iov, 1);
+	}
+	w->len = 0;
 }
 
-void lsn_serialize(char* filepath, lison_t* lison)
+static void lsn_w_bytes(lsn_writer_t* w, const char* data, size_t len)
+{
+	if (w->len + len <= LSN_WRITE_BUFFER)
+	{
+		memcpy(w->buf + w->len, data, len);
+		w->len += len;
+		return;
+	}
+	if (len < LSN_WRITE_BUFFER / 2)
+	{
+		lsn_w_flush(w);
+		memcpy(w->buf, data, len);
+		w->len = len;
+		return;
+	}
+	// long values skip the buffer
+	struct iovec iov[2] = {
+		{ .iov_base = w->buf, .iov_len = w->len },
+		{ .iov_base = (char*)data, .iov_len = len },
+	};
+	if (!w->failed)
+		w->failed = !lsn_write_all(w->fd, iov, 2);
+	w->len = 0;
+}
+
+static void lsn_w_char(lsn_writer_t* w, char c)
+{
+	if (w->len == LSN_WRITE_BUFFER)
+		lsn_w_flush(w);
+	w->buf[w->len++] = c;
+}
+
+static const char lsn_digit_pairs[] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+/**
+ * Writes the decimal digits two at a time from the end of a local buffer.
+ */
+static size_t lsn_format_int(char* out, int32_t value)
+{
+	char local[12];
+	char* end = local + sizeof(local);
+	char* it = end;
+	uint32_t u = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+	while (u >= 100)
+	{
+		uint32_t pair = (u % 100) * 2;
+		u /= 100;
+		*--it = lsn_digit_pairs[pair + 1];
+		*--it = lsn_digit_pairs[pair];
+	}
+	if (u >= 10)
+	{
+		*--it = lsn_digit_pairs[u * 2 + 1];
+		*--it = lsn_digit_pairs[u * 2];
+	}
+	else
+		*--it = (char)('0' + u);
+	if (value < 0)
+		*--it = '-';
+	size_t len = (size_t)(end - it);
+	memcpy(out, it, len);
+	return len;
+}
+
+static const double lsn_pow10[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+};
+
+/**
+ * Fixed notation with the fewest fraction digits (at least one, as the
+ * grammar needs d.d) that reads back as the same float.
+ * Values with up to 15 significant digits are checked with the division
+ * the lexer itself uses, anything else goes through snprintf and strtof.
+ * Returns 0 for infinities and NaN, which LiSON cannot express.
+ */
+static size_t lsn_format_float(char* out, size_t cap, float value)
+{
+	if (value != value || value - value != 0)
+		return 0;
+	bool negative = value < 0 || (value == 0 && 1 / value < 0);
+	float abs = negative ? -value : value;
+	for (int digits = 1; digits < 10; digits++)
+	{
+		double scaled = (double)abs * lsn_pow10[digits];
+		if (scaled >= 1e15)
+			break;
+		uint64_t mantissa = (uint64_t)(scaled + 0.5);
+		if ((float)((double)mantissa / lsn_pow10[digits]) != abs)
+			continue;
+		char local[24];
+		char* end = local + sizeof(local);
+		char* it = end;
+		// at least one digit before the point
+		for (int i = 0; i <= digits || mantissa; i++)
+		{
+			if (i == digits)
+				*--it = '.';
+			*--it = (char)('0' + mantissa % 10);
+			mantissa /= 10;
+		}
+		if (negative)
+			*--it = '-';
+		size_t len = (size_t)(end - it);
+		memcpy(out, it, len);
+		return len;
+	}
+	for (int digits = 1; digits < 64; digits++)
+	{
+		int len = snprintf(out, cap, "%.*f", digits, (double)value);
+		if (len < 0 || (size_t)len >= cap)
+			return 0;
+		if (strtof(out, NULL) == value)
+			return (size_t)len;
+	}
+	return 0;
+}
+
+static void lsn_w_value(lsn_writer_t* w, const lison_t* object)
+{
+	char num[128];
+	switch (object->tag)
+	{
+	case LSN_String:
+	{
+		str_t str = lsn_str(object);
+		lsn_writer_string(w, &str);
+		break;
+	}
+	case LSN_Tag:
+	{
+		str_t str = lsn_str(object);
+		lsn_writer_tag(w, &str);
+		break;
+	}
+	case LSN_Integer:
+		lsn_w_bytes(w, num, lsn_format_int(num, object->value.integer));
+		break;
+	case LSN_Float:
+	{
+		size_t len = lsn_format_float(num, sizeof(num), object->value.lsn_float);
+		if (!len)
+		{
+			LOG("[LSN SERDE] Float without a LiSON form\n");
+			w->failed = true;
+		}
+		lsn_w_bytes(w, num, len);
+		break;
+	}
+	case LSN_IntArray:
+	case LSN_FloatArray:
+	{
+		lsn_w_char(w, '(');
+		for (size_t i = 0; i < object->value.array.len; i++)
+		{
+			if (i)
+				lsn_w_char(w, ' ');
+			size_t len = object->tag == LSN_IntArray
+				? lsn_format_int(num, object->value.array.ints[i])
+				: lsn_format_float(num, sizeof(num), object->value.array.floats[i]);
+			if (!len)
+			{
+				LOG("[LSN SERDE] Float without a LiSON form\n");
+				w->failed = true;
+			}
+			lsn_w_bytes(w, num, len);
+		}
+		lsn_w_char(w, ')');
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/**
+ * Iterative, the stack holds the next node of every open list.
+ */
+static void lsn_w_tree(lsn_writer_t* w, const lison_t* root)
+{
+	const lison_node_t* local[LSN_LOCAL_DEPTH];
+	const lison_node_t** stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+
+	const lison_t* object = root;
+	while (true)
+	{
+		if (object && object->tag == LSN_Object)
+		{
+			if (top == cap)
+			{
+				const lison_node_t** grown = (const lison_node_t**)malloc(2 * cap * sizeof(lison_node_t*));
+				memcpy(grown, stack, top * sizeof(lison_node_t*));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				cap *= 2;
+			}
+			lsn_w_char(w, '(');
+			stack[top++] = object->value.object.head;
+		}
+		else if (object)
+			lsn_w_value(w, object);
+
+		// next value, closing the finished lists
+		object = NULL;
+		while (top > 0 && !stack[top - 1])
+		{
+			lsn_w_char(w, ')');
+			top--;
+		}
+		if (top == 0)
+			break;
+		const lison_node_t* node = stack[top - 1];
+		if (node->prev)
+			lsn_w_char(w, ' ');
+		stack[top - 1] = node->next;
+		object = node->value;
+	}
+	if (stack != local)
+		free(stack);
+}
+
+// API --------------------------------------------------
+
+bool lsn_write(int fd, const lison_t* lison)
 {
-	(void)filepath;
-	(void)lison;
+	if (!lison)
+		return false;
+	lsn_writer_t* w = (lsn_writer_t*)malloc(sizeof(lsn_writer_t));
+	w->fd = fd;
+	w->len = 0;
+	w->failed = false;
+	lsn_w_tree(w, lison);
+	lsn_w_flush(w);
+	bool res = !w->failed;
+	free(w);
+	return res;
+}
+
+lsn_writer_t* lsn_writer_new(int fd)
+{
+	lsn_writer_t* w = (lsn_writer_t*)malloc(sizeof(lsn_writer_t));
+	w->fd = fd;
+	w->len = 0;
+	w->failed = false;
+	return w;
+}
+
+bool lsn_writer_delete(lsn_writer_t** w)
+{
+	if (!w || !*w)
+		return false;
+	lsn_w_flush(*w);
+	bool res = !(*w)->failed;
+	free(*w);
+	*w = NULL;
+	return res;
+}
+
+void lsn_writer_raw(lsn_writer_t* w, const char* data, size_t len)
+{
+	lsn_w_bytes(w, data, len);
+}
+
+void lsn_writer_integer(lsn_writer_t* w, int32_t value)
+{
+	char num[12];
+	lsn_w_bytes(w, num, lsn_format_int(num, value));
+}
+
+void lsn_writer_float(lsn_writer_t* w, float value)
+{
+	char num[128];
+	size_t len = lsn_format_float(num, sizeof(num), value);
+	if (!len)
+	{
+		LOG("[LSN SERDE] Float without a LiSON form\n");
+		w->failed = true;
+	}
+	lsn_w_bytes(w, num, len);
+}
+
+void lsn_writer_string(lsn_writer_t* w, const str_t* value)
+{
+	if (!lsn_lex_string_ok(value))
+	{
+		LOG("[LSN SERDE] String the lexer would not read back\n");
+		w->failed = true;
+	}
+	lsn_w_char(w, '\'');
+	lsn_w_bytes(w, value->data, value->len);
+	lsn_w_char(w, '\'');
+}
+
+void lsn_writer_tag(lsn_writer_t* w, const str_t* name)
+{
+	if (!lsn_lex_tag_ok(name))
+	{
+		LOG("[LSN SERDE] Tag the lexer would not read back\n");
+		w->failed = true;
+	}
+	lsn_w_char(w, ':');
+	lsn_w_bytes(w, name->data, name->len);
+}
+
+bool lsn_serialize(char* filepath, lison_t* lison)
+{
+	if (!filepath || !lison)
+		return false;
+	int fd = open(filepath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	bool res = lsn_write(fd, lison);
+	return close(fd) == 0 && res;
+}
+
+lison_t* lsn_deserialize(char* filepath)
+{
+	if (!filepath)
+		return NULL;
+	int fd = open(filepath, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	lison_t* res = NULL;
+	size_t len = (size_t)st.st_size;
+	void* data = S_ISREG(st.st_mode) && len > 0
+		? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)
+		: MAP_FAILED;
+	if (data != MAP_FAILED)
+	{
+		madvise(data, len, MADV_SEQUENTIAL);
+		// values are copied out, the mapping is not needed after parsing
+		res = lsn_compile_n((char*)data, len, NULL);
+		munmap(data, len);
+		close(fd);
+		return res;
+	}
+
+	// pipes, devices and the like
+	size_t cap = S_ISREG(st.st_mode) && len > 0 ? len : 4096;
+	char* buff = (char*)malloc(cap);
+	len = 0;
+	ssize_t got;
+	while ((got = read(fd, buff + len, cap - len)) > 0)
+	{
+		len += (size_t)got;
+		if (len == cap)
+		{
+			cap *= 2;
+			buff = (char*)realloc(buff, cap);
+		}
+	}
+	if (got == 0)
+		res = lsn_compile_n(buff, len, NULL);
+	free(buff);
+	close(fd);
+	return res;
 }
@@ -0,0 +1,298 @@
+#include "lsn.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Sources with many documents one after the other, like a log with one
+ * record per object.
+ * The iterator compiles one document per call, reusing its token stream.
+ * In batch mode the structural index of the rest of the source gives the
+ * boundaries of the documents, which are cut into blocks of a fixed
+ * number of documents. The blocks go into a ring of twice as many blocks
+ * as threads: a pool of threads compiles them in the order they are cut
+ * while the iterator hands out the compiled ones in the same order, and
+ * refills every block it is done with, so the workers keep going while
+ * the caller consumes the documents.
+ */
+
+typedef struct _lsn_docs_block_t
+{
+	char* src;
+	size_t len;
+	lison_t** docs;
+	size_t docs_len;
+	size_t docs_cap;
+	size_t next; // the next document to hand out
+	bool failed;
+	bool done; // under the lock of the pool
+	lsn_token_stream_t stream;
+} lsn_docs_block_t;
+
+typedef struct _lsn_docs_pool_t
+{
+	pthread_t* threads;
+	size_t threads_len;
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	bool stop;
+	const lsn_options_t* opt;
+
+	// the ring, as counts of blocks: handed out <= taken <= cut
+	lsn_docs_block_t* blocks;
+	size_t blocks_len;
+	size_t head; // the block being handed out, owned by the iterator
+	size_t ready; // blocks known to be compiled, owned by the iterator
+	size_t taken; // under the lock
+	size_t tail; // under the lock
+
+	// documents left, as positions in the index
+	char* base;
+	size_t len;
+	lsn_structural_t index;
+	uint32_t* match;
+	size_t at;
+	size_t batch;
+} lsn_docs_pool_t;
+
+static void lsn_docs_block_compile(lsn_docs_block_t* block, const lsn_options_t* opt)
+{
+	size_t pos = 0;
+	while (pos < block->len)
+	{
+		lison_t* doc = lsn_compile_next(&block->stream, block->src, block->len, &pos, opt);
+		if (!doc)
+		{
+			block->failed = pos < block->len;
+			return;
+		}
+		if (block->docs_len == block->docs_cap)
+		{
+			block->docs_cap = block->docs_cap ? 2 * block->docs_cap : 16;
+			block->docs = (lison_t**)realloc(block->docs, block->docs_cap * sizeof(lison_t*));
+		}
+		block->docs[block->docs_len++] = doc;
+	}
+}
+
+static void* lsn_docs_worker(void* arg)
+{
+	lsn_docs_pool_t* pool = (lsn_docs_pool_t*)arg;
+	pthread_mutex_lock(&pool->lock);
+	while (true)
+	{
+		while (!pool->stop && pool->taken == pool->tail)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if (pool->stop)
+			break;
+		lsn_docs_block_t* block = &pool->blocks[pool->taken++ % pool->blocks_len];
+		pthread_mutex_unlock(&pool->lock);
+
+		lsn_docs_block_compile(block, pool->opt);
+
+		pthread_mutex_lock(&pool->lock);
+		block->done = true;
+		pthread_cond_signal(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+}
+
+// frees the documents of a block that were not handed out
+static void lsn_docs_block_clear(lsn_docs_block_t* block)
+{
+	for (size_t i = block->next; i < block->docs_len; i++)
+		lsn_delete(&block->docs[i]);
+	block->docs_len = 0;
+	block->next = 0;
+	block->failed = false;
+	block->done = false;
+}
+
+/**
+ * Cuts blocks into the free part of the ring and hands them to the
+ * workers. Only the iterator cuts, so tail is read without the lock.
+ */
+static void lsn_docs_refill(lsn_docs_pool_t* pool)
+{
+	const uint32_t* offsets = pool->index.offsets;
+	size_t len = pool->index.len;
+	size_t tail = pool->tail;
+	while (tail - pool->head < pool->blocks_len && pool->at < len)
+	{
+		size_t first = pool->at;
+		for (size_t n = 0; n < pool->batch && pool->at < len; n++)
+			pool->at = pool->base[offsets[pool->at]] == '(' ? pool->match[pool->at] + 1 : pool->at + 1;
+		lsn_docs_block_t* block = &pool->blocks[tail++ % pool->blocks_len];
+		block->src = pool->base + offsets[first];
+		// up to the next document, comments and whitespace included
+		block->len = (pool->at < len ? offsets[pool->at] : pool->len) - offsets[first];
+	}
+	if (tail == pool->tail)
+		return;
+	pthread_mutex_lock(&pool->lock);
+	pool->tail = tail;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+static void lsn_docs_pool_delete(lsn_docs_pool_t* pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (size_t i = 0; i < pool->threads_len; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	for (size_t b = 0; b < pool->blocks_len; b++)
+	{
+		lsn_docs_block_clear(&pool->blocks[b]);
+		free(pool->blocks[b].docs);
+		lsn_ts_delete(&pool->blocks[b].stream);
+	}
+	free(pool->blocks);
+	free(pool->threads);
+	lsn_structural_delete(&pool->index);
+	free(pool->match);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool);
+}
+
+// API --------------------------------------------------
+
+void lsn_docs_init(lsn_docs_t* docs, char* src, size_t len, const lsn_options_t* opt)
+{
+	docs->src = src;
+	docs->len = len;
+	docs->pos = 0;
+	docs->mapped = false;
+	docs->failed = false;
+	docs->opt = opt ? *opt : (lsn_options_t) { .max_depth = 0, .flags = 0, .symbols = NULL };
+	docs->stream = (lsn_token_stream_t) { .tokens = NULL, .len = 0, .cap = 0 };
+	docs->pool = NULL;
+}
+
+bool lsn_docs_open(lsn_docs_t* docs, char* path, const lsn_options_t* opt)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+	{
+		close(fd);
+		return false;
+	}
+	size_t len = (size_t)st.st_size;
+	void* data = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	madvise(data, len, MADV_SEQUENTIAL);
+	lsn_docs_init(docs, (char*)data, len, opt);
+	docs->mapped = len > 0;
+	return true;
+}
+
+bool lsn_docs_parallel(lsn_docs_t* docs, size_t threads, size_t batch)
+{
+	if (docs->pool || threads == 0 || batch == 0)
+		return false;
+	lsn_docs_pool_t* pool = (lsn_docs_pool_t*)calloc(1, sizeof(lsn_docs_pool_t));
+	pool->base = docs->src + docs->pos;
+	pool->len = docs->len - docs->pos;
+	lsn_structural_init(&pool->index);
+	// unbalanced parens are left to the sequential iterator to report
+	if (!lsn_structural_index(pool->base, pool->len, &pool->index)
+		|| !(pool->match = lsn_structural_match(pool->base, &pool->index)))
+	{
+		lsn_structural_delete(&pool->index);
+		free(pool);
+		return false;
+	}
+	pool->batch = batch;
+	pool->opt = &docs->opt;
+	pool->blocks_len = 2 * threads;
+	pool->blocks = (lsn_docs_block_t*)calloc(pool->blocks_len, sizeof(lsn_docs_block_t));
+	pool->threads = (pthread_t*)malloc(threads * sizeof(pthread_t));
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (; pool->threads_len < threads; pool->threads_len++)
+	{
+		if (pthread_create(&pool->threads[pool->threads_len], NULL, lsn_docs_worker, pool) != 0)
+			break;
+	}
+	if (pool->threads_len == 0)
+	{
+		lsn_docs_pool_delete(pool);
+		return false;
+	}
+	lsn_docs_refill(pool);
+	docs->pool = pool;
+	return true;
+}
+
+lison_t* lsn_docs_next(lsn_docs_t* docs)
+{
+	if (docs->failed)
+		return NULL;
+	lsn_docs_pool_t* pool = docs->pool;
+	if (!pool)
+	{
+		size_t pos = docs->pos;
+		lison_t* res = lsn_compile_next(&docs->stream, docs->src, docs->len, &docs->pos, &docs->opt);
+		docs->failed = !res && pos == docs->pos && docs->pos < docs->len;
+		return res;
+	}
+
+	while (true)
+	{
+		if (pool->head == pool->tail)
+		{
+			docs->pos = docs->len;
+			return NULL;
+		}
+		lsn_docs_block_t* block = &pool->blocks[pool->head % pool->blocks_len];
+		if (pool->ready == pool->head)
+		{
+			pthread_mutex_lock(&pool->lock);
+			while (!block->done)
+				pthread_cond_wait(&pool->done, &pool->lock);
+			pthread_mutex_unlock(&pool->lock);
+			pool->ready = pool->head + 1;
+		}
+		if (block->next < block->docs_len)
+			return block->docs[block->next++];
+		if (block->failed)
+		{
+			docs->failed = true;
+			return NULL;
+		}
+		lsn_docs_block_clear(block);
+		pool->head++;
+		lsn_docs_refill(pool);
+	}
+}
+
+void lsn_docs_close(lsn_docs_t* docs)
+{
+	if (!docs)
+		return;
+	if (docs->pool)
+		lsn_docs_pool_delete(docs->pool);
+	docs->pool = NULL;
+	lsn_ts_delete(&docs->stream);
+	if (docs->mapped)
+		munmap(docs->src, docs->len);
+	docs->mapped = false;
+	docs->src = NULL;
+	docs->len = 0;
+	docs->pos = 0;
+}
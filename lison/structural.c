@@ -0,0 +1,267 @@
+#include "lsn.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LSN_SI_X86 1
+#endif
+
+/**
+ * Structural index: the offsets where tokens start.
+ * The source is classified 64 bytes at a time into bitmasks (one bit per
+ * byte) of quotes, parens and whitespace. The inside of strings is the
+ * prefix xor of the quotes, so the bits of parens and whitespace inside
+ * strings are masked out without looking at the bytes one by one.
+ * Tokens start at parens, at opening quotes and at the first byte of
+ * every run of other bytes (tags and numbers).
+ * Blocks that contain a comment go through the scalar scanner, which
+ * follows the rules of the lexer byte by byte.
+ */
+
+#define LSN_SI_BLOCK 64
+#define LSN_SI_INIT_CAP 1024
+
+// carried from one block to the next
+typedef struct _lsn_si_state_t
+{
+	uint64_t in_string; // all ones inside a string
+	uint64_t prev_atom; // 1 if the last byte was part of a tag or number
+} lsn_si_state_t;
+
+static void lsn_si_reserve(lsn_structural_t* out, size_t len)
+{
+	if (len <= out->cap)
+		return;
+	size_t cap = out->cap ? out->cap : LSN_SI_INIT_CAP;
+	while (cap < len)
+		cap *= 2;
+	out->offsets = (uint32_t*)realloc(out->offsets, cap * sizeof(uint32_t));
+	out->cap = cap;
+}
+
+static void lsn_si_emit(lsn_structural_t* out, uint32_t base, uint64_t bits)
+{
+	uint32_t* it = out->offsets + out->len;
+	out->len += (size_t)__builtin_popcountll(bits);
+	while (bits)
+	{
+		*it++ = base + (uint32_t)__builtin_ctzll(bits);
+		bits &= bits - 1;
+	}
+}
+
+/**
+ * Scans [pos, end) like the lexer would, a comment may carry on past end.
+ * Returns where the scan stopped.
+ */
+static size_t lsn_si_scalar(const char* src, size_t len, size_t pos, size_t end, lsn_si_state_t* state, lsn_structural_t* out)
+{
+	while (pos < end)
+	{
+		char c = src[pos];
+		if (state->in_string)
+		{
+			if (c == '\'')
+				state->in_string = 0;
+			pos++;
+			continue;
+		}
+		if (c == '(' && pos + 1 < len && src[pos + 1] == '*')
+		{
+			// the search starts at the star, so (*) is a whole comment
+			const char* it = src + pos + 1;
+			const char* stop = src + len;
+			while ((it = memchr(it, '*', (size_t)(stop - it))) && it + 1 < stop && it[1] != ')')
+				it++;
+			pos = it && it + 1 < stop ? (size_t)(it - src) + 2 : len;
+			state->prev_atom = 0;
+			continue;
+		}
+		if (c == '(' || c == ')' || c == '\'')
+		{
+			out->offsets[out->len++] = (uint32_t)pos;
+			state->in_string = c == '\'' ? ~0ull : 0;
+			state->prev_atom = 0;
+		}
+		else if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+			state->prev_atom = 0;
+		else
+		{
+			if (!state->prev_atom)
+				out->offsets[out->len++] = (uint32_t)pos;
+			state->prev_atom = 1;
+		}
+		pos++;
+	}
+	return pos;
+}
+
+/**
+ * The bitmasks of one block to the offsets of the tokens in it.
+ * Returns false if the block has a comment, which is left to the scalar
+ * scanner.
+ */
+static bool lsn_si_masks(uint32_t base, uint64_t quote, uint64_t lparen, uint64_t rparen, uint64_t star, uint64_t space, bool star_after, lsn_si_state_t* state, lsn_structural_t* out)
+{
+	// prefix xor: bit i is the parity of the quotes up to and including i
+	uint64_t inside = quote;
+	inside ^= inside << 1;
+	inside ^= inside << 2;
+	inside ^= inside << 4;
+	inside ^= inside << 8;
+	inside ^= inside << 16;
+	inside ^= inside << 32;
+	inside ^= state->in_string;
+
+	// a paren followed by a star outside strings
+	uint64_t comment = lparen & ((star >> 1) | ((uint64_t)star_after << 63)) & ~inside;
+	if (comment)
+		return false;
+
+	uint64_t atom = ~(quote | lparen | rparen | space | inside);
+	uint64_t starts = atom & ~((atom << 1) | state->prev_atom);
+	// inside includes the opening quote, not the closing one
+	uint64_t structural = ((lparen | rparen) & ~inside) | (quote & inside);
+	lsn_si_emit(out, base, structural | starts);
+
+	state->in_string = (uint64_t)0 - (inside >> 63);
+	state->prev_atom = atom >> 63;
+	return true;
+}
+
+#ifdef LSN_SI_X86
+static inline uint64_t lsn_si_eq16(__m128i a, __m128i b, __m128i c, __m128i d, char ch)
+{
+	__m128i v = _mm_set1_epi8(ch);
+	return (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, v))
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(b, v)) << 16
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(c, v)) << 32
+		| (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(d, v)) << 48;
+}
+
+static bool lsn_si_block_sse2(const char* block, uint32_t base, bool star_after, lsn_si_state_t* state, lsn_structural_t* out)
+{
+	__m128i a = _mm_loadu_si128((const __m128i*)block);
+	__m128i b = _mm_loadu_si128((const __m128i*)(block + 16));
+	__m128i c = _mm_loadu_si128((const __m128i*)(block + 32));
+	__m128i d = _mm_loadu_si128((const __m128i*)(block + 48));
+	uint64_t space = lsn_si_eq16(a, b, c, d, ' ') | lsn_si_eq16(a, b, c, d, '\t')
+		| lsn_si_eq16(a, b, c, d, '\n') | lsn_si_eq16(a, b, c, d, '\r');
+	return lsn_si_masks(base, lsn_si_eq16(a, b, c, d, '\''), lsn_si_eq16(a, b, c, d, '('),
+		lsn_si_eq16(a, b, c, d, ')'), lsn_si_eq16(a, b, c, d, '*'), space, star_after, state, out);
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t lsn_si_eq32(__m256i a, __m256i b, char ch)
+{
+	__m256i v = _mm256_set1_epi8(ch);
+	return (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, v))
+		| (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b, v)) << 32;
+}
+
+__attribute__((target("avx2")))
+static bool lsn_si_block_avx2(const char* block, uint32_t base, bool star_after, lsn_si_state_t* state, lsn_structural_t* out)
+{
+	__m256i a = _mm256_loadu_si256((const __m256i*)block);
+	__m256i b = _mm256_loadu_si256((const __m256i*)(block + 32));
+	uint64_t space = lsn_si_eq32(a, b, ' ') | lsn_si_eq32(a, b, '\t')
+		| lsn_si_eq32(a, b, '\n') | lsn_si_eq32(a, b, '\r');
+	return lsn_si_masks(base, lsn_si_eq32(a, b, '\''), lsn_si_eq32(a, b, '('),
+		lsn_si_eq32(a, b, ')'), lsn_si_eq32(a, b, '*'), space, star_after, state, out);
+}
+#endif
+
+typedef bool (*lsn_si_block_f)(const char*, uint32_t, bool, lsn_si_state_t*, lsn_structural_t*);
+
+static lsn_si_block_f lsn_si_pick(void)
+{
+#ifdef LSN_SI_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return lsn_si_block_avx2;
+	return lsn_si_block_sse2;
+#else
+	return NULL;
+#endif
+}
+
+// API --------------------------------------------------
+
+void lsn_structural_init(lsn_structural_t* out)
+{
+	out->offsets = NULL;
+	out->len = 0;
+	out->cap = 0;
+}
+
+void lsn_structural_delete(lsn_structural_t* out)
+{
+	if (!out)
+		return;
+	free(out->offsets);
+	lsn_structural_init(out);
+}
+
+bool lsn_structural_index(const char* src, size_t len, lsn_structural_t* out)
+{
+	if (!src || !out || len > UINT32_MAX)
+		return false;
+	out->len = 0;
+	lsn_si_state_t state = { 0, 0 };
+	lsn_si_block_f block = lsn_si_pick();
+	size_t pos = 0;
+	if (!block)
+	{
+		lsn_si_reserve(out, len);
+		lsn_si_scalar(src, len, 0, len, &state, out);
+		return true;
+	}
+
+	while (pos < len)
+	{
+		lsn_si_reserve(out, out->len + LSN_SI_BLOCK);
+		size_t rest = len - pos;
+		bool done;
+		if (rest >= LSN_SI_BLOCK)
+		{
+			bool star_after = rest > LSN_SI_BLOCK && src[pos + LSN_SI_BLOCK] == '*';
+			done = block(src + pos, (uint32_t)pos, star_after, &state, out);
+		}
+		else
+		{
+			// the tail is padded with spaces, which start no tokens
+			char tail[LSN_SI_BLOCK];
+			memset(tail, ' ', sizeof(tail));
+			memcpy(tail, src + pos, rest);
+			done = block(tail, (uint32_t)pos, false, &state, out);
+		}
+		size_t end = pos + (rest < LSN_SI_BLOCK ? rest : LSN_SI_BLOCK);
+		pos = done ? end : lsn_si_scalar(src, len, pos, end, &state, out);
+	}
+	return true;
+}
+
+uint32_t* lsn_structural_match(const char* src, const lsn_structural_t* index)
+{
+	size_t len = index->len;
+	uint32_t* match = (uint32_t*)malloc((len ? len : 1) * sizeof(uint32_t));
+	uint32_t* stack = (uint32_t*)malloc((len ? len : 1) * sizeof(uint32_t));
+	size_t top = 0;
+	bool res = true;
+	for (size_t i = 0; i < len && res; i++)
+	{
+		char c = src[index->offsets[i]];
+		if (c == '(')
+			stack[top++] = (uint32_t)i;
+		else if (c == ')')
+		{
+			res = top > 0;
+			if (res)
+				match[stack[--top]] = (uint32_t)i;
+		}
+	}
+	free(stack);
+	if (res && top == 0)
+		return match;
+	free(match);
+	return NULL;
+}
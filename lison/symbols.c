@@ -0,0 +1,174 @@
+#include "lsn.h"
+
+/**
+ * Symbol table for interned tags.
+ * Names are copied into an arena, so their pointers stay valid until the
+ * table is deleted, and are found by an open addressing hash of ids.
+ * Every name follows a pointer to its table, so interned tags know where
+ * their id belongs and two of them compare by id (see lsn_sym_table).
+ * Shared tables take their mutex on every operation.
+ */
+
+#define LSN_SYM_INIT_SLOTS 64
+
+uint32_t lsn_hash(const char* name, size_t len)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/**
+ * Slot of the name: holds its id + 1, or 0 if the name is not in the table.
+ */
+static uint32_t* lsn_sym_slot(const lsn_symtab_t* tab, const char* name, size_t len)
+{
+	uint32_t idx = lsn_hash(name, len) & tab->mask;
+	while (tab->slots[idx])
+	{
+		const lsn_symbol_t* sym = &tab->symbols[tab->slots[idx] - 1];
+		if (sym->len == len && memcmp(sym->name, name, len) == 0)
+			break;
+		idx = (idx + 1) & tab->mask;
+	}
+	return &tab->slots[idx];
+}
+
+static void lsn_sym_grow(lsn_symtab_t* tab)
+{
+	uint32_t slots_len = 2 * (tab->mask + 1);
+	free(tab->slots);
+	tab->slots = (uint32_t*)calloc(slots_len, sizeof(uint32_t));
+	tab->mask = slots_len - 1;
+	for (uint32_t id = 0; id < tab->len; id++)
+		*lsn_sym_slot(tab, tab->symbols[id].name, tab->symbols[id].len) = id + 1;
+}
+
+static void lsn_sym_lock(lsn_symtab_t* tab)
+{
+	if (tab->shared)
+		pthread_mutex_lock(&tab->lock);
+}
+
+static void lsn_sym_unlock(lsn_symtab_t* tab)
+{
+	if (tab->shared)
+		pthread_mutex_unlock(&tab->lock);
+}
+
+/**
+ * Id of the name, added if it is new. The caller holds the lock.
+ */
+static uint32_t lsn_sym_add(lsn_symtab_t* tab, const char* name, size_t len)
+{
+	uint32_t* slot = lsn_sym_slot(tab, name, len);
+	if (*slot)
+		return *slot - 1;
+
+	if (tab->len == tab->cap)
+	{
+		tab->cap = tab->cap ? 2 * tab->cap : LSN_SYM_INIT_SLOTS;
+		tab->symbols = (lsn_symbol_t*)realloc(tab->symbols, tab->cap * sizeof(lsn_symbol_t));
+	}
+	uint32_t id = tab->len++;
+	lsn_symtab_t** owner = (lsn_symtab_t**)lsn_ar_alloc(&tab->names, sizeof(lsn_symtab_t*) + len + 1);
+	*owner = tab;
+	char* copy = (char*)(owner + 1);
+	memcpy(copy, name, len);
+	copy[len] = 0;
+	tab->symbols[id] = (lsn_symbol_t) { .name = copy, .len = (uint32_t)len };
+	*slot = id + 1;
+	// at most half full
+	if (2 * tab->len > tab->mask + 1)
+		lsn_sym_grow(tab);
+	return id;
+}
+
+// API --------------------------------------------------
+
+void lsn_sym_init(lsn_symtab_t* tab, bool shared)
+{
+	lsn_ar_init(&tab->names, 0, 0);
+	tab->symbols = NULL;
+	tab->len = 0;
+	tab->cap = 0;
+	tab->slots = (uint32_t*)calloc(LSN_SYM_INIT_SLOTS, sizeof(uint32_t));
+	tab->mask = LSN_SYM_INIT_SLOTS - 1;
+	tab->shared = shared;
+	if (shared)
+		pthread_mutex_init(&tab->lock, NULL);
+}
+
+void lsn_sym_delete(lsn_symtab_t* tab)
+{
+	if (!tab)
+		return;
+	lsn_ar_delete(&tab->names);
+	free(tab->symbols);
+	free(tab->slots);
+	if (tab->shared)
+		pthread_mutex_destroy(&tab->lock);
+	tab->symbols = NULL;
+	tab->slots = NULL;
+	tab->len = 0;
+	tab->cap = 0;
+}
+
+uint32_t lsn_sym_intern(lsn_symtab_t* tab, const char* name, size_t len)
+{
+	lsn_sym_lock(tab);
+	uint32_t id = lsn_sym_add(tab, name, len);
+	lsn_sym_unlock(tab);
+	return id;
+}
+
+bool lsn_sym_find(lsn_symtab_t* tab, const char* name, size_t len, uint32_t* id)
+{
+	lsn_sym_lock(tab);
+	uint32_t slot = *lsn_sym_slot(tab, name, len);
+	lsn_sym_unlock(tab);
+	if (!slot)
+		return false;
+	if (id)
+		*id = slot - 1;
+	return true;
+}
+
+const char* lsn_sym_name(lsn_symtab_t* tab, uint32_t id)
+{
+	lsn_sym_lock(tab);
+	const char* name = id < tab->len ? tab->symbols[id].name : NULL;
+	lsn_sym_unlock(tab);
+	return name;
+}
+
+lsn_symtab_t* lsn_sym_table(const lison_t* tag)
+{
+	if (!tag || tag->tag != LSN_Tag || !(tag->flags & LSN_F_Interned))
+		return NULL;
+	return ((lsn_symtab_t* const*)tag->value.sym.name)[-1];
+}
+
+lison_t* lsn_ar_tag_sym(lsn_arena_t* arena, lsn_symtab_t* tab, const str_t* str)
+{
+	// one lock for the id and the name, the symbols array may be moved by others
+	lsn_sym_lock(tab);
+	uint32_t id = lsn_sym_add(tab, str->data, str->len);
+	const char* name = tab->symbols[id].name;
+	lsn_sym_unlock(tab);
+	lison_t* res = arena
+		? (lison_t*)lsn_ar_alloc(arena, sizeof(lison_t))
+		: (lison_t*)malloc(sizeof(lison_t));
+	res->tag = LSN_Tag;
+	res->flags = LSN_F_Interned | (arena ? LSN_F_Arena : 0);
+	// the name lives in the arena of the table, valid without the lock
+	res->value.sym.name = name;
+	res->value.sym.id = id;
+	res->value.sym.len = (uint32_t)str->len;
+	return res;
+}
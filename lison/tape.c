@@ -0,0 +1,248 @@
+#include "lsn.h"
+
+/**
+ * Flat representation of a document: the values in preorder, one 16 byte
+ * entry each. Objects store the number of their children and the index
+ * just past their last descendant, so a sibling is one step away and the
+ * children are the entries between the object and its end.
+ * Strings and tags are NUL terminated in a separate blob.
+ */
+
+#define LSN_TAPE_INIT_CAP 64
+
+static void lsn_tape_push(lsn_tape_t* tape, lsn_tape_entry_t entry)
+{
+	if (tape->len == tape->cap)
+	{
+		tape->cap = tape->cap ? 2 * tape->cap : LSN_TAPE_INIT_CAP;
+		tape->entries = (lsn_tape_entry_t*)realloc(tape->entries, tape->cap * sizeof(lsn_tape_entry_t));
+	}
+	tape->entries[tape->len++] = entry;
+}
+
+static uint64_t lsn_tape_push_str(lsn_tape_t* tape, const char* data, size_t len)
+{
+	if (tape->strings_len + len + 1 > tape->strings_cap)
+	{
+		size_t cap = tape->strings_cap ? 2 * tape->strings_cap : 256;
+		while (cap < tape->strings_len + len + 1)
+			cap *= 2;
+		tape->strings = (char*)realloc(tape->strings, cap);
+		tape->strings_cap = cap;
+	}
+	uint64_t offset = tape->strings_len;
+	memcpy(tape->strings + offset, data, len);
+	tape->strings[offset + len] = 0;
+	tape->strings_len += len + 1;
+	return offset;
+}
+
+static void lsn_tape_push_token(lsn_tape_t* tape, const lsn_token_t* tkn)
+{
+	lsn_tape_entry_t entry = { .len = 0 };
+	switch (tkn->tag)
+	{
+	case LSN_TKN_String:
+		entry.tag = LSN_String;
+		entry.len = (uint32_t)tkn->value.string.len;
+		entry.value.offset = lsn_tape_push_str(tape, tkn->value.string.data, tkn->value.string.len);
+		break;
+	case LSN_TKN_Tag:
+		entry.tag = LSN_Tag;
+		entry.len = (uint32_t)tkn->value.tag.len;
+		entry.value.offset = lsn_tape_push_str(tape, tkn->value.tag.data, tkn->value.tag.len);
+		break;
+	case LSN_TKN_Integer:
+		entry.tag = LSN_Integer;
+		entry.value.integer = tkn->value.integer;
+		break;
+	default:
+		entry.tag = LSN_Float;
+		entry.value.lsn_float = tkn->value.lsn_float;
+		break;
+	}
+	lsn_tape_push(tape, entry);
+}
+
+typedef struct _lsn_tape_frame_t
+{
+	lison_list_t list;
+	size_t end;
+} lsn_tape_frame_t;
+
+static lison_t* lsn_tape_atom(const lsn_tape_t* tape, const lsn_tape_entry_t* entry)
+{
+	switch (entry->tag)
+	{
+	case LSN_String:
+	case LSN_Tag:
+	{
+		str_t str = { .data = tape->strings + entry->value.offset, .len = entry->len };
+		return entry->tag == LSN_String ? lsn_string_str(&str) : lsn_tag_str(&str);
+	}
+	case LSN_Integer:
+		return lsn_integer(entry->value.integer);
+	case LSN_Float:
+		return lsn_float(entry->value.lsn_float);
+	default:
+		return NULL;
+	}
+}
+
+// API --------------------------------------------------
+
+void lsn_tape_init(lsn_tape_t* tape)
+{
+	tape->entries = NULL;
+	tape->len = 0;
+	tape->cap = 0;
+	tape->strings = NULL;
+	tape->strings_len = 0;
+	tape->strings_cap = 0;
+}
+
+void lsn_tape_delete(lsn_tape_t* tape)
+{
+	if (!tape)
+		return;
+	free(tape->entries);
+	free(tape->strings);
+	lsn_tape_init(tape);
+}
+
+bool lsn_tape_compile(char* src, lsn_tape_t* tape, const lsn_options_t* opt)
+{
+	size_t max_depth = opt && opt->max_depth ? opt->max_depth : LSN_MAX_DEPTH;
+	size_t len = strlen(src);
+	lsn_tape_init(tape);
+	// about one value per 8 bytes of source
+	tape->cap = len / 8 + LSN_TAPE_INIT_CAP;
+	tape->entries = (lsn_tape_entry_t*)malloc(tape->cap * sizeof(lsn_tape_entry_t));
+
+	// indices of the open objects
+	size_t local[LSN_LOCAL_DEPTH];
+	size_t* stack = local;
+	size_t stack_cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, len);
+	lsn_token_t tkn;
+	bool done = false;
+	bool ok = false;
+	while (true)
+	{
+		lsn_token_tag_t tag = lsn_lex_next(&lex, &tkn);
+		if (tag == LSN_TKN_EOF)
+		{
+			ok = done;
+			break;
+		}
+		// a single value at the top
+		if (done || tag == LSN_TKN_Error || (tag == LSN_TKN_RParen && top == 0))
+			break;
+		if (top > 0 && tag != LSN_TKN_RParen)
+			tape->entries[stack[top - 1]].len++;
+
+		if (tag == LSN_TKN_LParen)
+		{
+			if (top >= max_depth)
+			{
+				LOG("[LSN TAPE] Nesting deeper than %zu\n", max_depth);
+				break;
+			}
+			if (top == stack_cap)
+			{
+				size_t* grown = (size_t*)malloc(2 * stack_cap * sizeof(size_t));
+				memcpy(grown, stack, top * sizeof(size_t));
+				if (stack != local)
+					free(stack);
+				stack = grown;
+				stack_cap *= 2;
+			}
+			stack[top++] = tape->len;
+			lsn_tape_push(tape, (lsn_tape_entry_t) { .tag = LSN_Object, .len = 0 });
+		}
+		else if (tag == LSN_TKN_RParen)
+		{
+			tape->entries[stack[--top]].value.end = tape->len;
+			done = top == 0;
+		}
+		else
+		{
+			lsn_tape_push_token(tape, &tkn);
+			done = top == 0;
+		}
+	}
+
+	if (stack != local)
+		free(stack);
+	if (!ok)
+		lsn_tape_delete(tape);
+	return ok;
+}
+
+size_t lsn_tape_next(const lsn_tape_t* tape, size_t idx)
+{
+	const lsn_tape_entry_t* entry = &tape->entries[idx];
+	return entry->tag == LSN_Object ? (size_t)entry->value.end : idx + 1;
+}
+
+const char* lsn_tape_str(const lsn_tape_t* tape, size_t idx)
+{
+	const lsn_tape_entry_t* entry = &tape->entries[idx];
+	if (entry->tag != LSN_String && entry->tag != LSN_Tag)
+		return NULL;
+	return tape->strings + entry->value.offset;
+}
+
+lison_t* lsn_tape_to_lison(const lsn_tape_t* tape, size_t idx)
+{
+	if (!tape || idx >= tape->len)
+		return NULL;
+	if (tape->entries[idx].tag != LSN_Object)
+		return lsn_tape_atom(tape, &tape->entries[idx]);
+
+	// the objects still open, each with the index just past it
+	lsn_tape_frame_t local[LSN_LOCAL_DEPTH];
+	lsn_tape_frame_t* stack = local;
+	size_t cap = LSN_LOCAL_DEPTH;
+	size_t top = 0;
+	lison_t* res = NULL;
+	size_t end = tape->entries[idx].value.end;
+	for (size_t it = idx; it <= end; it++)
+	{
+		// close the objects that end here
+		while (top > 0 && stack[top - 1].end == it)
+		{
+			lison_t* object = lsn_object(stack[--top].list);
+			if (top == 0)
+				res = object;
+			else
+				lsn_lst_append(&stack[top - 1].list, object);
+		}
+		if (it == end)
+			break;
+		const lsn_tape_entry_t* entry = &tape->entries[it];
+		if (entry->tag != LSN_Object)
+		{
+			lsn_lst_append(&stack[top - 1].list, lsn_tape_atom(tape, entry));
+			continue;
+		}
+		if (top == cap)
+		{
+			lsn_tape_frame_t* grown = (lsn_tape_frame_t*)malloc(2 * cap * sizeof(lsn_tape_frame_t));
+			memcpy(grown, stack, top * sizeof(lsn_tape_frame_t));
+			if (stack != local)
+				free(stack);
+			stack = grown;
+			cap *= 2;
+		}
+		lsn_lst_init(&stack[top].list);
+		stack[top++].end = entry->value.end;
+	}
+
+	if (stack != local)
+		free(stack);
+	return res;
+}
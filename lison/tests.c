@@ -2,6 +2,8 @@
 #include <rgx.h>
 
 #include <unitest.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 // #define PRINT
 
@@ -126,7 +128,7 @@ int test_strnum(void)
 
 int test_tokenizer(void)
 {
-	lsn_token_stream_t stream = { .head = NULL, .tail = NULL };
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
 	lsn_ts_init(&stream);
 	lsn_tokenize("(:height 165.5 :age 22 :name 'John')", &stream);
 #ifdef PRINT
@@ -138,7 +140,7 @@ int test_tokenizer(void)
 
 int test_comment(void)
 {
-	lsn_token_stream_t stream = { .head = NULL, .tail = NULL };
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
 	lsn_ts_init(&stream);
 	// same as before, but age is commented out
 	lsn_tokenize("(:height 165.5 (* :age 22 *) :name 'John')", &stream);
@@ -149,13 +151,47 @@ int test_comment(void)
 	return 0;
 }
 
+int test_lexer(void)
+{
+	char* src = "(*) )(* x *)(:ab-c 'x y' (*) 12 3.25 (* open";
+	lsn_token_tag_t expected[] = {
+		LSN_TKN_RParen, LSN_TKN_LParen, LSN_TKN_Tag, LSN_TKN_String,
+		LSN_TKN_Integer, LSN_TKN_Float, LSN_TKN_EOF,
+	};
+	lsn_lexer_t lex;
+	lsn_lex_init(&lex, src, strlen(src));
+	lsn_token_t tkn;
+	int res = 0;
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+	{
+		if (lsn_lex_next(&lex, &tkn) != expected[i])
+			return 1;
+		if (tkn.tag == LSN_TKN_Tag)
+			res += tkn.value.tag.len != 4 || strncmp(tkn.value.tag.data, "ab-c", 4);
+		if (tkn.tag == LSN_TKN_String)
+			res += tkn.value.string.len != 3 || strncmp(tkn.value.string.data, "x y", 3);
+		if (tkn.tag == LSN_TKN_Integer)
+			res += tkn.value.integer != 12;
+		if (tkn.tag == LSN_TKN_Float)
+			res += tkn.value.lsn_float != 3.25f;
+	}
+
+	// tags stop at parens, unknown input is an error
+	lsn_lex_init(&lex, ":a) hello", 9);
+	res += lsn_lex_next(&lex, &tkn) != LSN_TKN_Tag || tkn.value.tag.len != 1;
+	res += lsn_lex_next(&lex, &tkn) != LSN_TKN_RParen;
+	res += lsn_lex_next(&lex, &tkn) != LSN_TKN_Error;
+	res += lsn_compile("(:a 1) hello") != NULL;
+	return res;
+}
+
 int test_parse(void)
 {
-	lsn_token_stream_t stream = { .head = NULL, .tail = NULL };
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
 	lsn_ts_init(&stream);
 	lsn_tokenize("(:name 'Jacob Gipsz' (*animals are optional*) :animals ())", &stream);
-	lsn_parse_res_t res = lsn_p_object(stream.head);
-	int test = res.stream->value.tag == LSN_TKN_EOF ? 0 : 1;
+	lsn_parse_res_t res = lsn_p_object(stream.tokens);
+	int test = res.stream->tag == LSN_TKN_EOF ? 0 : 1;
 #ifdef PRINT
 	lsn_ts_print(&stream);
 	lsn_print(res.lison);
@@ -168,11 +204,11 @@ int test_parse(void)
 
 int test_complex(void)
 {
-	lsn_token_stream_t stream = { .head = NULL, .tail = NULL };
+	lsn_token_stream_t stream = { .tokens = NULL, .len = 0, .cap = 0 };
 	lsn_ts_init(&stream);
 	lsn_tokenize("(:persons  ( (* First Person *) (:name 'John' (* comments can be anywhere *) :age 22 :height 165) (* Someone Else *) (:name 'Andrew Sharp' :age 27 :height 195 :workplaces  ((:name 'University of Pannonia')))))", &stream);
-	lsn_parse_res_t res = lsn_p_object(stream.head);
-	int test = res.stream->value.tag == LSN_TKN_EOF ? 0 : 1;
+	lsn_parse_res_t res = lsn_p_object(stream.tokens);
+	int test = res.stream->tag == LSN_TKN_EOF ? 0 : 1;
 #ifdef PRINT
 	lsn_ts_print(&stream);
 	lsn_print(res.lison);
@@ -194,6 +230,817 @@ int test_compile(void)
 	return res;
 }
 
+static char* nested(size_t depth)
+{
+	char* src = (char*)malloc(2 * depth + 1);
+	memset(src, '(', depth);
+	memset(src + depth, ')', depth);
+	src[2 * depth] = 0;
+	return src;
+}
+
+int test_depth(void)
+{
+	// deeper than the default limit, no stack overflow
+	char* src = nested(100000);
+	lison_t* lison = lsn_compile(src);
+	int res = lison != NULL;
+	free(src);
+
+	src = nested(LSN_MAX_DEPTH);
+	lison = lsn_compile(src);
+	res += lison == NULL;
+	lsn_delete(&lison);
+	free(src);
+
+	// a deep tree allowed by max_depth is copied and freed without recursion
+	src = nested(1000000);
+	lsn_options_t deep = { .max_depth = 1000000 };
+	lison = lsn_compile_opt(src, &deep);
+	lison_t* copy = lsn_detach(lison);
+	res += lison == NULL || copy == NULL;
+	lsn_delete(&lison);
+	lsn_delete(&copy);
+	free(src);
+
+	lsn_options_t opt = { .max_depth = 2 };
+	lison = lsn_compile_opt("(:a (:b) ())", &opt);
+	res += lison == NULL;
+	lsn_delete(&lison);
+	lison = lsn_compile_opt("(:a (:b ()))", &opt);
+	res += lison != NULL;
+	return res;
+}
+
+int test_arena(void)
+{
+	lsn_arena_t arena;
+	lsn_ar_init(&arena, 0, 0);
+	int res = 0;
+	// allocations larger than a block get their own
+	char* big = (char*)lsn_ar_alloc(&arena, 3 * LSN_AR_MIN_BLOCK);
+	memset(big, 1, 3 * LSN_AR_MIN_BLOCK);
+	for (size_t i = 0; i < 10000; i++)
+	{
+		void* ptr = lsn_ar_alloc(&arena, 1 + i % 40);
+		res += (uintptr_t)ptr % 8 != 0;
+	}
+	lsn_ar_reset(&arena);
+	res += arena.head == NULL || arena.head->next != NULL || arena.head->used != 0;
+	lsn_ar_delete(&arena);
+
+	lsn_options_t opt = { .flags = LSN_OPT_HugePages };
+	lsn_doc_t* doc = lsn_compile_doc("(:name 'John' :height 165.4 :cars (1 2))", &opt);
+	res += !doc || doc->root->tag != LSN_Object || !(doc->root->flags & LSN_F_Arena);
+	if (doc)
+	{
+		lison_t* name = doc->root->value.object.head->next->value;
+		res += strcmp(name->value.string, "John") != 0;
+		// no-op on arena objects
+		lsn_delete(&name);
+	}
+	lsn_doc_delete(&doc);
+	res += doc != NULL;
+	res += lsn_compile_doc("(:name 'John'", NULL) != NULL;
+	return res;
+}
+
+int test_tape(void)
+{
+	lsn_tape_t tape;
+	int res = 0;
+	if (!lsn_tape_compile("(:name 'John' (* skipped *) :cars (1 2.5 ()) :age 22)", &tape, NULL))
+		return 1;
+	// (, :name, 'John', :cars, (, 1, 2.5, (, :age, 22
+	res += tape.len != 10;
+	res += tape.entries[0].len != 6 || tape.entries[0].value.end != 10;
+	res += strcmp(lsn_tape_str(&tape, 2), "John") != 0;
+	// the list of cars is skipped in one step
+	res += lsn_tape_next(&tape, 4) != 8;
+	res += tape.entries[4].len != 3 || tape.entries[7].len != 0;
+	res += tape.entries[9].value.integer != 22;
+
+	lison_t* lison = lsn_tape_to_lison(&tape, 4);
+	res += !lison || lison->value.object.head->next->value->value.lsn_float != 2.5f;
+	lsn_delete(&lison);
+	lsn_tape_delete(&tape);
+
+	res += lsn_tape_compile("(:a (1)", &tape, NULL);
+	res += lsn_tape_compile("(:a) 1", &tape, NULL);
+	res += !lsn_tape_compile("42", &tape, NULL) || tape.entries[0].value.integer != 42;
+	lsn_tape_delete(&tape);
+
+	// a deep tape comes back as a tree without recursion
+	char* src = nested(1000000);
+	lsn_options_t deep = { .max_depth = 1000000 };
+	res += !lsn_tape_compile(src, &tape, &deep);
+	lison = lsn_tape_to_lison(&tape, 0);
+	lison_t* inner = lison;
+	for (size_t i = 1; inner && i < 1000000; i++)
+		inner = inner->value.object.head ? inner->value.object.head->value : NULL;
+	res += !inner || inner->value.object.head != NULL;
+	lsn_delete(&lison);
+	lsn_tape_delete(&tape);
+	free(src);
+	return res;
+}
+
+int test_zero_copy(void)
+{
+	char src[] = "(:name 'John Doe' :age 22)";
+	lsn_options_t opt = { .flags = LSN_OPT_ZeroCopy };
+	lison_t* lison = lsn_compile_opt(src, &opt);
+	if (!lison)
+		return 1;
+	lison_t* name = lison->value.object.head->next->value;
+	str_t str = lsn_str(name);
+	int res = !(name->flags & LSN_F_Borrowed) || str.data != src + 8 || str.len != 8;
+
+	lsn_doc_t* doc = lsn_compile_doc(src, &opt);
+	lison_t* copy = lsn_detach(doc->root);
+	lsn_doc_delete(&doc);
+	// the copy survives the source
+	memset(src, 0, sizeof(src));
+	name = copy->value.object.head->next->value;
+	res += (name->flags & LSN_F_Borrowed) || strcmp(name->value.string, "John Doe") != 0;
+	res += strcmp(copy->value.object.head->value->value.tag, "name") != 0;
+
+	lsn_delete(&copy);
+	lsn_delete(&lison);
+	return res;
+}
+
+int test_interned(void)
+{
+	lsn_symtab_t tab;
+	lsn_sym_init(&tab, true);
+	lsn_options_t opt = { .symbols = &tab };
+	lison_t* lison = lsn_compile_opt("((:name 'a' :age 1) (:name 'b' :age 2))", &opt);
+	if (!lison)
+		return 1;
+	lison_t* first = lison->value.object.head->value->value.object.head->value;
+	lison_t* second = lison->value.object.head->next->value->value.object.head->value;
+	int res = !(first->flags & LSN_F_Interned) || first->value.sym.id != second->value.sym.id;
+	res += first->value.sym.name != second->value.sym.name || strcmp(first->value.tag, "name") != 0;
+	uint32_t id;
+	res += !lsn_sym_find(&tab, "age", 3, &id) || strcmp(lsn_sym_name(&tab, id), "age") != 0;
+	res += lsn_sym_find(&tab, "height", 6, NULL) || tab.len != 2;
+	res += lsn_sym_table(first) != &tab || lsn_sym_table(lsn_get(lison->value.object.head->value, "name")) != NULL;
+
+	// lookups by id, and by a key resolved in the table of the records
+	lison_t* record = lison->value.object.head->next->value;
+	res += lsn_get_sym(record, &tab, id)->value.integer != 2;
+	res += lsn_get_sym(record, &tab, 99) != NULL;
+	lsn_key_t key;
+	lsn_key_init(&key, "age", 3);
+	res += lsn_key_get(lison->value.object.head->value, &key)->value.integer != 1;
+	res += lsn_sym_table(&key.tag) != &tab || key.tag.value.sym.id != id;
+	res += lsn_key_get(record, &key)->value.integer != 2;
+	lsn_delete(&lison);
+
+	// the same names in another table, under other ids, or not interned
+	// are found by name
+	lsn_symtab_t other;
+	lsn_sym_init(&other, false);
+	lsn_options_t other_opt = { .symbols = &other };
+	lison = lsn_compile_opt("(:age 3 :pad 0 :k1 1 :k2 2 :k3 3 :k4 4 :k5 5 :k6 6 :k7 7 :k8 8)", &other_opt);
+	res += !lison || lsn_get_sym(lison, &tab, id)->value.integer != 3;
+	res += lsn_key_get(lison, &key)->value.integer != 3;
+	lsn_delete(&lison);
+	lison = lsn_compile("(:age 4)");
+	res += !lison || lsn_get_sym(lison, &tab, id)->value.integer != 4;
+	res += lsn_key_get(lison, &key)->value.integer != 4;
+	lsn_delete(&lison);
+	lsn_sym_delete(&other);
+
+	// grows past the initial slots
+	char name[16];
+	for (int i = 0; i < 1000; i++)
+		res += lsn_sym_intern(&tab, name, (size_t)sprintf(name, "t%d", i)) != (uint32_t)i + 2;
+	res += lsn_sym_intern(&tab, "t500", 4) != 502;
+	lsn_sym_delete(&tab);
+
+	// own table of the document
+	opt = (lsn_options_t) { .flags = LSN_OPT_Intern };
+	lsn_doc_t* doc = lsn_compile_doc("(:x :y :x)", &opt);
+	res += !doc || doc->symbols->len != 2;
+	lsn_doc_delete(&doc);
+	return res;
+}
+
+int test_lookup(void)
+{
+	char* src = "(:name 'John' :height 165.4 :address (:city 'New York' :house 10) :last)";
+	lison_t* lison = lsn_compile(src);
+	int res = !lison;
+	res += strcmp(lsn_get(lison, "name")->value.string, "John") != 0;
+	res += lsn_get_path(lison, "address", "house", NULL)->value.integer != 10;
+	res += lsn_get(lison, "last") != NULL || lsn_get(lison, "age") != NULL;
+	res += lsn_get_path(lison, "name", "city", NULL) != NULL;
+	res += LSN_LST_INDEX(&lison->value.object) != NULL;
+	lsn_delete(&lison);
+	// the index is not in the value nodes
+	res += sizeof(lison_t) > 3 * sizeof(void*);
+
+	// tags that are values are not keys
+	lison = lsn_compile("(:a :b :b 1)");
+	res += !lison || lsn_get(lison, "b")->tag != LSN_Integer;
+	lsn_delete(&lison);
+
+	// long enough for an index, in both kinds of documents
+	char big[4096];
+	size_t len = (size_t)sprintf(big, "(");
+	for (int i = 0; i < 100; i++)
+		len += (size_t)sprintf(big + len, ":k%d %d ", i, i);
+	sprintf(big + len, ":v :k100 :k7 1000)");
+	lsn_options_t opt = { .flags = LSN_OPT_Index | LSN_OPT_Intern };
+	lsn_doc_t* doc = lsn_compile_doc(big, &opt);
+	lison = lsn_compile(big);
+	for (int i = 0; i < 100; i++)
+	{
+		char key[8];
+		sprintf(key, "k%d", i);
+		res += lsn_get(lison, key)->value.integer != i;
+		res += lsn_get(doc->root, key)->value.integer != i;
+	}
+	res += LSN_LST_INDEX(&lison->value.object) == NULL || LSN_LST_INDEX(&doc->root->value.object) == NULL;
+	res += lsn_get(lison, "k100") != NULL || lsn_get(doc->root, "k100") != NULL;
+
+	// appending drops the index
+	lison_t* tag = lsn_tag("extra");
+	lsn_lst_append(&lison->value.object, tag);
+	lsn_lst_append(&lison->value.object, lsn_integer(5));
+	res += LSN_LST_INDEX(&lison->value.object) != NULL || lsn_get(lison, "extra")->value.integer != 5;
+
+	lsn_delete(&lison);
+	lsn_doc_delete(&doc);
+	return res;
+}
+
+int test_binary(void)
+{
+	char* src = "(:name 'John' :age -22 :height 165.4 :cars (:name 'a' () 7) :empty ())";
+	lison_t* lison = lsn_compile(src);
+	lsn_buffer_t buf = { NULL, 0, 0 };
+	int res = !lsn_encode_binary(lison, &buf);
+
+	// the tags of repeated records are stored once
+	char records[2048];
+	size_t len = (size_t)sprintf(records, "(");
+	for (int i = 0; i < 20; i++)
+		len += (size_t)sprintf(records + len, "(:name 'Person' :height %d.5 :workplace 'x')", 150 + i);
+	sprintf(records + len, ")");
+	lison_t* many = lsn_compile(records);
+	lsn_buffer_t small = { NULL, 0, 0 };
+	lsn_encode_binary(many, &small);
+	res += small.len >= len * 2 / 3;
+	lsn_buffer_delete(&small);
+	lsn_delete(&many);
+
+	lison_t* decoded = lsn_decode_binary(buf.data, buf.len);
+	lsn_options_t opt = { .flags = LSN_OPT_Intern };
+	lsn_doc_t* doc = lsn_decode_binary_doc(buf.data, buf.len, &opt);
+	res += !decoded || !doc;
+	if (!res)
+	{
+		res += lsn_get(decoded, "age")->value.integer != -22;
+		res += lsn_get(doc->root, "height")->value.lsn_float != 165.4f;
+		res += strcmp(lsn_get_path(doc->root, "cars", "name", NULL)->value.string, "a") != 0;
+		res += lsn_get(decoded, "empty")->value.object.head != NULL;
+		res += doc->symbols->len != 5;
+
+		// encoding the decoded tree gives the same bytes
+		lsn_buffer_t again = { NULL, 0, 0 };
+		lsn_encode_binary(doc->root, &again);
+		res += again.len != buf.len || memcmp(again.data, buf.data, buf.len) != 0;
+		lsn_buffer_delete(&again);
+	}
+
+	// every truncation fails cleanly
+	for (len = 0; len < buf.len; len++)
+		res += lsn_decode_binary(buf.data, len) != NULL;
+	buf.data[5] = 100;
+	res += lsn_decode_binary(buf.data, buf.len) != NULL;
+
+	lsn_buffer_delete(&buf);
+	lsn_doc_delete(&doc);
+	lsn_delete(&decoded);
+	lsn_delete(&lison);
+	return res;
+}
+
+int test_lazy(void)
+{
+	char* src = "(* header *) (:name 'John (x' :age 22 :cars ((:name 'a') (:name 'b' (* ) *) :seats 4)) :bad (1 2 !)) \n";
+	char path[] = "/tmp/lsn_lazy_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	int res = write(fd, src, strlen(src)) != (ssize_t)strlen(src);
+	close(fd);
+
+	lsn_lazy_t* lazy = lsn_open_lazy(path);
+	res += !lazy;
+	if (!res)
+	{
+		lsn_lazy_node_t* root = lsn_lazy_root(lazy);
+		res += lsn_lazy_len(lazy, root) != 8;
+		res += strcmp(lsn_lazy_value(lazy, lsn_lazy_get(lazy, root, "name"))->value.string, "John (x") != 0;
+		res += lsn_lazy_value(lazy, lsn_lazy_get(lazy, root, "age"))->value.integer != 22;
+
+		lsn_lazy_node_t* cars = lsn_lazy_get(lazy, root, "cars");
+		lsn_lazy_node_t* second = lsn_lazy_child(lazy, cars, 1);
+		res += lsn_lazy_value(lazy, lsn_lazy_get(lazy, second, "seats"))->value.integer != 4;
+		// the first car was never looked at
+		res += lsn_lazy_child(lazy, cars, 0)->children != NULL;
+		res += lsn_lazy_child(lazy, cars, 2) != NULL;
+
+		// errors stay inside the value
+		lsn_lazy_node_t* bad = lsn_lazy_get(lazy, root, "bad");
+		res += lsn_lazy_len(lazy, bad) != 0 || lsn_lazy_value(lazy, bad) != NULL;
+		lison_t* all = lsn_lazy_value(lazy, cars);
+		res += !all || strcmp(lsn_get(all->value.object.head->value, "name")->value.string, "a") != 0;
+	}
+	lsn_close_lazy(&lazy);
+
+	// one value only
+	fd = open(path, O_WRONLY | O_TRUNC);
+	res += write(fd, "(1) (2)", 7) != 7;
+	close(fd);
+	res += lsn_open_lazy(path) != NULL;
+	remove(path);
+	return res;
+}
+
+int test_structural(void)
+{
+	char* src = "(:a 'x (y' 1-2 (* ( ' *) ())";
+	uint32_t expected[] = { 0, 1, 4, 11, 25, 26, 27 };
+	lsn_structural_t index;
+	lsn_structural_init(&index);
+	int res = !lsn_structural_index(src, strlen(src), &index);
+	res += index.len != sizeof(expected) / sizeof(expected[0]);
+	for (size_t i = 0; !res && i < index.len; i++)
+		res += index.offsets[i] != expected[i];
+
+	// blocks of 64 bytes with strings and comments across their borders
+	char big[1024];
+	size_t len = (size_t)sprintf(big, "(");
+	for (int i = 0; i < 12; i++)
+		len += (size_t)sprintf(big + len, "(:name 'Person %d (x)' (* comment %d ' *) :height %d.5 -%d)", i, i, 150 + i, i);
+	sprintf(big + len, ")");
+	lsn_token_stream_t plain = { .tokens = NULL, .len = 0, .cap = 0 };
+	lsn_token_stream_t indexed = { .tokens = NULL, .len = 0, .cap = 0 };
+	lsn_ts_init(&plain);
+	lsn_ts_init(&indexed);
+	res += !lsn_tokenize(big, &plain);
+	res += !lsn_structural_index(big, strlen(big), &index);
+	res += !lsn_tokenize_structural(big, strlen(big), &index, &indexed);
+	res += plain.len != indexed.len;
+	for (size_t i = 0; !res && i < plain.len; i++)
+		res += plain.tokens[i].tag != indexed.tokens[i].tag;
+
+	lsn_ts_delete(&plain);
+	lsn_ts_delete(&indexed);
+	lsn_structural_delete(&index);
+	return res;
+}
+
+int test_parallel(void)
+{
+	size_t cap = 256 << 10;
+	char* src = (char*)malloc(cap);
+	size_t len = (size_t)sprintf(src, "(:version 1 :persons (");
+	int count = 0;
+	while (len < cap - 256)
+		len += (size_t)sprintf(src + len, "(:name 'Person %d' :height %d.5 :tags (:a :b)) ", count, 150 + count % 50), count++;
+	sprintf(src + len, ") :count %d)", count);
+
+	lsn_options_t opt = { .flags = LSN_OPT_Intern };
+	lsn_doc_t* doc = lsn_compile_parallel(src, 4, &opt);
+	int res = !doc;
+	if (!res)
+	{
+		res += lsn_get(doc->root, "count")->value.integer != count;
+		// every record is there, in order
+		int i = 0;
+		for (lison_node_t* it = lsn_get(doc->root, "persons")->value.object.head; it; it = it->next, i++)
+			res += lsn_get(it->value, "height")->value.lsn_float != (float)(150 + i % 50) + 0.5f;
+		res += i != count;
+		res += doc->symbols->len != 8;
+	}
+	lsn_doc_delete(&doc);
+
+	// errors in any range fail the whole document
+	src[len / 2] = '"';
+	res += lsn_compile_parallel(src, 4, NULL) != NULL;
+	src[len / 2] = ' ';
+	src[len] = 0;
+	res += lsn_compile_parallel(src, 4, NULL) != NULL;
+	free(src);
+	return res;
+}
+
+int test_docs(void)
+{
+	char src[8192];
+	size_t len = 0;
+	for (int i = 0; i < 100; i++)
+		len += (size_t)sprintf(src + len, "(:id %d :name 'Record %d') (* %d *)\n", i, i, i);
+	len += (size_t)sprintf(src + len, "42 ");
+
+	// one by one, then the same in batches
+	int res = 0;
+	for (int mode = 0; mode < 2; mode++)
+	{
+		lsn_docs_t docs;
+		lsn_docs_init(&docs, src, len, NULL);
+		if (mode)
+			res += !lsn_docs_parallel(&docs, 3, 7);
+		int count = 0;
+		lison_t* doc;
+		while ((doc = lsn_docs_next(&docs)))
+		{
+			if (count < 100)
+				res += lsn_get(doc, "id")->value.integer != count;
+			else
+				res += doc->value.integer != 42;
+			count++;
+			lsn_delete(&doc);
+		}
+		res += count != 101 || docs.failed;
+		lsn_docs_close(&docs);
+	}
+
+	// the iteration stops at an invalid document, after the valid ones
+	src[len / 2] = '"';
+	for (int mode = 0; mode < 2; mode++)
+	{
+		lsn_docs_t docs;
+		lsn_docs_init(&docs, src, len, NULL);
+		if (mode)
+			res += !lsn_docs_parallel(&docs, 2, 5);
+		int count = 0;
+		lison_t* doc;
+		while ((doc = lsn_docs_next(&docs)))
+		{
+			res += lsn_get(doc, "id")->value.integer != count++;
+			lsn_delete(&doc);
+		}
+		res += !docs.failed || count < 40 || count > 60;
+		lsn_docs_close(&docs);
+	}
+
+	// closed while the workers are still compiling
+	src[len / 2] = ' ';
+	for (size_t threads = 1; threads <= 4; threads++)
+	{
+		lsn_docs_t docs;
+		lsn_docs_init(&docs, src, len, NULL);
+		res += !lsn_docs_parallel(&docs, threads, 1);
+		for (int i = 0; i < 3; i++)
+		{
+			lison_t* doc = lsn_docs_next(&docs);
+			res += !doc || lsn_get(doc, "id")->value.integer != i;
+			lsn_delete(&doc);
+		}
+		lsn_docs_close(&docs);
+	}
+	return res;
+}
+
+int test_reader(void)
+{
+	char* src = "(:name 'John' (* c *) :cars ((:seats 4) (:seats 2)) :height 165.5)";
+	lsn_event_tag_t expected[] = {
+		LSN_EV_ObjectStart, LSN_EV_Tag, LSN_EV_String, LSN_EV_Tag, LSN_EV_ObjectStart,
+		LSN_EV_ObjectStart, LSN_EV_Tag, LSN_EV_Integer, LSN_EV_ObjectEnd,
+		LSN_EV_ObjectStart, LSN_EV_Tag, LSN_EV_Integer, LSN_EV_ObjectEnd, LSN_EV_ObjectEnd,
+		LSN_EV_Tag, LSN_EV_Float, LSN_EV_ObjectEnd, LSN_EV_End, LSN_EV_End,
+	};
+	lsn_reader_t reader;
+	lsn_reader_init(&reader, src, strlen(src), NULL);
+	int res = 0;
+	int seats = 0;
+	for (size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); i++)
+	{
+		res += lsn_next(&reader) != expected[i];
+		if (reader.event.tag == LSN_EV_Integer && reader.event.depth == 3)
+			seats += reader.event.value.integer;
+	}
+	res += seats != 6;
+
+	// skipping the cars
+	lsn_reader_init(&reader, src, strlen(src), NULL);
+	for (int i = 0; i < 5; i++)
+		lsn_next(&reader);
+	res += lsn_reader_skip(&reader) != LSN_EV_ObjectEnd || reader.depth != 1;
+	res += lsn_next(&reader) != LSN_EV_Tag || strncmp(reader.event.value.tag.data, "height", reader.event.value.tag.len) != 0;
+
+	char* invalid[] = { "(1 2", "(1))", "(1) 2", "", "(1 x)" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+	{
+		lsn_reader_init(&reader, invalid[i], strlen(invalid[i]), NULL);
+		lsn_event_tag_t tag;
+		while ((tag = lsn_next(&reader)) != LSN_EV_End && tag != LSN_EV_Error)
+			;
+		res += tag != LSN_EV_Error;
+	}
+
+	lsn_options_t opt = { .max_depth = 2 };
+	lsn_reader_init(&reader, "(((1)))", 7, &opt);
+	res += lsn_next(&reader) != LSN_EV_ObjectStart || lsn_next(&reader) != LSN_EV_ObjectStart;
+	res += lsn_next(&reader) != LSN_EV_Error;
+	return res;
+}
+
+static void test_push_count(const lsn_event_t* ev, void* user)
+{
+	if (ev->tag == LSN_EV_String)
+		*(size_t*)user += ev->value.string.len;
+}
+
+int test_push(void)
+{
+	char* src = "(* start *) (:name 'John Doe' :age -22 (*)(**) :height 165.25 :cars ((:seats 4) (:seats 12)) (*end*))";
+	size_t len = strlen(src);
+	int res = 0;
+	// every chunk size splits tokens, strings and comments somewhere
+	for (size_t chunk = 1; chunk <= len; chunk++)
+	{
+		lsn_push_t push;
+		lsn_push_init(&push, NULL, NULL, NULL);
+		for (size_t i = 0; i < len; i += chunk)
+			res += !lsn_push_feed(&push, src + i, i + chunk < len ? chunk : len - i);
+		lison_t* root = NULL;
+		res += !lsn_push_finish(&push, &root);
+		res += !root || strcmp(lsn_get(root, "name")->value.string, "John Doe") != 0;
+		res += !root || lsn_get(root, "age")->value.integer != -22;
+		res += !root || lsn_get(root, "height")->value.lsn_float != 165.25f;
+		res += !root || lsn_get(lsn_get(root, "cars")->value.object.tail->value, "seats")->value.integer != 12;
+		lsn_delete(&root);
+
+		size_t string_len = 0;
+		lsn_push_init(&push, NULL, test_push_count, &string_len);
+		for (size_t i = 0; i < len; i += chunk)
+			lsn_push_feed(&push, src + i, i + chunk < len ? chunk : len - i);
+		res += !lsn_push_finish(&push, NULL) || string_len != 8;
+	}
+
+	// incomplete and invalid input
+	char* invalid[] = { "(1 2", "(1 'x", "(1) 2", "(1 (* x", "(1 x)" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+	{
+		lsn_push_t push;
+		lsn_push_init(&push, NULL, NULL, NULL);
+		lsn_push_feed(&push, invalid[i], 2);
+		lsn_push_feed(&push, invalid[i] + 2, strlen(invalid[i]) - 2);
+		lison_t* root = NULL;
+		res += lsn_push_finish(&push, &root) || root != NULL;
+	}
+	return res;
+}
+
+typedef struct _test_query_acc_t
+{
+	size_t count;
+	size_t limit;
+	int sum; // integers, and the length of strings
+} test_query_acc_t;
+
+static bool test_query_collect(const lison_t* match, void* user)
+{
+	test_query_acc_t* acc = (test_query_acc_t*)user;
+	acc->count++;
+	if (match->tag == LSN_Integer)
+		acc->sum += match->value.integer;
+	else if (match->tag == LSN_String)
+		acc->sum += (int)strlen(match->value.string);
+	return acc->count != acc->limit;
+}
+
+int test_query(void)
+{
+	char* src = "(:persons ((:name 'John' :age 22 :height 165) (* x *) (:name 'Andrew Sharp' :age 27 :height 195.5 :workplaces ((:name 'Pannonia'))) (:age 40)) :count 3)";
+	size_t len = strlen(src);
+	lison_t* root = lsn_compile(src);
+	int res = !root;
+	struct
+	{
+		const char* text;
+		size_t count;
+		int sum;
+	} cases[] = {
+		{ ":persons/*/:name", 2, 16 },
+		{ ":persons/*/:age", 3, 89 },
+		{ ":persons/1/:age", 1, 27 },
+		{ ":persons/*[:age>=27]/:age", 2, 67 },
+		{ ":persons/*[:height<190]/:name", 1, 4 },
+		{ ":persons/*[:name='John']/:height", 1, 165 },
+		{ ":persons/*[:name!='John']/:age", 1, 27 },
+		{ ":persons/*[:workplaces]/:workplaces/*/:name", 1, 8 },
+		{ ":persons/*/:missing", 0, 0 },
+		{ ":count", 1, 3 },
+		{ "*", 4, 3 },
+	};
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		lsn_query_t* query = lsn_query_compile(cases[i].text);
+		test_query_acc_t tree = { 0, 0, 0 };
+		test_query_acc_t scan = { 0, 0, 0 };
+		lsn_query_run(query, root, test_query_collect, &tree);
+		res += !query || !lsn_query_scan(query, src, len, test_query_collect, &scan);
+		res += tree.count != cases[i].count || tree.sum != cases[i].sum;
+		res += scan.count != cases[i].count || scan.sum != cases[i].sum;
+		lsn_query_delete(&query);
+	}
+
+	// the callback stops both modes at the first match
+	lsn_query_t* query = lsn_query_compile(":persons/*/:age");
+	test_query_acc_t tree = { 0, 1, 0 };
+	test_query_acc_t scan = { 0, 1, 0 };
+	lsn_query_run(query, root, test_query_collect, &tree);
+	res += !lsn_query_scan(query, src, len, test_query_collect, &scan);
+	res += tree.count != 1 || tree.sum != 22 || scan.count != 1 || scan.sum != 22;
+	// skipped objects are still checked
+	test_query_acc_t acc = { 0, 0, 0 };
+	res += lsn_query_scan(query, "(:persons ((:age 1)) :other (1 x))", 34, test_query_collect, &acc);
+	lsn_query_delete(&query);
+	lsn_delete(&root);
+
+	// tags that are values are not keys
+	query = lsn_query_compile(":b");
+	root = lsn_compile("(:a :b :b 5)");
+	test_query_acc_t keys = { 0, 0, 0 };
+	lsn_query_run(query, root, test_query_collect, &keys);
+	res += !lsn_query_scan(query, "(:a :b :b 5)", 12, test_query_collect, &keys);
+	res += keys.count != 2 || keys.sum != 10;
+	lsn_query_delete(&query);
+	lsn_delete(&root);
+
+	char* invalid[] = { "", "persons", ":persons/", ":a[", ":a[:b", ":a[:b=]", ":a[:b 1]", "*[:b='x]" };
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+	{
+		query = lsn_query_compile(invalid[i]);
+		res += query != NULL;
+		lsn_query_delete(&query);
+	}
+	return res;
+}
+
+int test_writer(void)
+{
+	char path[] = "/tmp/lsn_writer_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	str_t name = { "John Doe", 8 };
+	str_t tag = { "person", 6 };
+	lsn_writer_t* w = lsn_writer_new(fd);
+	lsn_writer_raw(w, "(", 1);
+	lsn_writer_tag(w, &tag);
+	lsn_writer_raw(w, " ", 1);
+	lsn_writer_string(w, &name);
+	lsn_writer_raw(w, " ", 1);
+	lsn_writer_integer(w, -22);
+	lsn_writer_raw(w, " ", 1);
+	lsn_writer_float(w, 165.25f);
+	lsn_writer_raw(w, ")", 1);
+	int res = !lsn_writer_delete(&w) || w != NULL;
+	close(fd);
+
+	FILE* file = fopen(path, "r");
+	char written[64] = { 0 };
+	res += fread(written, 1, sizeof(written) - 1, file) == 0;
+	fclose(file);
+	res += strcmp(written, "(:person 'John Doe' -22 165.25)") != 0;
+
+	// values LiSON cannot express fail the writer
+	str_t quoted = { "it's", 4 };
+	fd = open(path, O_WRONLY | O_TRUNC);
+	w = lsn_writer_new(fd);
+	lsn_writer_string(w, &quoted);
+	res += lsn_writer_delete(&w);
+	w = lsn_writer_new(fd);
+	lsn_writer_float(w, 1.0f / 0.0f);
+	res += lsn_writer_delete(&w);
+	str_t spaced = { "a b", 3 };
+	w = lsn_writer_new(fd);
+	lsn_writer_tag(w, &spaced);
+	res += lsn_writer_delete(&w);
+
+	// and so do the same values in a tree
+	lison_t* string = lsn_string("it's");
+	res += lsn_write(fd, string);
+	lsn_delete(&string);
+	lison_t* bad_tag = lsn_tag("a)b");
+	res += lsn_write(fd, bad_tag);
+	lsn_delete(&bad_tag);
+	close(fd);
+	remove(path);
+	return res;
+}
+
+static bool test_pack_sum(const lison_t* match, void* user)
+{
+	*(float*)user += match->tag == LSN_Integer ? (float)match->value.integer : match->value.lsn_float;
+	return true;
+}
+
+int test_pack(void)
+{
+	char* src = "(:series (1 2 3 -4) :coords (1.5 2.5) :mixed (1 2.5) :empty () :names ('a') :nested ((7) (8.5)))";
+	lsn_options_t opt = { .max_depth = 0, .flags = LSN_OPT_Pack, .symbols = NULL };
+	lison_t* root = lsn_compile_opt(src, &opt);
+	int res = !root;
+	const lison_t* series = lsn_get(root, "series");
+	const lison_t* coords = lsn_get(root, "coords");
+	res += series->tag != LSN_IntArray || series->value.array.len != 4 || series->value.array.ints[3] != -4;
+	res += coords->tag != LSN_FloatArray || coords->value.array.len != 2 || coords->value.array.floats[1] != 2.5f;
+	res += lsn_get(root, "mixed")->tag != LSN_Object || lsn_get(root, "empty")->tag != LSN_Object;
+	res += lsn_get(root, "names")->tag != LSN_Object;
+	res += lsn_get(root, "nested")->value.object.head->value->tag != LSN_IntArray;
+
+	// the arrays are written back as lists, in text and in binary
+	char path[] = "/tmp/lsn_pack_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	res += !lsn_write(fd, root);
+	close(fd);
+	FILE* file = fopen(path, "r");
+	char written[128] = { 0 };
+	res += fread(written, 1, sizeof(written) - 1, file) == 0;
+	fclose(file);
+	remove(path);
+	res += strcmp(written, "(:series (1 2 3 -4) :coords (1.5 2.5) :mixed (1 2.5) :empty () :names ('a') :nested ((7) (8.5)))") != 0;
+
+	lsn_buffer_t buf = { NULL, 0, 0 };
+	res += !lsn_encode_binary(root, &buf);
+	lison_t* decoded = lsn_decode_binary(buf.data, buf.len);
+	res += !decoded || lsn_get(decoded, "coords")->value.array.floats[0] != 1.5f;
+	lsn_delete(&decoded);
+	lsn_buffer_delete(&buf);
+
+	lison_t* copy = lsn_detach(root);
+	res += !copy || lsn_get(copy, "series")->value.array.ints[0] != 1;
+	lsn_delete(&copy);
+
+	lsn_query_t* query = lsn_query_compile(":series/*");
+	float sum = 0;
+	lsn_query_run(query, root, test_pack_sum, &sum);
+	res += sum != 2;
+	lsn_query_delete(&query);
+	lsn_delete(&root);
+
+	// the other builders pack too
+	lsn_doc_t* doc = lsn_compile_doc("(1.5 2.5 3.5)", &opt);
+	res += !doc || doc->root->tag != LSN_FloatArray || doc->root->value.array.len != 3;
+	lsn_doc_delete(&doc);
+	lsn_push_t push;
+	lsn_push_init(&push, &opt, NULL, NULL);
+	lsn_push_feed(&push, src, strlen(src));
+	res += !lsn_push_finish(&push, &root) || lsn_get(root, "series")->tag != LSN_IntArray;
+	lsn_delete(&root);
+
+	// without the option lists stay lists
+	root = lsn_compile(src);
+	res += !root || lsn_get(root, "series")->tag != LSN_Object;
+	lsn_delete(&root);
+	return res;
+}
+
+int test_columns(void)
+{
+	char* src = "(:persons ((:name 'John' :age 22 :height 165 :job :none) (:name 'Andrew Sharp' :age 27 :height 195.5 :job :dev) (:job :qa :age 40 :height 180 :name '')))";
+	lison_t* root = lsn_compile(src);
+	const char* tags[] = { "age", "height", "name", "job" };
+	lsn_columns_t cols;
+	int res = !lsn_to_columns(lsn_get(root, "persons"), tags, 4, &cols);
+	res += cols.rows != 3 || cols.len != 4;
+	const lsn_column_t* age = &cols.columns[0];
+	const lsn_column_t* height = &cols.columns[1];
+	const lsn_column_t* name = &cols.columns[2];
+	const lsn_column_t* job = &cols.columns[3];
+	res += age->type != LSN_Integer || age->ints[0] + age->ints[1] + age->ints[2] != 89;
+	// integers and floats make a float column
+	res += height->type != LSN_Float || height->floats[0] != 165.0f || height->floats[1] != 195.5f;
+	res += name->type != LSN_String || name->offsets[3] != 16 || memcmp(name->data, "JohnAndrew Sharp", 16) != 0;
+	res += name->offsets[2] != name->offsets[3];
+	res += job->type != LSN_Tag || memcmp(job->data + job->offsets[1], "dev", 3) != 0;
+	lsn_columns_delete(&cols);
+
+	// records without the tag and values of different kinds
+	const char* missing[] = { "age", "weight" };
+	res += lsn_to_columns(lsn_get(root, "persons"), missing, 2, &cols) || cols.columns != NULL;
+	const char* mixed[] = { "name", "age" };
+	lison_t* other = lsn_compile("((:name 'a' :age 1) (:name :b :age 2))");
+	res += lsn_to_columns(other, mixed, 2, &cols);
+	lsn_delete(&other);
+	lsn_delete(&root);
+	return res;
+}
+
 int test_compile_error_no_end(void)
 {
 	lison_t* lison = lsn_compile("(*Test*) (:name 'John' :height 165.4 :cars 1 :address (:postcode '9082' :city 'New York' :road '9th avenue' :house 10 (*) ) (*missing paren here*)");
@@ -218,7 +1065,53 @@ int test_compile_error_invalid_token(void)
 
 int test_serde(void)
 {
-	return 1;
+	char* src = "(:name 'John Doe' :age -22 :height 165.4 :ratio 0.1 :big 3.0e+7 :list (1 -2.5 ()) :empty ())";
+	char* expected = "(:name 'John Doe' :age -22 :height 165.4 :ratio 0.1 :big 30000000.0 :list (1 -2.5 ()) :empty ())";
+	char path[] = "/tmp/lsn_serde_XXXXXX";
+	int fd = mkstemp(path);
+	if (fd < 0)
+		return 1;
+	close(fd);
+
+	// no exponents in LiSON
+	lison_t* lison = lsn_compile(src);
+	int res = lison != NULL;
+	lsn_delete(&lison);
+	src = "(:name 'John Doe' :age -22 :height 165.4 :ratio 0.1 :big 30000000.0 :list (1 -2.5 ()) :empty ())";
+	lison = lsn_compile(src);
+	res += !lsn_serialize(path, lison);
+	lsn_delete(&lison);
+
+	FILE* file = fopen(path, "r");
+	char written[256] = { 0 };
+	res += fread(written, 1, sizeof(written) - 1, file) == 0;
+	fclose(file);
+	res += strcmp(written, expected) != 0;
+
+	lison = lsn_deserialize(path);
+	res += !lison || lsn_get(lison, "age")->value.integer != -22;
+	res += !lison || lsn_get(lison, "ratio")->value.lsn_float != 0.1f;
+
+	// floats round trip exactly
+	lison_list_t list;
+	lsn_lst_init(&list);
+	float values[] = { 1e-7f, 3.14159265f, 16777217.0f, -0.0f, 1e30f, 123456.789f };
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); i++)
+		lsn_lst_append(&list, lsn_float(values[i]));
+	lison_t* floats = lsn_object(list);
+	res += !lsn_serialize(path, floats);
+	lsn_delete(&floats);
+	floats = lsn_deserialize(path);
+	size_t i = 0;
+	for (lison_node_t* it = floats ? floats->value.object.head : NULL; it; it = it->next, i++)
+		res += memcmp(&it->value->value.lsn_float, &values[i], sizeof(float)) != 0;
+	res += i != sizeof(values) / sizeof(values[0]);
+
+	lsn_delete(&floats);
+	lsn_delete(&lison);
+	remove(path);
+	res += lsn_deserialize(path) != NULL;
+	return res;
 }
 
 /*
@@ -240,9 +1133,27 @@ RUN_TESTS(
 	TEST (strnum),
 	TEST (tokenizer),
 	TEST (comment),
+	TEST (lexer),
 	TEST (parse),
 	TEST (complex),
 	TEST (compile),
 	TEST (compile_error_no_end),
+	TEST (depth),
+	TEST (arena),
+	TEST (tape),
+	TEST (zero_copy),
+	TEST (interned),
+	TEST (lookup),
+	TEST (binary),
+	TEST (lazy),
+	TEST (structural),
+	TEST (parallel),
+	TEST (docs),
+	TEST (reader),
+	TEST (push),
+	TEST (query),
+	TEST (writer),
+	TEST (pack),
+	TEST (columns),
 	TEST (serde),
 )
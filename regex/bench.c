@@ -0,0 +1,348 @@
+#include "rgx.h"
+
+#include <time.h>
+
+/**
+ * Tóth Bálint, University of Pannonia
+ * 2023.
+ *
+ * Benchmark of the regex library against the POSIX regex of libc.
+ *
+ * Generates the corpora (random ASCII, log-like lines and pathological
+ * inputs for nested stars), then measures for every case:
+ * - compile time of rgx_compile, rgx_dfa_compile and regcomp,
+ * - throughput (MB/s) and per-call latency percentiles of the full
+ *   match (rgx_accept, rgx_dfa_accept, regexec with ^...$) and of the
+ *   prefix match (rgx_match, rgx_dfa_match, regexec with ^...).
+ * Every call is timed separately, so the latencies include the cost of
+ * reading the clock (a few tens of ns).
+ *
+ * --------------------------------------------------------------
+ * Usage:
+ * $> make bench
+ * $> ./benchmarks [lines per corpus]
+ */
+
+// bench_posix.c
+void* posix_compile(const char* pattern);
+bool posix_accept(void* rgx, const char* src);
+size_t posix_match(void* rgx, const char* src);
+void posix_delete(void* rgx);
+
+#define DEFAULT_LINES 20000
+#define COMPILE_ROUNDS 2000
+
+// POSIX equivalents of the character sets
+#define P_CHAR "[]A-Za-z.:,?;!%@&$/=()<>[-]"
+#define P_DIGIT "[0-9]"
+#define P_SPACE "[ \t\n]"
+
+typedef struct _corpus_t
+{
+	const char* name;
+	char* data;
+	char** lines;
+	size_t len;
+	size_t bytes;
+} corpus_t;
+
+typedef struct _bench_case_t
+{
+	const char* name;
+	const char* pattern;
+	const char* posix_full;
+	const char* posix_prefix;
+	corpus_t* corpus;
+} bench_case_t;
+
+typedef enum _engine_t
+{
+	Engine_Tree,
+	Engine_Dfa,
+	Engine_Posix,
+} engine_t;
+
+static const char* engine_names[] = { "tree", "dfa", "posix" };
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static int cmp_double(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+static double percentile(const double* sorted, size_t len, double p)
+{
+	size_t idx = (size_t)(p * (double)(len - 1));
+	return sorted[idx];
+}
+
+// CORPORA --------------------------------------------------
+
+static void corpus_init(corpus_t* corpus, const char* name, size_t lines, size_t max_line)
+{
+	corpus->name = name;
+	corpus->data = (char*)malloc(lines * (max_line + 1));
+	corpus->lines = (char**)malloc(lines * sizeof(char*));
+	corpus->len = 0;
+	corpus->bytes = 0;
+}
+
+static char* corpus_next(corpus_t* corpus)
+{
+	char* line = corpus->len
+		? corpus->lines[corpus->len - 1] + strlen(corpus->lines[corpus->len - 1]) + 1
+		: corpus->data;
+	corpus->lines[corpus->len++] = line;
+	return line;
+}
+
+static void corpus_random(corpus_t* corpus, size_t lines)
+{
+	const char* alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 ";
+	size_t alen = strlen(alphabet);
+	corpus_init(corpus, "random", lines, 120);
+	for (size_t i = 0; i < lines; i++)
+	{
+		char* line = corpus_next(corpus);
+		size_t len = 20 + (size_t)rand() % 100;
+		for (size_t j = 0; j < len; j++)
+			line[j] = alphabet[(size_t)rand() % alen];
+		line[len] = 0;
+		corpus->bytes += len;
+	}
+}
+
+static void corpus_log(corpus_t* corpus, size_t lines)
+{
+	const char* levels[] = { "200", "404", "500" };
+	corpus_init(corpus, "log", lines, 120);
+	for (size_t i = 0; i < lines; i++)
+	{
+		char* line = corpus_next(corpus);
+		char pass[9];
+		for (size_t j = 0; j < 8; j++)
+			pass[j] = (char)('a' + rand() % 26);
+		pass[8] = 0;
+		int len = sprintf(line, "2023-%02d-%02d user=u%zu pass=%s status=%s",
+			1 + rand() % 12, 1 + rand() % 28, i, pass, levels[rand() % 3]);
+		corpus->bytes += (size_t)len;
+	}
+}
+
+static void corpus_pathological(corpus_t* corpus, size_t lines)
+{
+	// runs of a with no b at the end: every split of the run is a candidate
+	corpus_init(corpus, "a-runs", lines, 512);
+	for (size_t i = 0; i < lines; i++)
+	{
+		char* line = corpus_next(corpus);
+		size_t len = 16 + (size_t)rand() % 496;
+		memset(line, 'a', len);
+		line[len] = 0;
+		corpus->bytes += len;
+	}
+}
+
+static void corpus_delete(corpus_t* corpus)
+{
+	free(corpus->data);
+	free(corpus->lines);
+}
+
+// MEASUREMENTS --------------------------------------------------
+
+static void report(const char* name, const char* engine, const char* op,
+	double* lat, size_t len, size_t bytes, size_t hits)
+{
+	double total = 0;
+	for (size_t i = 0; i < len; i++)
+		total += lat[i];
+	qsort(lat, len, sizeof(double), cmp_double);
+	printf("%-14s %-6s %-7s %9.2f %9.0f %9.0f %9.0f %9.0f %7zu\n",
+		name, engine, op, (double)bytes / (total / 1e9) / 1e6,
+		percentile(lat, len, 0.5), percentile(lat, len, 0.9),
+		percentile(lat, len, 0.99), lat[len - 1], hits);
+}
+
+static void bench_compile(const bench_case_t* bc)
+{
+	double* lat = (double*)malloc(COMPILE_ROUNDS * sizeof(double));
+	for (int engine = Engine_Tree; engine <= Engine_Posix; engine++)
+	{
+		for (size_t i = 0; i < COMPILE_ROUNDS; i++)
+		{
+			double start = now_ns();
+			switch (engine)
+			{
+			case Engine_Tree:
+			{
+				regex_t* rgx = rgx_compile(bc->pattern);
+				lat[i] = now_ns() - start;
+				rgx_delete(&rgx);
+				break;
+			}
+			case Engine_Dfa:
+			{
+				// the DFA needs the tree first
+				regex_t* rgx = rgx_compile(bc->pattern);
+				rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+				lat[i] = now_ns() - start;
+				rgx_dfa_delete(&dfa);
+				rgx_delete(&rgx);
+				break;
+			}
+			case Engine_Posix:
+			{
+				void* rgx = posix_compile(bc->posix_full);
+				lat[i] = now_ns() - start;
+				posix_delete(rgx);
+				break;
+			}
+			}
+		}
+		qsort(lat, COMPILE_ROUNDS, sizeof(double), cmp_double);
+		printf("%-14s %-6s %9.0f %9.0f\n", bc->name, engine_names[engine],
+			percentile(lat, COMPILE_ROUNDS, 0.5), percentile(lat, COMPILE_ROUNDS, 0.99));
+	}
+	free(lat);
+}
+
+static void bench_match(const bench_case_t* bc)
+{
+	const corpus_t* corpus = bc->corpus;
+	double* lat = (double*)malloc(corpus->len * sizeof(double));
+	regex_t* rgx = rgx_compile(bc->pattern);
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	void* posix_full = posix_compile(bc->posix_full);
+	void* posix_prefix = posix_compile(bc->posix_prefix);
+	if (!rgx || !dfa || !posix_full || !posix_prefix)
+	{
+		fprintf(stderr, "%s: cannot compile the patterns\n", bc->name);
+		goto cleanup;
+	}
+
+	for (int engine = Engine_Tree; engine <= Engine_Posix; engine++)
+	{
+		size_t hits = 0;
+		for (size_t i = 0; i < corpus->len; i++)
+		{
+			const char* line = corpus->lines[i];
+			double start = now_ns();
+			bool res;
+			switch (engine)
+			{
+			case Engine_Tree:  res = rgx_accept(line, rgx); break;
+			case Engine_Dfa:   res = rgx_dfa_accept(line, dfa); break;
+			default:           res = posix_accept(posix_full, line); break;
+			}
+			lat[i] = now_ns() - start;
+			hits += res;
+		}
+		report(bc->name, engine_names[engine], "accept", lat, corpus->len, corpus->bytes, hits);
+	}
+
+	for (int engine = Engine_Tree; engine <= Engine_Posix; engine++)
+	{
+		size_t hits = 0;
+		for (size_t i = 0; i < corpus->len; i++)
+		{
+			const char* line = corpus->lines[i];
+			double start = now_ns();
+			size_t len;
+			switch (engine)
+			{
+			case Engine_Tree:  len = rgx_match(line, rgx).len; break;
+			case Engine_Dfa:   len = rgx_dfa_match(line, dfa).len; break;
+			default:           len = posix_match(posix_prefix, line); break;
+			}
+			lat[i] = now_ns() - start;
+			hits += len > 0;
+		}
+		report(bc->name, engine_names[engine], "match", lat, corpus->len, corpus->bytes, hits);
+	}
+
+cleanup:
+	posix_delete(posix_full);
+	posix_delete(posix_prefix);
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	free(lat);
+}
+
+int main(int argc, char** argv)
+{
+	size_t lines = argc > 1 ? (size_t)atol(argv[1]) : DEFAULT_LINES;
+	if (lines == 0)
+		lines = DEFAULT_LINES;
+	srand(42);
+
+	corpus_t random, log, runs;
+	corpus_random(&random, lines);
+	corpus_log(&log, lines);
+	corpus_pathological(&runs, lines / 10 ? lines / 10 : 1);
+
+	bench_case_t cases[] = {
+		{
+			.name = "log-line",
+			.pattern = "\\d+-\\d+-\\d+\\wuser=u\\d+\\wpass=\\c+\\wstatus=\\d+",
+			.posix_full = "^" P_DIGIT "+-" P_DIGIT "+-" P_DIGIT "+" P_SPACE "user=u" P_DIGIT "+"
+				P_SPACE "pass=" P_CHAR "+" P_SPACE "status=" P_DIGIT "+$",
+			.posix_prefix = "^" P_DIGIT "+-" P_DIGIT "+-" P_DIGIT "+" P_SPACE "user=u" P_DIGIT "+"
+				P_SPACE "pass=" P_CHAR "+" P_SPACE "status=" P_DIGIT "+",
+			.corpus = &log,
+		},
+		{
+			.name = "log-alt",
+			.pattern = "(\\c|\\d|\\w)*status=(404|500)",
+			.posix_full = "^(" P_CHAR "|" P_DIGIT "|" P_SPACE ")*status=(404|500)$",
+			.posix_prefix = "^(" P_CHAR "|" P_DIGIT "|" P_SPACE ")*status=(404|500)",
+			.corpus = &log,
+		},
+		{
+			.name = "random-words",
+			.pattern = "(\\c|\\d)+(\\w(\\c|\\d)+)*",
+			.posix_full = "^(" P_CHAR "|" P_DIGIT ")+(" P_SPACE "(" P_CHAR "|" P_DIGIT ")+)*$",
+			.posix_prefix = "^(" P_CHAR "|" P_DIGIT ")+(" P_SPACE "(" P_CHAR "|" P_DIGIT ")+)*",
+			.corpus = &random,
+		},
+		{
+			.name = "nested-star",
+			.pattern = "(a*)*b",
+			.posix_full = "^(a*)*b$",
+			.posix_prefix = "^(a*)*b",
+			.corpus = &runs,
+		},
+		{
+			.name = "alt-star",
+			.pattern = "(a|aa)*(a|aa)*b",
+			.posix_full = "^(a|aa)*(a|aa)*b$",
+			.posix_prefix = "^(a|aa)*(a|aa)*b",
+			.corpus = &runs,
+		},
+	};
+	size_t cases_len = sizeof(cases) / sizeof(bench_case_t);
+
+	printf("== compile (ns per pattern) ==\n");
+	printf("%-14s %-6s %9s %9s\n", "case", "engine", "p50", "p99");
+	for (size_t i = 0; i < cases_len; i++)
+		bench_compile(&cases[i]);
+
+	printf("\n== match (%zu lines, latencies in ns per call) ==\n", lines);
+	printf("%-14s %-6s %-7s %9s %9s %9s %9s %9s %7s\n",
+		"case", "engine", "op", "MB/s", "p50", "p90", "p99", "max", "hits");
+	for (size_t i = 0; i < cases_len; i++)
+		bench_match(&cases[i]);
+
+	corpus_delete(&random);
+	corpus_delete(&log);
+	corpus_delete(&runs);
+	return 0;
+}
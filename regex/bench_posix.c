@@ -0,0 +1,40 @@
+/**
+ * POSIX regex baseline of the benchmark.
+ * Lives in its own translation unit, because <regex.h> defines regex_t
+ * just like rgx.h does.
+ */
+#include <regex.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+void* posix_compile(const char* pattern)
+{
+	regex_t* rgx = (regex_t*)malloc(sizeof(regex_t));
+	if (regcomp(rgx, pattern, REG_EXTENDED) != 0)
+	{
+		free(rgx);
+		return NULL;
+	}
+	return rgx;
+}
+
+bool posix_accept(void* rgx, const char* src)
+{
+	return regexec((regex_t*)rgx, src, 0, NULL, 0) == 0;
+}
+
+size_t posix_match(void* rgx, const char* src)
+{
+	regmatch_t match;
+	if (regexec((regex_t*)rgx, src, 1, &match, 0) != 0 || match.rm_so != 0)
+		return 0;
+	return (size_t)match.rm_eo;
+}
+
+void posix_delete(void* rgx)
+{
+	if (!rgx)
+		return;
+	regfree((regex_t*)rgx);
+	free(rgx);
+}
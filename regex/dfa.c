@@ -0,0 +1,858 @@
+#include "rgx.h"
+
+/**
+ * Deterministic automaton engine.
+ *
+ * The regex tree is first turned into a Thompson NFA (one state per leaf
+ * and operator, epsilon transitions for the glue), then the subset
+ * construction builds the DFA over byte equivalence classes. States that
+ * cannot reach an accepting state are merged into the dead state, so every
+ * run can stop on the first byte that makes a match impossible.
+ */
+
+typedef enum _rgx_nfa_kind_t
+{
+	NFA_Byte,
+	NFA_Split,
+	NFA_Eps,
+	NFA_Match,
+} rgx_nfa_kind_t;
+
+typedef struct _rgx_nfa_state_t
+{
+	rgx_nfa_kind_t kind;
+	int out;
+	int out1;
+	// index of the byte set for NFA_Byte states
+	int set;
+} rgx_nfa_state_t;
+
+typedef struct _rgx_byteset_t
+{
+	uint64_t bits[4];
+} rgx_byteset_t;
+
+typedef struct _rgx_nfa_t
+{
+	rgx_nfa_state_t* states;
+	size_t len;
+	size_t cap;
+	rgx_byteset_t* sets;
+	size_t sets_len;
+	size_t sets_cap;
+	int start;
+	// a Negate or Intersect node had no automaton to embed
+	bool failed;
+} rgx_nfa_t;
+
+typedef struct _rgx_frag_t
+{
+	int start;
+	int end;
+} rgx_frag_t;
+
+static bool byteset_has(const rgx_byteset_t* set, unsigned char c)
+{
+	return (set->bits[c / 64] >> (c % 64)) & 1;
+}
+
+static int nfa_state(rgx_nfa_t* nfa, rgx_nfa_kind_t kind, int out, int out1)
+{
+	if (nfa->len == nfa->cap)
+	{
+		nfa->cap = nfa->cap ? 2 * nfa->cap : 16;
+		nfa->states = (rgx_nfa_state_t*)realloc(nfa->states, nfa->cap * sizeof(rgx_nfa_state_t));
+	}
+	nfa->states[nfa->len] = (rgx_nfa_state_t) { .kind = kind, .out = out, .out1 = out1, .set = -1 };
+	return (int)nfa->len++;
+}
+
+static int nfa_set(rgx_nfa_t* nfa, const rgx_byteset_t* set)
+{
+	if (nfa->sets_len == nfa->sets_cap)
+	{
+		nfa->sets_cap = nfa->sets_cap ? 2 * nfa->sets_cap : 8;
+		nfa->sets = (rgx_byteset_t*)realloc(nfa->sets, nfa->sets_cap * sizeof(rgx_byteset_t));
+	}
+	nfa->sets[nfa->sets_len] = *set;
+	return (int)nfa->sets_len++;
+}
+
+static int nfa_byte(rgx_nfa_t* nfa, const rgx_byteset_t* set, int out)
+{
+	int byte = nfa_state(nfa, NFA_Byte, out, -1);
+	nfa->states[byte].set = nfa_set(nfa, set);
+	return byte;
+}
+
+/**
+ * Embeds the automaton of a Negate or Intersect node as a fragment.
+ * Every live DFA state becomes a chain of splits over its outgoing byte
+ * sets (one per target state), and the accepting ones also branch to
+ * the end of the fragment.
+ */
+static rgx_frag_t nfa_embed(rgx_nfa_t* nfa, const rgx_dfa_t* dfa)
+{
+	int end = nfa_state(nfa, NFA_Eps, -1, -1);
+	int* entry = (int*)malloc(dfa->states * sizeof(int));
+	uint32_t* seen = (uint32_t*)malloc(dfa->states * sizeof(uint32_t));
+	for (uint32_t s = 0; s < dfa->states; s++)
+	{
+		entry[s] = nfa_state(nfa, NFA_Eps, -1, -1);
+		seen[s] = UINT32_MAX;
+	}
+	for (uint32_t s = 1; s < dfa->states; s++)
+	{
+		const uint32_t* row = dfa->trans + s * dfa->classes_len;
+		int chain = dfa->accept[s] ? end : -1;
+		for (unsigned cls = 0; cls < dfa->classes_len; cls++)
+		{
+			uint32_t target = row[cls];
+			if (target == RGX_DFA_DEAD || seen[target] == s)
+				continue;
+			seen[target] = s;
+			rgx_byteset_t set = {{0}};
+			for (unsigned c = 0; c < 256; c++)
+				if (row[dfa->classes[c]] == target)
+					set.bits[c / 64] |= (uint64_t)1 << (c % 64);
+			int byte = nfa_byte(nfa, &set, entry[target]);
+			chain = chain < 0 ? byte : nfa_state(nfa, NFA_Split, byte, chain);
+		}
+		nfa->states[entry[s]].out = chain;
+	}
+	// a dead start state keeps its entry without transitions
+	int start = entry[dfa->start];
+	free(entry);
+	free(seen);
+	return (rgx_frag_t) { .start = start, .end = end };
+}
+
+static rgx_frag_t nfa_build(rgx_nfa_t* nfa, const regex_t* regex)
+{
+	switch (regex->type)
+	{
+	case Concat:
+	{
+		rgx_frag_t a = nfa_build(nfa, regex->value.concat.a);
+		rgx_frag_t b = nfa_build(nfa, regex->value.concat.b);
+		nfa->states[a.end].out = b.start;
+		return (rgx_frag_t) { .start = a.start, .end = b.end };
+	}
+	case Union:
+	{
+		rgx_frag_t a = nfa_build(nfa, regex->value.uni.a);
+		rgx_frag_t b = nfa_build(nfa, regex->value.uni.b);
+		int end = nfa_state(nfa, NFA_Eps, -1, -1);
+		nfa->states[a.end].out = end;
+		nfa->states[b.end].out = end;
+		int split = nfa_state(nfa, NFA_Split, a.start, b.start);
+		return (rgx_frag_t) { .start = split, .end = end };
+	}
+	case Star:
+	{
+		rgx_frag_t a = nfa_build(nfa, regex->value.star);
+		int end = nfa_state(nfa, NFA_Eps, -1, -1);
+		int split = nfa_state(nfa, NFA_Split, a.start, end);
+		nfa->states[a.end].out = split;
+		return (rgx_frag_t) { .start = split, .end = end };
+	}
+	case Plus:
+	{
+		rgx_frag_t a = nfa_build(nfa, regex->value.plus);
+		int end = nfa_state(nfa, NFA_Eps, -1, -1);
+		int split = nfa_state(nfa, NFA_Split, a.start, end);
+		nfa->states[a.end].out = split;
+		return (rgx_frag_t) { .start = a.start, .end = end };
+	}
+	case Negate:
+	case Intersect:
+	{
+		const rgx_dfa_t* dfa = regex->type == Negate
+			? regex->value.negate.dfa
+			: regex->value.inter.dfa;
+		if (dfa)
+			return nfa_embed(nfa, dfa);
+		nfa->failed = true;
+		int dead = nfa_state(nfa, NFA_Eps, -1, -1);
+		return (rgx_frag_t) { .start = dead, .end = dead };
+	}
+	default:
+	{
+		rgx_byteset_t set = {{0}};
+		for (unsigned c = 0; c < 256; c++)
+			if (rgx_class_has(regex, (unsigned char)c))
+				set.bits[c / 64] |= (uint64_t)1 << (c % 64);
+		int end = nfa_state(nfa, NFA_Eps, -1, -1);
+		int byte = nfa_byte(nfa, &set, end);
+		return (rgx_frag_t) { .start = byte, .end = end };
+	}
+	}
+}
+
+static void nfa_delete(rgx_nfa_t* nfa)
+{
+	free(nfa->states);
+	free(nfa->sets);
+	nfa->states = NULL;
+	nfa->sets = NULL;
+}
+
+/**
+ * Splits the byte alphabet into classes that no byte set distinguishes.
+ * Returns the number of classes.
+ */
+static unsigned nfa_byte_classes(const rgx_nfa_t* nfa, uint8_t classes[256])
+{
+	unsigned count = 1;
+	memset(classes, 0, 256);
+	for (size_t s = 0; s < nfa->sets_len; s++)
+	{
+		// (old class, member of the set) -> new class
+		int remap[256][2];
+		for (unsigned i = 0; i < count; i++)
+			remap[i][0] = remap[i][1] = -1;
+		unsigned next = 0;
+		for (unsigned c = 0; c < 256; c++)
+		{
+			int in = byteset_has(&nfa->sets[s], (unsigned char)c);
+			int* slot = &remap[classes[c]][in];
+			if (*slot < 0)
+				*slot = (int)next++;
+			classes[c] = (uint8_t)*slot;
+		}
+		count = next;
+	}
+	return count;
+}
+
+// SUBSET CONSTRUCTION --------------------------------------------------
+
+typedef struct _rgx_subset_t
+{
+	// NFA state sets of the DFA states, concatenated
+	int* data;
+	size_t data_len;
+	size_t data_cap;
+	size_t* off;
+	size_t* len;
+	size_t count;
+	size_t cap;
+
+	// open addressing table of DFA state ids
+	uint32_t* table;
+	size_t table_cap;
+} rgx_subset_t;
+
+static uint32_t subset_hash(const int* set, size_t len)
+{
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (uint32_t)set[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static void subset_rehash(rgx_subset_t* sub)
+{
+	free(sub->table);
+	sub->table_cap = sub->table_cap ? 2 * sub->table_cap : 64;
+	sub->table = (uint32_t*)malloc(sub->table_cap * sizeof(uint32_t));
+	for (size_t i = 0; i < sub->table_cap; i++)
+		sub->table[i] = UINT32_MAX;
+	for (size_t id = 0; id < sub->count; id++)
+	{
+		size_t slot = subset_hash(sub->data + sub->off[id], sub->len[id]) & (sub->table_cap - 1);
+		while (sub->table[slot] != UINT32_MAX)
+			slot = (slot + 1) & (sub->table_cap - 1);
+		sub->table[slot] = (uint32_t)id;
+	}
+}
+
+/**
+ * Returns the DFA state id of the sorted NFA state set, adding it if it
+ * is new.
+ */
+static uint32_t subset_find(rgx_subset_t* sub, const int* set, size_t len)
+{
+	if (2 * (sub->count + 1) > sub->table_cap)
+		subset_rehash(sub);
+	size_t slot = subset_hash(set, len) & (sub->table_cap - 1);
+	while (sub->table[slot] != UINT32_MAX)
+	{
+		uint32_t id = sub->table[slot];
+		if (sub->len[id] == len && memcmp(sub->data + sub->off[id], set, len * sizeof(int)) == 0)
+			return id;
+		slot = (slot + 1) & (sub->table_cap - 1);
+	}
+	if (sub->count == sub->cap)
+	{
+		sub->cap = sub->cap ? 2 * sub->cap : 16;
+		sub->off = (size_t*)realloc(sub->off, sub->cap * sizeof(size_t));
+		sub->len = (size_t*)realloc(sub->len, sub->cap * sizeof(size_t));
+	}
+	while (sub->data_len + len > sub->data_cap)
+	{
+		sub->data_cap = sub->data_cap ? 2 * sub->data_cap : 64;
+		sub->data = (int*)realloc(sub->data, sub->data_cap * sizeof(int));
+	}
+	if (len)
+		memcpy(sub->data + sub->data_len, set, len * sizeof(int));
+	sub->off[sub->count] = sub->data_len;
+	sub->len[sub->count] = len;
+	sub->data_len += len;
+	sub->table[slot] = (uint32_t)sub->count;
+	return (uint32_t)sub->count++;
+}
+
+static void subset_delete(rgx_subset_t* sub)
+{
+	free(sub->data);
+	free(sub->off);
+	free(sub->len);
+	free(sub->table);
+}
+
+static int cmp_int(const void* a, const void* b)
+{
+	int x = *(const int*)a;
+	int y = *(const int*)b;
+	return (x > y) - (x < y);
+}
+
+/**
+ * Epsilon closure of the states in set[0..len) written back into set.
+ * Only byte and match states are kept, the others are glue.
+ * Returns the length of the closure.
+ */
+static size_t nfa_closure(const rgx_nfa_t* nfa, int* set, size_t len, int* stack, uint32_t* mark, uint32_t gen)
+{
+	size_t top = 0;
+	for (size_t i = 0; i < len; i++)
+		stack[top++] = set[i];
+	size_t res = 0;
+	while (top > 0)
+	{
+		int s = stack[--top];
+		if (s < 0 || mark[s] == gen)
+			continue;
+		mark[s] = gen;
+		const rgx_nfa_state_t* st = &nfa->states[s];
+		switch (st->kind)
+		{
+		case NFA_Split:
+			stack[top++] = st->out1;
+			stack[top++] = st->out;
+			break;
+		case NFA_Eps:
+			stack[top++] = st->out;
+			break;
+		default:
+			set[res++] = s;
+			break;
+		}
+	}
+	qsort(set, res, sizeof(int), cmp_int);
+	return res;
+}
+
+static void dfa_prune(rgx_dfa_t* dfa);
+
+/**
+ * Makes room for at least count states in the tables of the DFA.
+ */
+static void dfa_reserve(rgx_dfa_t* dfa, size_t* cap, size_t count)
+{
+	if (count <= *cap)
+		return;
+	while (count > *cap)
+		*cap *= 2;
+	dfa->trans = (uint32_t*)realloc(dfa->trans, *cap * dfa->classes_len * sizeof(uint32_t));
+	dfa->accept = (bool*)realloc(dfa->accept, *cap * sizeof(bool));
+}
+
+static rgx_dfa_t* dfa_from_nfa(const rgx_nfa_t* nfa)
+{
+	rgx_dfa_t* dfa = (rgx_dfa_t*)malloc(sizeof(rgx_dfa_t));
+	dfa->live = NULL;
+	dfa->classes_len = (uint16_t)nfa_byte_classes(nfa, dfa->classes);
+	unsigned char repr[256];
+	for (unsigned c = 256; c-- > 0;)
+		repr[dfa->classes[c]] = (unsigned char)c;
+
+	size_t cap = 16;
+	dfa->trans = (uint32_t*)malloc(cap * dfa->classes_len * sizeof(uint32_t));
+	dfa->accept = (bool*)malloc(cap * sizeof(bool));
+
+	rgx_subset_t sub = {0};
+	// every state is expanded once and pushes at most two successors
+	int* set = (int*)malloc((nfa->len + 1) * sizeof(int));
+	int* stack = (int*)malloc(3 * (nfa->len + 1) * sizeof(int));
+	uint32_t* mark = (uint32_t*)calloc(nfa->len, sizeof(uint32_t));
+	uint32_t gen = 0;
+	bool ok = true;
+
+	// state 0 is the empty set, the dead state
+	subset_find(&sub, NULL, 0);
+	set[0] = nfa->start;
+	size_t len = nfa_closure(nfa, set, 1, stack, mark, ++gen);
+	dfa->start = subset_find(&sub, set, len);
+
+	for (size_t id = 0; ok && id < sub.count; id++)
+	{
+		dfa_reserve(dfa, &cap, sub.count);
+		dfa->accept[id] = false;
+		for (size_t i = 0; i < sub.len[id]; i++)
+			if (nfa->states[sub.data[sub.off[id] + i]].kind == NFA_Match)
+				dfa->accept[id] = true;
+		for (unsigned cls = 0; cls < dfa->classes_len; cls++)
+		{
+			size_t next = 0;
+			for (size_t i = 0; i < sub.len[id]; i++)
+			{
+				const rgx_nfa_state_t* st = &nfa->states[sub.data[sub.off[id] + i]];
+				if (st->kind == NFA_Byte && byteset_has(&nfa->sets[st->set], repr[cls]))
+					set[next++] = st->out;
+			}
+			len = nfa_closure(nfa, set, next, stack, mark, ++gen);
+			uint32_t target = subset_find(&sub, set, len);
+			dfa->trans[id * dfa->classes_len + cls] = target;
+			if (sub.count > RGX_DFA_MAX_STATES)
+			{
+				ok = false;
+				break;
+			}
+		}
+	}
+	dfa->states = (uint32_t)sub.count;
+
+	free(set);
+	free(stack);
+	free(mark);
+	subset_delete(&sub);
+	if (!ok)
+	{
+		LOG("[DFA] State limit reached\n");
+		rgx_dfa_delete(&dfa);
+		return NULL;
+	}
+	dfa_prune(dfa);
+	return dfa;
+}
+
+/**
+ * Merges every state that cannot reach an accepting state into a fresh
+ * dead state 0 and renumbers the rest, dropping the unused rows.
+ */
+static void dfa_prune(rgx_dfa_t* dfa)
+{
+	size_t states = dfa->states;
+	size_t width = dfa->classes_len;
+	size_t edges = states * width;
+
+	// reverse edges in compressed rows: rev[first[t]..first[t+1]) -> t
+	uint32_t* first = (uint32_t*)calloc(states + 1, sizeof(uint32_t));
+	uint32_t* rev = (uint32_t*)malloc(edges * sizeof(uint32_t));
+	for (size_t e = 0; e < edges; e++)
+		first[dfa->trans[e] + 1]++;
+	for (size_t s = 0; s < states; s++)
+		first[s + 1] += first[s];
+	uint32_t* fill = (uint32_t*)malloc(states * sizeof(uint32_t));
+	memcpy(fill, first, states * sizeof(uint32_t));
+	for (size_t e = 0; e < edges; e++)
+		rev[fill[dfa->trans[e]]++] = (uint32_t)(e / width);
+
+	// live: states that can reach an accepting state
+	bool* live = (bool*)calloc(states, sizeof(bool));
+	size_t top = 0;
+	for (size_t s = 0; s < states; s++)
+	{
+		if (dfa->accept[s])
+		{
+			live[s] = true;
+			fill[top++] = (uint32_t)s;
+		}
+	}
+	while (top > 0)
+	{
+		uint32_t t = fill[--top];
+		for (uint32_t i = first[t]; i < first[t + 1]; i++)
+		{
+			if (!live[rev[i]])
+			{
+				live[rev[i]] = true;
+				fill[top++] = rev[i];
+			}
+		}
+	}
+
+	// renumber: live states follow the dead state in their old order
+	uint32_t* id = first;
+	uint32_t count = 1;
+	for (size_t s = 0; s < states; s++)
+		id[s] = live[s] ? count++ : RGX_DFA_DEAD;
+	uint32_t* trans = (uint32_t*)calloc(count * width, sizeof(uint32_t));
+	bool* accept = (bool*)calloc(count, sizeof(bool));
+	for (size_t s = 0; s < states; s++)
+	{
+		if (!live[s])
+			continue;
+		for (size_t cls = 0; cls < width; cls++)
+			trans[id[s] * width + cls] = id[dfa->trans[s * width + cls]];
+		accept[id[s]] = dfa->accept[s];
+	}
+	free(dfa->trans);
+	free(dfa->accept);
+	dfa->trans = trans;
+	dfa->accept = accept;
+	dfa->start = id[dfa->start];
+	dfa->states = count;
+
+	free(first);
+	free(rev);
+	free(fill);
+	free(live);
+}
+
+static void live_delete(rgx_live_t** live)
+{
+	if (!live || !*live)
+		return;
+	free((*live)->trans);
+	free((*live)->sets);
+	free(*live);
+	*live = NULL;
+}
+
+/**
+ * Builds the automaton of the live sets (see rgx_live_t) by the subset
+ * construction over the DFA edges run backwards. Reading a byte of class
+ * c into the set S gives the accepting states and the states whose edge
+ * on c leads into S.
+ * Returns an automaton without states if it would have more than
+ * RGX_DFA_MAX_STATES states, so the failure is only met once.
+ */
+static rgx_live_t* dfa_live(const rgx_dfa_t* dfa)
+{
+	size_t states = dfa->states;
+	size_t width = dfa->classes_len;
+	size_t edges = states * width;
+
+	// edges into each state in compressed rows, as source * width + class
+	uint32_t* first = (uint32_t*)calloc(states + 1, sizeof(uint32_t));
+	uint32_t* into = (uint32_t*)malloc(edges * sizeof(uint32_t));
+	for (size_t e = 0; e < edges; e++)
+		first[dfa->trans[e] + 1]++;
+	for (size_t s = 0; s < states; s++)
+		first[s + 1] += first[s];
+	uint32_t* fill = (uint32_t*)malloc((states > width ? states : width) * sizeof(uint32_t));
+	memcpy(fill, first, states * sizeof(uint32_t));
+	for (size_t e = 0; e < edges; e++)
+		into[fill[dfa->trans[e]]++] = (uint32_t)e;
+
+	int* accepting = (int*)malloc(states * sizeof(int));
+	size_t accepting_len = 0;
+	for (size_t s = 0; s < states; s++)
+		if (dfa->accept[s])
+			accepting[accepting_len++] = (int)s;
+
+	// sources of the edges into the current set, grouped by class
+	uint32_t* bounds = (uint32_t*)malloc((width + 1) * sizeof(uint32_t));
+	int* sources = (int*)malloc((edges ? edges : 1) * sizeof(int));
+	int* set = (int*)malloc((states + 1) * sizeof(int));
+	uint32_t* mark = (uint32_t*)calloc(states, sizeof(uint32_t));
+	uint32_t gen = 0;
+
+	rgx_live_t* live = (rgx_live_t*)malloc(sizeof(rgx_live_t));
+	size_t cap = 16;
+	live->trans = (uint32_t*)malloc(cap * width * sizeof(uint32_t));
+	rgx_subset_t sub = {0};
+	live->start = subset_find(&sub, accepting, accepting_len);
+	bool ok = true;
+	for (size_t id = 0; ok && id < sub.count; id++)
+	{
+		if (sub.count > cap)
+		{
+			while (sub.count > cap)
+				cap *= 2;
+			live->trans = (uint32_t*)realloc(live->trans, cap * width * sizeof(uint32_t));
+		}
+		memset(bounds, 0, (width + 1) * sizeof(uint32_t));
+		const int* members = sub.data + sub.off[id];
+		for (size_t i = 0; i < sub.len[id]; i++)
+			for (uint32_t k = first[members[i]]; k < first[members[i] + 1]; k++)
+				bounds[into[k] % width + 1]++;
+		for (size_t cls = 0; cls < width; cls++)
+			bounds[cls + 1] += bounds[cls];
+		memcpy(fill, bounds, width * sizeof(uint32_t));
+		for (size_t i = 0; i < sub.len[id]; i++)
+			for (uint32_t k = first[members[i]]; k < first[members[i] + 1]; k++)
+				sources[fill[into[k] % width]++] = (int)(into[k] / width);
+
+		for (size_t cls = 0; cls < width; cls++)
+		{
+			// a state has one edge per class, so the sources are distinct
+			size_t len = 0;
+			gen++;
+			for (uint32_t k = bounds[cls]; k < bounds[cls + 1]; k++)
+			{
+				set[len++] = sources[k];
+				mark[sources[k]] = gen;
+			}
+			for (size_t i = 0; i < accepting_len; i++)
+				if (mark[accepting[i]] != gen)
+					set[len++] = accepting[i];
+			qsort(set, len, sizeof(int), cmp_int);
+			live->trans[id * width + cls] = subset_find(&sub, set, len);
+			if (sub.count > RGX_DFA_MAX_STATES)
+			{
+				ok = false;
+				break;
+			}
+		}
+	}
+	live->states = (uint32_t)sub.count;
+	live->words = (states + 63) / 64;
+	live->sets = ok ? (uint64_t*)calloc(live->states * live->words, sizeof(uint64_t)) : NULL;
+	for (size_t id = 0; ok && id < sub.count; id++)
+	{
+		uint64_t* row = live->sets + id * live->words;
+		for (size_t i = 0; i < sub.len[id]; i++)
+		{
+			int s = sub.data[sub.off[id] + i];
+			row[s / 64] |= (uint64_t)1 << (s % 64);
+		}
+	}
+
+	free(first);
+	free(into);
+	free(fill);
+	free(accepting);
+	free(bounds);
+	free(sources);
+	free(set);
+	free(mark);
+	subset_delete(&sub);
+	if (!ok)
+	{
+		LOG("[DFA] State limit reached in live sets\n");
+		free(live->trans);
+		live->trans = NULL;
+		live->states = 0;
+	}
+	return live;
+}
+
+// OPERATIONS --------------------------------------------------
+
+rgx_dfa_t* rgx_dfa_complement(const rgx_dfa_t* dfa)
+{
+	if (!dfa)
+		return NULL;
+	rgx_dfa_t* res = (rgx_dfa_t*)malloc(sizeof(rgx_dfa_t));
+	*res = *dfa;
+	res->live = NULL;
+	res->trans = (uint32_t*)malloc(dfa->states * dfa->classes_len * sizeof(uint32_t));
+	res->accept = (bool*)malloc(dfa->states * sizeof(bool));
+	memcpy(res->trans, dfa->trans, dfa->states * dfa->classes_len * sizeof(uint32_t));
+	// the table is complete, so flipping the accepting states is enough:
+	// the old dead state becomes a sink that accepts everything
+	for (uint32_t s = 0; s < dfa->states; s++)
+		res->accept[s] = !dfa->accept[s];
+	dfa_prune(res);
+	return res;
+}
+
+rgx_dfa_t* rgx_dfa_intersect(const rgx_dfa_t* a, const rgx_dfa_t* b)
+{
+	if (!a || !b)
+		return NULL;
+	rgx_dfa_t* dfa = (rgx_dfa_t*)malloc(sizeof(rgx_dfa_t));
+	dfa->live = NULL;
+
+	// byte classes of the product: pairs of the operand classes
+	int* remap = (int*)malloc(a->classes_len * b->classes_len * sizeof(int));
+	uint8_t cls_a[256];
+	uint8_t cls_b[256];
+	unsigned count = 0;
+	for (size_t i = 0; i < (size_t)a->classes_len * b->classes_len; i++)
+		remap[i] = -1;
+	for (unsigned c = 0; c < 256; c++)
+	{
+		int* slot = &remap[a->classes[c] * b->classes_len + b->classes[c]];
+		if (*slot < 0)
+		{
+			cls_a[count] = a->classes[c];
+			cls_b[count] = b->classes[c];
+			*slot = (int)count++;
+		}
+		dfa->classes[c] = (uint8_t)*slot;
+	}
+	dfa->classes_len = (uint16_t)count;
+	free(remap);
+
+	size_t cap = 16;
+	dfa->trans = (uint32_t*)malloc(cap * dfa->classes_len * sizeof(uint32_t));
+	dfa->accept = (bool*)malloc(cap * sizeof(bool));
+
+	// the state pairs are kept in the same table as the NFA state sets
+	rgx_subset_t sub = {0};
+	int pair[2] = { RGX_DFA_DEAD, RGX_DFA_DEAD };
+	bool ok = true;
+	subset_find(&sub, pair, 2);
+	pair[0] = (int)a->start;
+	pair[1] = (int)b->start;
+	dfa->start = (a->start == RGX_DFA_DEAD || b->start == RGX_DFA_DEAD)
+		? RGX_DFA_DEAD
+		: subset_find(&sub, pair, 2);
+
+	for (size_t id = 0; ok && id < sub.count; id++)
+	{
+		dfa_reserve(dfa, &cap, sub.count);
+		uint32_t sa = (uint32_t)sub.data[sub.off[id]];
+		uint32_t sb = (uint32_t)sub.data[sub.off[id] + 1];
+		dfa->accept[id] = a->accept[sa] && b->accept[sb];
+		for (unsigned cls = 0; cls < dfa->classes_len; cls++)
+		{
+			uint32_t ta = a->trans[sa * a->classes_len + cls_a[cls]];
+			uint32_t tb = b->trans[sb * b->classes_len + cls_b[cls]];
+			uint32_t target = RGX_DFA_DEAD;
+			if (ta != RGX_DFA_DEAD && tb != RGX_DFA_DEAD)
+			{
+				pair[0] = (int)ta;
+				pair[1] = (int)tb;
+				target = subset_find(&sub, pair, 2);
+			}
+			dfa->trans[id * dfa->classes_len + cls] = target;
+			if (sub.count > RGX_DFA_MAX_STATES)
+			{
+				ok = false;
+				break;
+			}
+		}
+	}
+	dfa->states = (uint32_t)sub.count;
+	subset_delete(&sub);
+	if (!ok)
+	{
+		LOG("[DFA] State limit reached in product\n");
+		rgx_dfa_delete(&dfa);
+		return NULL;
+	}
+	dfa_prune(dfa);
+	return dfa;
+}
+
+// API --------------------------------------------------
+
+rgx_dfa_t* rgx_dfa_compile(const regex_t* regex)
+{
+	if (!regex)
+		return NULL;
+	rgx_nfa_t nfa = {0};
+	rgx_frag_t frag = nfa_build(&nfa, regex);
+	int match = nfa_state(&nfa, NFA_Match, -1, -1);
+	nfa.states[frag.end].out = match;
+	nfa.start = frag.start;
+	rgx_dfa_t* dfa = nfa.failed ? NULL : dfa_from_nfa(&nfa);
+	nfa_delete(&nfa);
+	LOG("[DFA] Compiled %u states, %u byte classes\n", dfa ? dfa->states : 0, dfa ? dfa->classes_len : 0);
+	return dfa;
+}
+
+rgx_dfa_t* rgx_dfa_compile_search(const regex_t* regex)
+{
+	if (!regex)
+		return NULL;
+	rgx_nfa_t nfa = {0};
+	rgx_frag_t frag = nfa_build(&nfa, regex);
+	int match = nfa_state(&nfa, NFA_Match, -1, -1);
+	nfa.states[frag.end].out = match;
+	// any byte may come before the match: (byte)* regex
+	rgx_byteset_t any;
+	memset(&any, 0xff, sizeof(any));
+	int split = nfa_state(&nfa, NFA_Split, -1, frag.start);
+	int loop = nfa_byte(&nfa, &any, split);
+	nfa.states[split].out = loop;
+	nfa.start = split;
+	rgx_dfa_t* dfa = nfa.failed ? NULL : dfa_from_nfa(&nfa);
+	nfa_delete(&nfa);
+	return dfa;
+}
+
+void rgx_dfa_delete(rgx_dfa_t** dfa)
+{
+	if (!dfa || !*dfa)
+		return;
+	live_delete(&(*dfa)->live);
+	free((*dfa)->trans);
+	free((*dfa)->accept);
+	free(*dfa);
+	*dfa = NULL;
+}
+
+const rgx_live_t* rgx_dfa_live(const rgx_dfa_t* dfa)
+{
+	rgx_live_t** slot = (rgx_live_t**)&dfa->live;
+	rgx_live_t* live = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+	if (!live)
+	{
+		rgx_live_t* built = dfa_live(dfa);
+		rgx_live_t* expected = NULL;
+		if (__atomic_compare_exchange_n(slot, &expected, built, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			live = built;
+		else
+		{
+			live_delete(&built);
+			live = expected;
+		}
+	}
+	return live->states ? live : NULL;
+}
+
+uint32_t rgx_dfa_feed(const rgx_dfa_t* dfa, uint32_t state, str_t input)
+{
+	if (!dfa || state >= dfa->states)
+		return RGX_DFA_DEAD;
+	const unsigned char* it = (const unsigned char*)input.data;
+	const unsigned char* end = it + input.len;
+	while (it < end && state != RGX_DFA_DEAD)
+		state = dfa->trans[state * dfa->classes_len + dfa->classes[*it++]];
+	return state;
+}
+
+bool rgx_dfa_accept(const char* src, const rgx_dfa_t* dfa)
+{
+	if (!src || !dfa)
+		return false;
+	uint32_t state = dfa->start;
+	const unsigned char* it = (const unsigned char*)src;
+	while (*it && state != RGX_DFA_DEAD)
+		state = dfa->trans[state * dfa->classes_len + dfa->classes[*it++]];
+	return *it == 0 && dfa->accept[state];
+}
+
+str_t rgx_dfa_match(const char* src, const rgx_dfa_t* dfa)
+{
+	if (!src || !dfa)
+		return (str_t) { .data = (char*)src, .len = 0 };
+	uint32_t state = dfa->start;
+	size_t length = 0;
+	for (size_t i = 0; state != RGX_DFA_DEAD; i++)
+	{
+		if (dfa->accept[state])
+			length = i;
+		if (src[i] == 0)
+			break;
+		state = dfa->trans[state * dfa->classes_len + dfa->classes[(unsigned char)src[i]]];
+	}
+	return (str_t) { .data = (char*)src, .len = length };
+}
+
+bool rgx_dfa_prefix_viable(const rgx_dfa_t* dfa, str_t input)
+{
+	if (!dfa)
+		return false;
+	return rgx_dfa_feed(dfa, dfa->start, input) != RGX_DFA_DEAD;
+}
@@ -63,6 +63,8 @@ void rgx_tokenize(const char* src, token_stream_t* res)
 	regex_t* star_regex           = rgx_character('*');
 	regex_t* bar_regex            = rgx_character('|');
 	regex_t* plus_regex           = rgx_character('+');
+	regex_t* tilde_regex          = rgx_character('~');
+	regex_t* amp_regex            = rgx_character('&');
 	regex_t* char_set_regex       = rgx_concat(rgx_character('\\'), rgx_character('c'));
 	regex_t* digit_set_regex      = rgx_concat(rgx_character('\\'), rgx_character('d'));
 	regex_t* whitespace_set_regex = rgx_concat(rgx_character('\\'), rgx_character('w'));
@@ -76,6 +78,8 @@ void rgx_tokenize(const char* src, token_stream_t* res)
 	regex_t* star_regex_esc       = rgx_concat(rgx_character('\\'), rgx_character('*'));
 	regex_t* bar_regex_esc        = rgx_concat(rgx_character('\\'), rgx_character('|'));
 	regex_t* plus_regex_esc       = rgx_concat(rgx_character('\\'), rgx_character('+'));
+	regex_t* tilde_regex_esc      = rgx_concat(rgx_character('\\'), rgx_character('~'));
+	regex_t* amp_regex_esc        = rgx_concat(rgx_character('\\'), rgx_character('&'));
 	while (*pointer != 0)
 	{
 		match_res_t lparen_match         = rgx_match_impl(pointer, lparen_regex);
@@ -123,6 +127,24 @@ void rgx_tokenize(const char* src, token_stream_t* res)
 			rgx_ts_append(res, plus);
 			continue;
 		}
+		match_res_t tilde_match          = rgx_match_impl(pointer, tilde_regex);
+		if (tilde_match.succ)
+		{
+			pointer = tilde_match.rem;
+			token_t tilde;
+			tilde.type = Tkn_Tilde;
+			rgx_ts_append(res, tilde);
+			continue;
+		}
+		match_res_t amp_match            = rgx_match_impl(pointer, amp_regex);
+		if (amp_match.succ)
+		{
+			pointer = amp_match.rem;
+			token_t amp;
+			amp.type = Tkn_Amp;
+			rgx_ts_append(res, amp);
+			continue;
+		}
 		match_res_t char_set_match       = rgx_match_impl(pointer, char_set_regex);
 		if (char_set_match.succ)
 		{
@@ -245,6 +267,26 @@ void rgx_tokenize(const char* src, token_stream_t* res)
 			rgx_ts_append(res, esc);
 			continue;
 		}
+		match_res_t tilde_esc_match = rgx_match_impl(pointer, tilde_regex_esc);
+		if (tilde_esc_match.succ)
+		{
+			token_t esc;
+			esc.type = Tkn_Character;
+			esc.value.character = '~';
+			pointer = tilde_esc_match.rem;
+			rgx_ts_append(res, esc);
+			continue;
+		}
+		match_res_t amp_esc_match = rgx_match_impl(pointer, amp_regex_esc);
+		if (amp_esc_match.succ)
+		{
+			token_t esc;
+			esc.type = Tkn_Character;
+			esc.value.character = '&';
+			pointer = amp_esc_match.rem;
+			rgx_ts_append(res, esc);
+			continue;
+		}
 		// nothing matches
 		pointer += 1;
 	}
@@ -266,12 +308,16 @@ void rgx_tokenize(const char* src, token_stream_t* res)
 	rgx_delete(&plus_regex_esc);
 	rgx_delete(&quote_regex);
 	rgx_delete(&quote_set_regex);
+	rgx_delete(&tilde_regex);
+	rgx_delete(&amp_regex);
+	rgx_delete(&tilde_regex_esc);
+	rgx_delete(&amp_regex_esc);
 }
 
 parse_res_t expression(token_node_t* lkd, regex_t* regex)
 {
 	LOG("[PARSER] expression\n");
-	parse_res_t next = term(lkd, regex); 
+	parse_res_t next = intersection(lkd, regex); 
 	parse_res_t res = conjunction(next.stream, next.regex); 
 	if (!res.stream)
 	{
@@ -280,6 +326,14 @@ parse_res_t expression(token_node_t* lkd, regex_t* regex)
 	return res;
 }
 
+parse_res_t intersection(token_node_t* lkd, regex_t* regex)
+{
+	LOG("[PARSER] intersection\n");
+	parse_res_t next = term(lkd, regex); 
+	parse_res_t res = meet(next.stream, next.regex); 
+	return res;
+}
+
 parse_res_t term(token_node_t* lkd, regex_t* regex)
 {
 	LOG("[PARSER] term\n");
@@ -291,6 +345,25 @@ parse_res_t term(token_node_t* lkd, regex_t* regex)
 parse_res_t factor(token_node_t* lkd, regex_t* regex)
 {
 	LOG("[PARSER] factor\n");
+	token_node_t* tilde = expect(lkd, Tkn_Tilde);
+	if (tilde)
+	{
+		LOG("[PARSER] factor found tilde\n");
+		parse_res_t inner = factor(tilde, NULL);
+		if (!inner.stream)
+		{
+			rgx_delete(&inner.regex);
+			return (parse_res_t) {.stream = NULL, .regex = regex};
+		}
+		regex_t* negate = rgx_negate(inner.regex);
+		if (!negate->value.negate.dfa)
+		{
+			LOG("[PARSER] negated automaton too large\n");
+			rgx_delete(&negate);
+			return (parse_res_t) {.stream = NULL, .regex = regex};
+		}
+		return (parse_res_t) {.stream = inner.stream, .regex = negate};
+	}
 	parse_res_t op_res = operand(lkd, regex); 
 	parse_res_t res = length_mod(op_res.stream, op_res.regex); 
 	return res;
@@ -411,7 +484,7 @@ parse_res_t conjunction(token_node_t* lkd, regex_t* regex)
 		if (bar)
 		{
 			LOG("[PARSER] conjunction found bar\n");
-			trm = term(bar, conj);
+			trm = intersection(bar, conj);
 			a = trm.regex;
 			conj = rgx_union(conj, a);
 			bar = expect(trm.stream, Tkn_Bar);
@@ -425,6 +498,33 @@ parse_res_t conjunction(token_node_t* lkd, regex_t* regex)
 	return (parse_res_t) {.stream = lkd, .regex = regex};
 }
 
+parse_res_t meet(token_node_t* lkd, regex_t* regex)
+{
+	LOG("[PARSER] meet\n");
+	regex_t* inter = regex;
+	token_node_t* stream = lkd;
+	token_node_t* amp = expect(lkd, Tkn_Amp);
+	while (amp)
+	{
+		LOG("[PARSER] meet found ampersand\n");
+		parse_res_t trm = term(amp, NULL);
+		if (!trm.stream)
+		{
+			rgx_delete(&trm.regex);
+			return (parse_res_t) {.stream = NULL, .regex = inter};
+		}
+		inter = rgx_intersect(inter, trm.regex);
+		if (!inter->value.inter.dfa)
+		{
+			LOG("[PARSER] product automaton too large\n");
+			return (parse_res_t) {.stream = NULL, .regex = inter};
+		}
+		stream = trm.stream;
+		amp = expect(stream, Tkn_Amp);
+	}
+	return (parse_res_t) {.stream = stream, .regex = inter};
+}
+
 parse_res_t concatenation(token_node_t* lkd, regex_t* regex)
 {
 	LOG("[PARSER] concatenation\n");
@@ -528,6 +628,12 @@ void rgx_print(const token_t* tkn)
 	case Tkn_EndOfInput:
 		printf("$");
 		break;
+	case Tkn_Tilde:
+		printf("[~]");
+		break;
+	case Tkn_Amp:
+		printf("[&]");
+		break;
 	}
 }
 
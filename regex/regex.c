@@ -2,150 +2,458 @@
 #include <stdio.h>
 #include <string.h>
 
-match_res_t match_char(char* src, char c)
+/**
+ * Backtracking tree matcher.
+ *
+ * The regex tree is flattened into a table of nodes. Every node has an
+ * ENTER state, and the repeating nodes (Star, Plus) have a LOOP state that
+ * decides between another iteration and leaving. What happens after a node
+ * matched only depends on its position in the tree, so it is resolved once
+ * into the `leave' state of the node. That makes the pair (state, position)
+ * a complete description of the remaining search: every pair is explored
+ * at most once, which bounds the matcher to O(nodes * input) steps.
+ * Complement and intersection nodes run their automaton one byte per step,
+ * with a state of their own for every DFA state after the node states, so
+ * the bound becomes O((nodes + automaton states) * input).
+ */
+
+#define RGX_BT_ACCEPT (-1)
+#define RGX_BT_LOCAL_NODES 32
+#define RGX_BT_LOCAL_STACK 64
+#define RGX_BT_LOCAL_MEMO 256
+
+#define RGX_BT_ENTER(idx) (2 * (idx))
+#define RGX_BT_LOOP(idx) (2 * (idx) + 1)
+
+typedef enum _rgx_bt_mode_t
 {
-	if (*src == c) return (match_res_t){ .succ = true, .rem = src + 1};
-	else		   return (match_res_t){ .succ = false, .rem = src };
-}
+	RGX_BT_Longest, // longest accepted prefix
+	RGX_BT_Full,    // stop at the first match of the whole input
+	RGX_BT_Prefix,  // stop at the first state alive at the end of the input
+} rgx_bt_mode_t;
+
+typedef struct _rgx_bt_node_t
+{
+	const regex_t* regex;
+	int leave;
+	int a;
+	int b;
+	bool some;    // the language of the node is not empty
+	bool live[2]; // ENTER and LOOP can still reach ACCEPT
+	size_t base;  // automaton nodes: the state of their DFA state 0
+} rgx_bt_node_t;
+
+typedef struct _rgx_bt_state_t
+{
+	int state;
+	size_t pos;
+} rgx_bt_state_t;
 
-match_res_t match_union(char* src, match_res_t a, match_res_t b)
+typedef struct _rgx_bt_t
 {
-	if (a.succ)		 return (match_res_t) { .succ = true, .rem = a.rem };
-	else if (b.succ) return (match_res_t) { .succ = true, .rem = b.rem };
-	else			 return (match_res_t) { .succ = false, .rem = src };
+	const char* src;
+	size_t n; // length limit of src, SIZE_MAX for terminated strings
+	rgx_bt_node_t* nodes;
+	size_t len;
+	size_t states;
+	// node of every automaton state, NULL without automaton nodes
+	int* owner;
+
+	rgx_bt_state_t* stack;
+	size_t top;
+	size_t stack_cap;
+
+	// visited bitset, one row of `states' bits per reached position
+	uint8_t* memo;
+	size_t rows;
+
+	// longest accepted prefix so far
+	bool succ;
+	size_t end;
+	// a state survived until the end of the input
+	bool viable;
+	rgx_bt_mode_t mode;
+
+	rgx_bt_node_t local_nodes[RGX_BT_LOCAL_NODES];
+	rgx_bt_state_t local_stack[RGX_BT_LOCAL_STACK];
+	uint8_t local_memo[RGX_BT_LOCAL_MEMO];
+} rgx_bt_t;
+
+bool rgx_class_has(const regex_t* regex, unsigned char c)
+{
+	switch (regex->type)
+	{
+	case Character:
+		return (unsigned char)regex->value.character == c;
+	case CharSet:
+		return (c >= 'a' && c <= 'z')
+			|| (c >= 'A' && c <= 'Z')
+			|| (c != 0 && strchr(".:,?;-!%@&$/=()<>[]", c) != NULL);
+	case DigitSet:
+		return c >= '0' && c <= '9';
+	case WhitespaceSet:
+		return c == ' ' || c == '\t' || c == '\n';
+	case QuoteSet:
+		return c == '\'' || c == '"' || c == '`';
+	case Wildcard:
+		// except whitespace
+		return c != 0 && c != ' ' && c != '\t' && c != '\n';
+	default:
+		return false;
+	}
 }
 
+size_t rgx_count_nodes(const regex_t* regex)
+{
+	if (!regex)
+		return 0;
+	switch (regex->type)
+	{
+	case Union:
+		return 1 + rgx_count_nodes(regex->value.uni.a) + rgx_count_nodes(regex->value.uni.b);
+	case Concat:
+		return 1 + rgx_count_nodes(regex->value.concat.a) + rgx_count_nodes(regex->value.concat.b);
+	case Star:
+		return 1 + rgx_count_nodes(regex->value.star);
+	case Plus:
+		return 1 + rgx_count_nodes(regex->value.plus);
+	default:
+		return 1;
+	}
+}
 
-match_res_t match_concat(char* src, const regex_t* a, const regex_t* b)
+static int bt_flatten(rgx_bt_t* bt, const regex_t* regex, int leave)
 {
-	match_res_t res_a = rgx_match_impl(src, a);
-	if (res_a.succ)
+	int idx = (int)bt->len++;
+	rgx_bt_node_t* node = &bt->nodes[idx];
+	node->regex = regex;
+	node->leave = leave;
+	node->a = -1;
+	node->b = -1;
+	switch (regex->type)
 	{
-		match_res_t res_b = rgx_match_impl(res_a.rem, b);
-		if (res_b.succ)
-			return (match_res_t) { .succ = true, .rem = res_b.rem };
+	case Union:
+		node->a = bt_flatten(bt, regex->value.uni.a, leave);
+		node->b = bt_flatten(bt, regex->value.uni.b, leave);
+		break;
+	case Concat:
+	{
+		// the right side must exist before the left one can continue into it
+		int b = bt_flatten(bt, regex->value.concat.b, leave);
+		int a = bt_flatten(bt, regex->value.concat.a, RGX_BT_ENTER(b));
+		bt->nodes[idx].a = a;
+		bt->nodes[idx].b = b;
+		break;
+	}
+	case Star:
+		node->a = bt_flatten(bt, regex->value.star, RGX_BT_ENTER(idx));
+		break;
+	case Plus:
+		node->a = bt_flatten(bt, regex->value.plus, RGX_BT_LOOP(idx));
+		break;
+	default:
+		break;
 	}
-	return (match_res_t) { .succ = false, .rem = src };
+	return idx;
 }
 
-match_res_t match_star(char* src, const regex_t* star)
+static const rgx_dfa_t* bt_dfa(const rgx_bt_node_t* node)
 {
-	match_res_t intermed = { .succ = true, .rem = src};
-	do 
+	switch (node->regex->type)
 	{
-		intermed = rgx_match_impl(intermed.rem, star);
-	} while (intermed.succ);
-	return (match_res_t) { .succ = true, .rem = intermed.rem };
+	case Negate:
+		return node->regex->value.negate.dfa;
+	case Intersect:
+		return node->regex->value.inter.dfa;
+	default:
+		return NULL;
+	}
 }
 
-match_res_t match_char_set(char* src)
+static bool bt_live(const rgx_bt_t* bt, int state)
 {
-	// TODO: use the power of ASCII
-	const char* characters = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz.:,?;-!%@&$/=()<>[]";
-	bool searching = true;
-	size_t i = 0;
-	while (searching && i < strlen(characters))
+	if (state == RGX_BT_ACCEPT)
+		return true;
+	// the DFA states are pruned, so what is left of the node can match
+	if ((size_t)state >= 2 * bt->len)
+		return bt->nodes[bt->owner[(size_t)state - 2 * bt->len]].live[1];
+	return bt->nodes[state / 2].live[state % 2];
+}
+
+/**
+ * Complement and intersection can have empty languages, so not every
+ * state of the tree reaches ACCEPT. Children come after their parent in
+ * the table, and a leave state is a parent or the right side of a Concat,
+ * which comes before the left side.
+ */
+static void bt_liveness(rgx_bt_t* bt)
+{
+	for (size_t i = bt->len; i-- > 0;)
+	{
+		rgx_bt_node_t* node = &bt->nodes[i];
+		switch (node->regex->type)
+		{
+		case Union:
+			node->some = bt->nodes[node->a].some || bt->nodes[node->b].some;
+			break;
+		case Concat:
+			node->some = bt->nodes[node->a].some && bt->nodes[node->b].some;
+			break;
+		case Plus:
+			node->some = bt->nodes[node->a].some;
+			break;
+		case Negate:
+		case Intersect:
+			node->some = bt_dfa(node) && bt_dfa(node)->start != RGX_DFA_DEAD;
+			break;
+		default:
+			node->some = true;
+			break;
+		}
+	}
+	for (size_t i = 0; i < bt->len; i++)
 	{
-		if (characters[i] == *src)
-			return (match_res_t) { .succ = true, .rem = src + 1 };
-		i++;
+		rgx_bt_node_t* node = &bt->nodes[i];
+		bool rest = bt_live(bt, node->leave);
+		node->live[0] = node->some && rest;
+		node->live[1] = rest;
 	}
-	return (match_res_t) { .succ = false, .rem = src };
 }
 
-match_res_t match_whitespace_set(char* src)
+static void* bt_grow(void* buffer, void* local, size_t used, size_t size)
 {
-	const char* whitespaces = " \t\n";
-	bool searching = true;
-	size_t i = 0;
-	while (searching && i < strlen(whitespaces))
+	if (buffer == local)
 	{
-		if (whitespaces[i] == *src)
-			return (match_res_t) { .succ = true, .rem = src + 1 };
-		i++;
+		void* heap = malloc(size);
+		memcpy(heap, local, used);
+		return heap;
 	}
-	return (match_res_t) { .succ = false, .rem = src };
+	return realloc(buffer, size);
 }
 
-match_res_t match_digit_set(char* src)
+/**
+ * Numbers the states of the automaton nodes after the node states.
+ */
+static void bt_automata(rgx_bt_t* bt)
 {
-	const char* digits = "0123456789";
-	bool searching = true;
-	size_t i = 0;
-	while (searching && i < strlen(digits))
+	size_t extra = 0;
+	for (size_t i = 0; i < bt->len; i++)
+	{
+		const rgx_dfa_t* dfa = bt_dfa(&bt->nodes[i]);
+		bt->nodes[i].base = extra;
+		extra += dfa ? dfa->states : 0;
+	}
+	bt->owner = extra ? (int*)malloc(extra * sizeof(int)) : NULL;
+	for (size_t i = 0; i < bt->len; i++)
 	{
-		if (digits[i] == *src)
-			return (match_res_t) { .succ = true, .rem = src + 1 };
-		i++;
+		const rgx_dfa_t* dfa = bt_dfa(&bt->nodes[i]);
+		for (uint32_t q = 0; dfa && q < dfa->states; q++)
+			bt->owner[bt->nodes[i].base + q] = (int)i;
 	}
-	return (match_res_t) { .succ = false, .rem = src };
+	bt->states = 2 * bt->len + extra;
 }
 
-match_res_t match_quote_set(char* src)
+static void bt_init(rgx_bt_t* bt, const char* src, size_t n, const regex_t* regex, rgx_bt_mode_t mode)
 {
-	const char* quotes = "'\"`";
-	bool searching = true;
-	size_t i = 0;
-	while (searching && i < strlen(quotes))
+	size_t count = rgx_count_nodes(regex);
+	bt->src = src;
+	bt->n = n;
+	bt->len = 0;
+	bt->nodes = count <= RGX_BT_LOCAL_NODES
+		? bt->local_nodes
+		: (rgx_bt_node_t*)malloc(count * sizeof(rgx_bt_node_t));
+	bt_flatten(bt, regex, RGX_BT_ACCEPT);
+	bt_liveness(bt);
+	bt_automata(bt);
+	bt->stack = bt->local_stack;
+	bt->top = 0;
+	bt->stack_cap = RGX_BT_LOCAL_STACK;
+	bt->memo = bt->local_memo;
+	bt->rows = RGX_BT_LOCAL_MEMO * 8 / bt->states;
+	bt->succ = false;
+	bt->end = 0;
+	bt->viable = false;
+	bt->mode = mode;
+	if (bt->rows == 0)
 	{
-		if (quotes[i] == *src)
-			return (match_res_t) { .succ = true, .rem = src + 1 };
-		i++;
+		bt->rows = 1;
+		bt->memo = (uint8_t*)malloc((bt->states + 7) / 8);
 	}
-	return (match_res_t) { .succ = false, .rem = src };
+	memset(bt->memo, 0, (bt->rows * bt->states + 7) / 8);
+}
+
+static void bt_free(rgx_bt_t* bt)
+{
+	if (bt->nodes != bt->local_nodes)
+		free(bt->nodes);
+	if (bt->stack != bt->local_stack)
+		free(bt->stack);
+	if (bt->memo != bt->local_memo)
+		free(bt->memo);
+	free(bt->owner);
 }
 
-// except whitespace
-match_res_t match_wildcard(char* src)
+static void bt_push(rgx_bt_t* bt, int state, size_t pos)
 {
-	const char* whitespaces = " \t\n";
-	bool searching = true;
-	size_t i = 0;
-	while (searching && i < strlen(whitespaces))
+	if (state == RGX_BT_ACCEPT)
+	{
+		if (!bt->succ || pos > bt->end)
+			bt->end = pos;
+		bt->succ = true;
+		if (pos == bt->n)
+			bt->viable = true;
+		return;
+	}
+	if (!bt_live(bt, state))
+		return;
+	if (pos == bt->n)
+	{
+		// the state can still reach ACCEPT on some input
+		bt->viable = true;
+		if (bt->mode == RGX_BT_Prefix)
+			return;
+	}
+
+	// positions are only reached by consuming input, so the memo grows
+	// with the length of the match instead of the length of the source
+	if (pos >= bt->rows)
 	{
-		if (whitespaces[i] == *src)
-			return (match_res_t) { .succ = false, .rem = src };
-		i++;
+		size_t used = (bt->rows * bt->states + 7) / 8;
+		size_t rows = bt->rows * 2 > pos + 1 ? bt->rows * 2 : pos + 1;
+		size_t size = (rows * bt->states + 7) / 8;
+		bt->memo = (uint8_t*)bt_grow(bt->memo, bt->local_memo, used, size);
+		memset(bt->memo + used, 0, size - used);
+		bt->rows = rows;
 	}
-	return (match_res_t) { .succ = true, .rem = src + 1 };
+	size_t bit = pos * bt->states + (size_t)state;
+	if (bt->memo[bit / 8] & (1u << (bit % 8)))
+		return;
+	bt->memo[bit / 8] |= (uint8_t)(1u << (bit % 8));
+
+	if (bt->top == bt->stack_cap)
+	{
+		bt->stack = (rgx_bt_state_t*)bt_grow(bt->stack, bt->local_stack,
+			bt->top * sizeof(rgx_bt_state_t), 2 * bt->stack_cap * sizeof(rgx_bt_state_t));
+		bt->stack_cap *= 2;
+	}
+	bt->stack[bt->top++] = (rgx_bt_state_t) { .state = state, .pos = pos };
 }
 
-match_res_t match_plus(char* src, const regex_t* plus)
+/**
+ * One byte of an automaton node, from the DFA state of st: an accepting
+ * state continues the search after the node.
+ */
+static void bt_step_dfa(rgx_bt_t* bt, rgx_bt_state_t st)
 {
-	match_res_t first = rgx_match_impl(src, plus);
-	if (first.succ) return match_star(first.rem, plus);
-	else            return (match_res_t) { .succ = false, .rem = src };
+	size_t extra = (size_t)st.state - 2 * bt->len;
+	const rgx_bt_node_t* node = &bt->nodes[bt->owner[extra]];
+	const rgx_dfa_t* dfa = bt_dfa(node);
+	uint32_t state = (uint32_t)(extra - node->base);
+	if (dfa->accept[state])
+		bt_push(bt, node->leave, st.pos);
+	if (st.pos >= bt->n || bt->src[st.pos] == 0)
+		return;
+	uint32_t next = dfa->trans[state * dfa->classes_len + dfa->classes[(unsigned char)bt->src[st.pos]]];
+	if (next != RGX_DFA_DEAD)
+		bt_push(bt, (int)(2 * bt->len + node->base + next), st.pos + 1);
 }
 
-match_res_t rgx_match_impl(char* src, const regex_t* regex)
+static void bt_step(rgx_bt_t* bt, rgx_bt_state_t st)
 {
-	switch (regex->type)
+	if ((size_t)st.state >= 2 * bt->len)
+	{
+		bt_step_dfa(bt, st);
+		return;
+	}
+	const rgx_bt_node_t* node = &bt->nodes[st.state / 2];
+	if (st.state % 2 == 1)
+	{
+		// LOOP of a Plus: another round or leave
+		bt_push(bt, node->leave, st.pos);
+		bt_push(bt, RGX_BT_ENTER(node->a), st.pos);
+		return;
+	}
+	switch (node->regex->type)
 	{
-	case Character:
-		return match_char(src, regex->value.character);
 	case Union:
-		return match_union(src, rgx_match_impl(src, regex->value.uni.a), rgx_match_impl(src, regex->value.uni.b));
+		bt_push(bt, RGX_BT_ENTER(node->b), st.pos);
+		bt_push(bt, RGX_BT_ENTER(node->a), st.pos);
+		break;
 	case Concat:
-		return match_concat(src, regex->value.concat.a, regex->value.concat.b);
+		bt_push(bt, RGX_BT_ENTER(node->a), st.pos);
+		break;
 	case Star:
-		return match_star(src, regex->value.star);
-	case CharSet:
-		return match_char_set(src);
-	case WhitespaceSet:
-		return match_whitespace_set(src);
-	case DigitSet:
-		return match_digit_set(src);
-	case QuoteSet:
-		return match_quote_set(src);
-	case Wildcard:
-		return match_wildcard(src);
+		bt_push(bt, node->leave, st.pos);
+		bt_push(bt, RGX_BT_ENTER(node->a), st.pos);
+		break;
 	case Plus:
-		return match_plus(src, regex->value.plus);
+		bt_push(bt, RGX_BT_ENTER(node->a), st.pos);
+		break;
+	case Negate:
+	case Intersect:
+		// ENTER is only pushed when the DFA has a live start state
+		bt_push(bt, (int)(2 * bt->len + node->base + bt_dfa(node)->start), st.pos);
+		break;
 	default:
-		return (match_res_t) { .succ = false, .rem = src }; 
+	{
+		if (st.pos >= bt->n)
+			break;
+		unsigned char c = (unsigned char)bt->src[st.pos];
+		if (c != 0 && rgx_class_has(node->regex, c))
+			bt_push(bt, node->leave, st.pos + 1);
+		break;
+	}
 	}
 }
 
+static void bt_run(rgx_bt_t* bt)
+{
+	bt_push(bt, RGX_BT_ENTER(0), 0);
+	while (bt->top > 0)
+	{
+		// early exits: nothing found later can change the answer
+		if (bt->mode == RGX_BT_Full && bt->succ && bt->src[bt->end] == 0)
+			break;
+		if (bt->mode == RGX_BT_Prefix && bt->viable)
+			break;
+		bt_step(bt, bt->stack[--bt->top]);
+	}
+}
+
+static match_res_t bt_match(const char* src, size_t n, const regex_t* regex, rgx_bt_mode_t mode)
+{
+	rgx_bt_t bt;
+	bt_init(&bt, src, n, regex, mode);
+	bt_run(&bt);
+	bt_free(&bt);
+	return (match_res_t) { .succ = bt.succ, .rem = (char*)src + bt.end };
+}
+
+match_res_t rgx_match_impl(char* src, const regex_t* regex)
+{
+	if (!src || !regex)
+		return (match_res_t) { .succ = false, .rem = src };
+	return bt_match(src, SIZE_MAX, regex, RGX_BT_Longest);
+}
+
+match_res_t rgx_match_impl_n(char* src, size_t len, const regex_t* regex)
+{
+	if (!src || !regex)
+		return (match_res_t) { .succ = false, .rem = src };
+	return bt_match(src, len, regex, RGX_BT_Longest);
+}
+
+bool rgx_prefix_viable(const regex_t* regex, str_t input)
+{
+	if (!regex || (!input.data && input.len))
+		return false;
+	rgx_bt_t bt;
+	bt_init(&bt, input.data, input.len, regex, RGX_BT_Prefix);
+	bt_run(&bt);
+	bt_free(&bt);
+	return bt.viable;
+}
+
 regex_t* rgx_character(char c)
 {
 	LOG("[REGEX] Allocating Character with %c\n", c);
@@ -182,6 +490,32 @@ regex_t* rgx_star(regex_t* star)
 	return res;
 }
 
+regex_t* rgx_negate(regex_t* inner)
+{
+	LOG("[REGEX] Allocating Negate\n");
+	regex_t* res = malloc(sizeof(regex_t));
+	res->type = Negate;
+	res->value.negate.inner = inner;
+	rgx_dfa_t* dfa = rgx_dfa_compile(inner);
+	res->value.negate.dfa = rgx_dfa_complement(dfa);
+	rgx_dfa_delete(&dfa);
+	return res;
+}
+
+regex_t* rgx_intersect(regex_t* a, regex_t* b)
+{
+	LOG("[REGEX] Allocating Intersect\n");
+	regex_t* res = malloc(sizeof(regex_t));
+	res->type = Intersect;
+	res->value.inter.operands = (regex_pair_t) { .a = a, .b = b };
+	rgx_dfa_t* dfa_a = rgx_dfa_compile(a);
+	rgx_dfa_t* dfa_b = rgx_dfa_compile(b);
+	res->value.inter.dfa = rgx_dfa_intersect(dfa_a, dfa_b);
+	rgx_dfa_delete(&dfa_a);
+	rgx_dfa_delete(&dfa_b);
+	return res;
+}
+
 regex_t* rgx_char_set()
 {
 	LOG("[REGEX] Allocating Character Set\n");
@@ -253,6 +587,19 @@ void rgx_delete(regex_t** regex)
 		rgx_delete(&(*regex)->value.plus);
 		break;
 	}
+	case Negate:
+	{
+		rgx_delete(&(*regex)->value.negate.inner);
+		rgx_dfa_delete(&(*regex)->value.negate.dfa);
+		break;
+	}
+	case Intersect:
+	{
+		rgx_delete(&(*regex)->value.inter.operands.a);
+		rgx_delete(&(*regex)->value.inter.operands.b);
+		rgx_dfa_delete(&(*regex)->value.inter.dfa);
+		break;
+	}
 	default:
 		break;
 	}
@@ -265,9 +612,10 @@ bool rgx_accept(const char* src, const regex_t* regex)
 {
 	if (!regex)
 		return false;
-	match_res_t res = rgx_match_impl((char*)src, regex);
-	size_t length = (size_t)(res.rem - src);
-	if (length == strlen(src)) return res.succ;
+	if (!src)
+		return false;
+	match_res_t res = bt_match(src, SIZE_MAX, regex, RGX_BT_Full);
+	if (*res.rem == 0) return res.succ;
 	else                       return false;
 }
 
@@ -357,6 +705,19 @@ void rgx_print_regex(regex_t* regex, unsigned tab)
 			break;
         case Wildcard:
 			break;
+        case Negate:
+			printf("Negate {\n");
+			rgx_print_regex(regex->value.negate.inner, tab + 2);
+			print_tab(tab);
+			printf("}\n");
+			break;
+        case Intersect:
+			printf("Intersect {\n");
+			rgx_print_regex(regex->value.inter.operands.a, tab + 2);
+			rgx_print_regex(regex->value.inter.operands.b, tab + 2);
+			print_tab(tab);
+			printf("}\n");
+			break;
         }
 }
 
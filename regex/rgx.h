@@ -23,11 +23,17 @@
  *
  * Extended regular expressions:
  *	negating a regex: ~(a|b)
+ *	intersection: \c+ & ~(if|else)
  *	character classes: \c := characters, \d := digits, \w := whitespaces
  *	anchors: ^ab$
  *	escapement: \|, \*
  *	extra quantifiers: a+ := aa*
  *	universal character: _ (just an epsilon transition)
+ *
+ * Negation and intersection are not handled by the tree matcher: their
+ * operands are compiled into DFAs when the node is created, and the
+ * complement / product automaton is stored in the node. The complement
+ * is taken over all byte strings, so ~a also accepts whitespace.
  */
 
 /**
@@ -42,12 +48,13 @@ typedef enum _regex_type_t
     Star,              // 3
 	// EXTENDED REGEX
 	Plus,              // 4
-	// Negate,
 	CharSet,           // 5
 	DigitSet,          // 6
 	WhitespaceSet,     // 7
 	QuoteSet,          // 8
 	Wildcard,          // 9
+	Negate,            // 10
+	Intersect,         // 11
 } regex_type_t;
 
 /**
@@ -60,6 +67,23 @@ typedef struct _regex_pair_t
 	regex_t* b;
 } regex_pair_t;
 
+/**
+ * Operands of the automaton backed nodes, with the automaton built
+ * from them. The automaton is NULL if it exceeded RGX_DFA_MAX_STATES.
+ */
+struct _rgx_dfa_t;
+typedef struct _regex_negate_t
+{
+	regex_t* inner;
+	struct _rgx_dfa_t* dfa;
+} regex_negate_t;
+
+typedef struct _regex_inter_t
+{
+	regex_pair_t operands;
+	struct _rgx_dfa_t* dfa;
+} regex_inter_t;
+
 /**
  * Tagged Union to describe a regular expression.
  * Regex has a tag (regex_type_t), and the union of
@@ -76,9 +100,69 @@ typedef struct _regex_t
 		regex_pair_t concat;
 		struct _regex_t* star;
 		struct _regex_t* plus;
+		regex_negate_t negate;
+		regex_inter_t inter;
 	} value;
 } regex_t;
 
+/**
+ * Deterministic finite automaton compiled from a regex.
+ * The transitions are indexed by byte equivalence classes: bytes that
+ * no part of the regex distinguishes share a column. State 0 is the
+ * dead state: every state that cannot reach an accepting state is
+ * merged into it, so runs stop as soon as they enter it.
+ * live holds the live sets the search functions use to find where
+ * matches start and end (see rgx_live_t). They are built on the first
+ * search and stay NULL until then.
+ */
+#define RGX_DFA_DEAD 0
+#define RGX_DFA_MAX_STATES 4096
+
+typedef struct _rgx_dfa_t
+{
+	uint32_t states;
+	uint32_t start;
+	uint16_t classes_len;
+	uint8_t classes[256];
+	uint32_t* trans;   // states * classes_len
+	bool* accept;
+	struct _rgx_live_t* live;
+} rgx_dfa_t;
+
+/**
+ * Automaton of the live sets of a DFA, that reads the input backwards.
+ * Its state after reading the input from position j to the end is the
+ * set of DFA states from which an accepting state can still be reached
+ * within that part of the input. A DFA run over the input can stop as
+ * soon as it leaves the set of its position: no match ends after that.
+ * The start state is the set of the accepting states.
+ */
+typedef struct _rgx_live_t
+{
+	uint32_t states;
+	uint32_t start;
+	uint32_t* trans; // states * classes_len of the DFA
+	uint64_t* sets;  // states * words: bit s of a row is DFA state s
+	size_t words;
+} rgx_live_t;
+
+/**
+ * Growable output buffer of the replace functions. Zero initialise it
+ * before first use; the data is kept zero terminated.
+ */
+typedef struct _rgx_buffer_t
+{
+	char* data;
+	size_t len;
+	size_t cap;
+} rgx_buffer_t;
+
+/**
+ * Output callback of the streaming replace functions, receives the
+ * pieces of the result in order.
+ */
+typedef void (*rgx_sink_t)(void* ctx, const char* data, size_t len);
+
 /**
  * Multiple return value type for the match functions.
  * Contains a success flag and the remainder of the base
@@ -93,9 +177,37 @@ typedef struct _match_res_t
 // PRIVATE --------------------------------------------------
 /**
  * Implementation of the matching of a regular expression.
+ * Backtracking matcher that interprets the regex tree directly and
+ * returns the longest accepted prefix of src. Every pair of a node or
+ * automaton state and a position is explored at most once, so the worst
+ * case is O((nodes + automaton states) * input length) instead of
+ * exponential.
  */
 match_res_t rgx_match_impl(char* src, const regex_t* regex);
 
+/**
+ * Same as rgx_match_impl, but reads at most len characters of src.
+ */
+match_res_t rgx_match_impl_n(char* src, size_t len, const regex_t* regex);
+
+/**
+ * Returns true if the single character regex (character, set or
+ * wildcard) accepts the character c.
+ */
+bool rgx_class_has(const regex_t* regex, unsigned char c);
+
+/**
+ * Number of nodes in the regex tree.
+ */
+size_t rgx_count_nodes(const regex_t* regex);
+
+/**
+ * Returns the live sets of the DFA, building them on first use. They are
+ * published atomically, so concurrent searches at worst build them twice.
+ * Returns NULL if they would have more than RGX_DFA_MAX_STATES states.
+ */
+const rgx_live_t* rgx_dfa_live(const rgx_dfa_t* dfa);
+
 // API --------------------------------------------------
 /**
  * Function that applies a regular expression to a string source.
@@ -152,6 +264,143 @@ str_t rgx_match_src(const char* src, const char* regex);
  */
 void rgx_delete(regex_t** regex);
 
+/**
+ * Function that decides whether the input can still be completed into
+ * a string the regex accepts, i.e. some extension of it (possibly the
+ * empty one) matches. Meant for validating partial input as it arrives:
+ * once it returns false, no more data can make the input valid.
+ * Errors:
+ * - if regex is NULL, the result will be false.
+ */
+bool rgx_prefix_viable(const regex_t* regex, str_t input);
+
+// DFA --------------------------------------------------
+/**
+ * Function to compile a regex into a DFA.
+ * The DFA is faster than the tree matcher for repeated use, but its
+ * construction is more expensive.
+ * Important: Dynamically allocates memory, free with rgx_dfa_delete.
+ * Errors:
+ * - if regex is NULL or the DFA would have more than
+ *   RGX_DFA_MAX_STATES states, the result will be NULL.
+ */
+rgx_dfa_t* rgx_dfa_compile(const regex_t* regex);
+
+/**
+ * Function to compile a regex into an unanchored DFA, that accepts
+ * every input with a suffix matching the regex. Feeding input byte by
+ * byte, an accepting state means that a match ends at the current byte.
+ * Important: Dynamically allocates memory, free with rgx_dfa_delete.
+ * Errors:
+ * - if regex is NULL or the DFA would have more than
+ *   RGX_DFA_MAX_STATES states, the result will be NULL.
+ */
+rgx_dfa_t* rgx_dfa_compile_search(const regex_t* regex);
+
+/**
+ * Function to free the memory of a DFA.
+ */
+void rgx_dfa_delete(rgx_dfa_t** dfa);
+
+/**
+ * Function that runs the DFA from the given state over the input and
+ * returns the reached state. Stops early when the dead state is reached
+ * (RGX_DFA_DEAD). Can be used to feed the input in pieces, starting
+ * from dfa->start.
+ * Errors:
+ * - if dfa is NULL or state is not a state of the DFA, the result will
+ *   be RGX_DFA_DEAD.
+ */
+uint32_t rgx_dfa_feed(const rgx_dfa_t* dfa, uint32_t state, str_t input);
+
+/**
+ * Same as rgx_accept, with a compiled DFA.
+ */
+bool rgx_dfa_accept(const char* src, const rgx_dfa_t* dfa);
+
+/**
+ * Same as rgx_match, with a compiled DFA: returns the longest prefix
+ * of src that the DFA accepts.
+ */
+str_t rgx_dfa_match(const char* src, const rgx_dfa_t* dfa);
+
+/**
+ * Same as rgx_prefix_viable, with a compiled DFA.
+ */
+bool rgx_dfa_prefix_viable(const rgx_dfa_t* dfa, str_t input);
+
+/**
+ * Function to build the complement of a DFA: it accepts exactly the
+ * byte strings the operand rejects.
+ * Important: Dynamically allocates memory, free with rgx_dfa_delete.
+ */
+rgx_dfa_t* rgx_dfa_complement(const rgx_dfa_t* dfa);
+
+/**
+ * Function to build the product automaton of two DFAs that accepts
+ * the strings accepted by both.
+ * Important: Dynamically allocates memory, free with rgx_dfa_delete.
+ * Errors:
+ * - if the product would have more than RGX_DFA_MAX_STATES states,
+ *   the result will be NULL.
+ */
+rgx_dfa_t* rgx_dfa_intersect(const rgx_dfa_t* a, const rgx_dfa_t* b);
+
+// SEARCH --------------------------------------------------
+/**
+ * Function to find the first non-empty match of the regex anywhere in
+ * the input: the leftmost starting position, and the longest match at
+ * that position. Empty matches are never reported.
+ * Returns true and sets match to a slice of the input when found.
+ * Important: the regex is compiled into a DFA on every call, use
+ * rgx_dfa_search for repeated searches.
+ * Errors:
+ * - if regex or match are NULL, the result will be false.
+ */
+bool rgx_search(const regex_t* regex, str_t input, str_t* match);
+
+/**
+ * Same as rgx_search, with a compiled DFA. The input is read once
+ * backwards for the live sets, then forwards only up to the end of each
+ * match, so searches and replacements take linear time. The live sets
+ * are built on the first search with the DFA.
+ */
+bool rgx_dfa_search(const rgx_dfa_t* dfa, str_t input, str_t* match);
+
+/**
+ * Function that replaces every non-overlapping match of the regex in
+ * the input and appends the result to out. All matches are found in
+ * one pass first, so the buffer is grown at most once, to the exact
+ * size of the result.
+ * Returns the number of replaced matches.
+ * Important: the regex is compiled into a DFA on every call, use
+ * rgx_dfa_replace_all for repeated replacements.
+ */
+size_t rgx_replace_all(const regex_t* regex, str_t input, str_t replacement, rgx_buffer_t* out);
+
+/**
+ * Same as rgx_replace_all, but the result is written to the sink piece
+ * by piece, without any buffering.
+ * Important: the regex is compiled into a DFA on every call, use
+ * rgx_dfa_replace_stream for repeated replacements.
+ */
+size_t rgx_replace_stream(const regex_t* regex, str_t input, str_t replacement, rgx_sink_t sink, void* ctx);
+
+/**
+ * Same as rgx_replace_all, with a compiled DFA.
+ */
+size_t rgx_dfa_replace_all(const rgx_dfa_t* dfa, str_t input, str_t replacement, rgx_buffer_t* out);
+
+/**
+ * Same as rgx_replace_stream, with a compiled DFA.
+ */
+size_t rgx_dfa_replace_stream(const rgx_dfa_t* dfa, str_t input, str_t replacement, rgx_sink_t sink, void* ctx);
+
+/**
+ * Function to free the memory of a replace buffer.
+ */
+void rgx_buffer_delete(rgx_buffer_t* buffer);
+
 // UTIL --------------------------------------------------
 
 /**
@@ -190,6 +439,25 @@ regex_t* rgx_star(regex_t* star);
  */
 regex_t* rgx_plus(regex_t* star);
 
+/**
+ * Function to create a regular expression corresponding to 
+ * the complement of the given regular expression.
+ * Important: Dynamically allocates memory to store the regex and
+ * compiles the operand into a DFA. If the automaton is too large, 
+ * value.negate.dfa is NULL and the regex matches nothing.
+ */
+regex_t* rgx_negate(regex_t* inner);
+
+/**
+ * Function to create a regular expression corresponding to 
+ * the intersection of the given regular expressions: strings
+ * accepted by both.
+ * Important: Dynamically allocates memory to store the regex and
+ * compiles the operands into a product DFA. If the automaton is too
+ * large, value.inter.dfa is NULL and the regex matches nothing.
+ */
+regex_t* rgx_intersect(regex_t* a, regex_t* b);
+
 /**
  * Function to create a regular expression corresponding to 
  * the set of lower and uppercase ASCII characters.
@@ -237,21 +505,29 @@ void rgx_print_regex(regex_t* regex, unsigned tab);
 /**
  * Parser for string representation -> regex structure conversion
  *
- * precedence order () > * = + > ° > |
+ * precedence order () > * = + > ~ > ° > & > |
  * The language for basic regex:
- * <expression> ::= <term> <conjunction>;
+ * <expression> ::= <intersection> <conjunction>;
  *
- * <conjunction> ::= [ '|' <term> ]
+ * <conjunction> ::= [ '|' <intersection> ]
  *				   | <empty>
  *				   ;
  *
+ * <intersection> ::= <term> <meet>;
+ *
+ * <meet> ::= [ '&' <term> ]
+ *          | <empty>
+ *          ;
+ *
  * <term> ::= <factor> <concatenation>;
  *
  * <concatenation> ::= [ <factor> ] 
  *	                 | <empty>
  *	                 ;
  *
- * <factor> ::= <operand> <length_mod>
+ * <factor> ::= '~' <factor>
+ *            | <operand> <length_mod>
+ *            ;
  *
  * <length_mod> ::= '*'
  *                | '+'
@@ -267,6 +543,9 @@ void rgx_print_regex(regex_t* regex, unsigned tab);
  *             ;
  *
  * <character> ::= /\c|\q/;
+ *
+ * '&' is an operator, a literal ampersand is written as \&, a literal
+ * tilde as \~.
  */
 typedef enum _token_type
 {
@@ -281,6 +560,8 @@ typedef enum _token_type
 	Tkn_WhitespaceSet,    // 8
 	Tkn_QuoteSet,         // 9
 	Tkn_EndOfInput,       // 10
+	Tkn_Tilde,            // 11
+	Tkn_Amp,              // 12
 } token_type;
 
 typedef struct _token_t
@@ -323,6 +604,8 @@ regex_t* rgx_compile(const char* src);
 
 // the parser functions
 parse_res_t expression(token_node_t* lkd, regex_t* regex);
+parse_res_t intersection(token_node_t* lkd, regex_t* regex);
+parse_res_t meet(token_node_t* lkd, regex_t* regex);
 parse_res_t term(token_node_t* lkd, regex_t* regex);
 parse_res_t factor(token_node_t* lkd, regex_t* regex);
 parse_res_t operand(token_node_t* lkd, regex_t* regex);
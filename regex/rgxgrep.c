@@ -0,0 +1,362 @@
+#include "rgx.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Tóth Bálint, University of Pannonia
+ * 2023.
+ *
+ * RGXGREP: grep-like search with the regex library.
+ * Prints the lines of the files that contain a match of the pattern,
+ * or the number of such lines with -c.
+ *
+ * Every file is mmapped and cut into chunks at line boundaries; the
+ * chunks are processed by a pool of threads and the results are printed
+ * in file and chunk order. The engine is chosen per pattern, fastest
+ * first: the unanchored DFA (one transition per byte), the anchored DFA
+ * with a search at each line, and the tree matcher.
+ *
+ * --------------------------------------------------------------
+ * Usage:
+ * $> rgxgrep [-c] [-h] [-j threads] pattern file...
+ */
+
+#define CHUNK_SIZE (4u << 20)
+#define MAX_THREADS 64
+
+typedef enum _engine_t
+{
+	Engine_Search,
+	Engine_Dfa,
+	Engine_Tree,
+} engine_t;
+
+typedef struct _grep_file_t
+{
+	const char* path;
+	char* data;
+	size_t len;
+} grep_file_t;
+
+typedef struct _grep_chunk_t
+{
+	size_t file;
+	size_t begin;
+	size_t end;
+	// results
+	size_t count;
+	rgx_buffer_t out;
+} grep_chunk_t;
+
+typedef struct _grep_t
+{
+	engine_t engine;
+	const regex_t* regex;
+	const rgx_dfa_t* dfa;
+	bool count_only;
+	bool prefix;
+
+	grep_file_t* files;
+	grep_chunk_t* chunks;
+	size_t chunks_len;
+	size_t next;
+	pthread_mutex_t lock;
+} grep_t;
+
+static void buffer_append(rgx_buffer_t* out, const char* data, size_t len)
+{
+	if (out->len + len + 1 > out->cap)
+	{
+		size_t cap = out->cap ? 2 * out->cap : 4096;
+		while (cap < out->len + len + 1)
+			cap *= 2;
+		out->data = (char*)realloc(out->data, cap);
+		out->cap = cap;
+	}
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+	out->data[out->len] = 0;
+}
+
+static bool line_matches(const grep_t* grep, const char* line, size_t len)
+{
+	str_t match;
+	switch (grep->engine)
+	{
+	case Engine_Dfa:
+		return grep->dfa->accept[grep->dfa->start]
+			|| rgx_dfa_search(grep->dfa, (str_t) { .data = (char*)line, .len = len }, &match);
+	case Engine_Tree:
+		for (size_t i = 0; i <= len; i++)
+			if (rgx_match_impl_n((char*)line + i, len - i, grep->regex).succ)
+				return true;
+		return false;
+	default:
+		return false;
+	}
+}
+
+static void emit_line(const grep_t* grep, grep_chunk_t* chunk, const char* line, size_t len)
+{
+	chunk->count++;
+	if (grep->count_only)
+		return;
+	if (grep->prefix)
+	{
+		const char* path = grep->files[chunk->file].path;
+		buffer_append(&chunk->out, path, strlen(path));
+		buffer_append(&chunk->out, ":", 1);
+	}
+	buffer_append(&chunk->out, line, len);
+	buffer_append(&chunk->out, "\n", 1);
+}
+
+/**
+ * Unanchored DFA over the whole chunk: the state is reset at every line
+ * start, and the first accepting state decides the line.
+ */
+static void grep_chunk_search(const grep_t* grep, grep_chunk_t* chunk)
+{
+	const rgx_dfa_t* dfa = grep->dfa;
+	const char* data = grep->files[chunk->file].data;
+	const char* it = data + chunk->begin;
+	const char* end = data + chunk->end;
+	while (it < end)
+	{
+		const char* line = it;
+		uint32_t state = dfa->start;
+		bool found = dfa->accept[state];
+		while (!found && it < end && *it != '\n')
+		{
+			state = dfa->trans[state * dfa->classes_len + dfa->classes[(unsigned char)*it++]];
+			found = dfa->accept[state];
+		}
+		const char* eol = it < end ? memchr(it, '\n', (size_t)(end - it)) : NULL;
+		if (!eol)
+			eol = end;
+		if (found)
+			emit_line(grep, chunk, line, (size_t)(eol - line));
+		it = eol + 1;
+	}
+}
+
+static void grep_chunk_lines(const grep_t* grep, grep_chunk_t* chunk)
+{
+	const char* data = grep->files[chunk->file].data;
+	const char* it = data + chunk->begin;
+	const char* end = data + chunk->end;
+	while (it < end)
+	{
+		const char* eol = memchr(it, '\n', (size_t)(end - it));
+		if (!eol)
+			eol = end;
+		if (line_matches(grep, it, (size_t)(eol - it)))
+			emit_line(grep, chunk, it, (size_t)(eol - it));
+		it = eol + 1;
+	}
+}
+
+static void* grep_worker(void* arg)
+{
+	grep_t* grep = (grep_t*)arg;
+	while (true)
+	{
+		pthread_mutex_lock(&grep->lock);
+		size_t idx = grep->next++;
+		pthread_mutex_unlock(&grep->lock);
+		if (idx >= grep->chunks_len)
+			break;
+		if (grep->engine == Engine_Search)
+			grep_chunk_search(grep, &grep->chunks[idx]);
+		else
+			grep_chunk_lines(grep, &grep->chunks[idx]);
+	}
+	return NULL;
+}
+
+static bool map_file(grep_file_t* file)
+{
+	file->data = NULL;
+	file->len = 0;
+	int fd = open(file->path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close(fd);
+		return false;
+	}
+	file->len = (size_t)st.st_size;
+	if (file->len > 0)
+	{
+		void* data = mmap(NULL, file->len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			close(fd);
+			return false;
+		}
+		madvise(data, file->len, MADV_SEQUENTIAL);
+		file->data = (char*)data;
+	}
+	close(fd);
+	return true;
+}
+
+/**
+ * Cuts the files into chunks of about CHUNK_SIZE bytes that end at a
+ * line boundary.
+ */
+static void split_chunks(grep_t* grep, size_t files)
+{
+	size_t cap = files + 16;
+	grep->chunks = (grep_chunk_t*)malloc(cap * sizeof(grep_chunk_t));
+	grep->chunks_len = 0;
+	for (size_t f = 0; f < files; f++)
+	{
+		const grep_file_t* file = &grep->files[f];
+		size_t begin = 0;
+		while (begin < file->len)
+		{
+			size_t end = begin + CHUNK_SIZE;
+			if (end >= file->len)
+				end = file->len;
+			else
+			{
+				const char* eol = memchr(file->data + end, '\n', file->len - end);
+				end = eol ? (size_t)(eol - file->data) + 1 : file->len;
+			}
+			if (grep->chunks_len == cap)
+			{
+				cap *= 2;
+				grep->chunks = (grep_chunk_t*)realloc(grep->chunks, cap * sizeof(grep_chunk_t));
+			}
+			grep->chunks[grep->chunks_len++] = (grep_chunk_t) {
+				.file = f, .begin = begin, .end = end, .count = 0, .out = {NULL, 0, 0},
+			};
+			begin = end;
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: rgxgrep [-c] [-h] [-j threads] pattern file...\n");
+}
+
+int main(int argc, char** argv)
+{
+	grep_t grep = { .count_only = false, .prefix = true };
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool no_prefix = false;
+	int opt;
+	while ((opt = getopt(argc, argv, "chj:")) != -1)
+	{
+		switch (opt)
+		{
+		case 'c':
+			grep.count_only = true;
+			break;
+		case 'h':
+			no_prefix = true;
+			break;
+		case 'j':
+			threads = atol(optarg);
+			break;
+		default:
+			usage();
+			return 2;
+		}
+	}
+	if (argc - optind < 2)
+	{
+		usage();
+		return 2;
+	}
+	if (threads < 1)
+		threads = 1;
+	if (threads > MAX_THREADS)
+		threads = MAX_THREADS;
+
+	regex_t* regex = rgx_compile(argv[optind]);
+	if (!regex)
+	{
+		fprintf(stderr, "rgxgrep: invalid pattern: %s\n", argv[optind]);
+		return 2;
+	}
+	rgx_dfa_t* dfa = rgx_dfa_compile_search(regex);
+	grep.engine = Engine_Search;
+	if (!dfa)
+	{
+		dfa = rgx_dfa_compile(regex);
+		grep.engine = dfa ? Engine_Dfa : Engine_Tree;
+	}
+	grep.regex = regex;
+	grep.dfa = dfa;
+
+	size_t files = (size_t)(argc - optind - 1);
+	grep.prefix = files > 1 && !no_prefix;
+	grep.files = (grep_file_t*)malloc(files * sizeof(grep_file_t));
+	int status = 1;
+	for (size_t f = 0; f < files; f++)
+	{
+		grep.files[f].path = argv[optind + 1 + f];
+		if (!map_file(&grep.files[f]))
+		{
+			fprintf(stderr, "rgxgrep: cannot read %s\n", grep.files[f].path);
+			grep.files[f].len = 0;
+			status = 2;
+		}
+	}
+	split_chunks(&grep, files);
+
+	pthread_t pool[MAX_THREADS];
+	pthread_mutex_init(&grep.lock, NULL);
+	grep.next = 0;
+	if ((size_t)threads > grep.chunks_len)
+		threads = grep.chunks_len ? (long)grep.chunks_len : 1;
+	// the workers share the chunk counter, fewer threads still do all the work
+	long started = 0;
+	while (started < threads && pthread_create(&pool[started], NULL, grep_worker, &grep) == 0)
+		started++;
+	if (started < threads)
+		fprintf(stderr, "rgxgrep: could only start %ld of %ld threads\n", started, threads);
+	if (started == 0)
+		grep_worker(&grep);
+	for (long t = 0; t < started; t++)
+		pthread_join(pool[t], NULL);
+	pthread_mutex_destroy(&grep.lock);
+
+	// results in input order
+	size_t chunk = 0;
+	for (size_t f = 0; f < files; f++)
+	{
+		size_t count = 0;
+		for (; chunk < grep.chunks_len && grep.chunks[chunk].file == f; chunk++)
+		{
+			count += grep.chunks[chunk].count;
+			if (grep.chunks[chunk].out.len)
+				fwrite(grep.chunks[chunk].out.data, 1, grep.chunks[chunk].out.len, stdout);
+			rgx_buffer_delete(&grep.chunks[chunk].out);
+		}
+		if (grep.count_only)
+		{
+			if (grep.prefix) printf("%s:%zu\n", grep.files[f].path, count);
+			else             printf("%zu\n", count);
+		}
+		if (count && status == 1)
+			status = 0;
+		if (grep.files[f].data)
+			munmap(grep.files[f].data, grep.files[f].len);
+	}
+
+	free(grep.chunks);
+	free(grep.files);
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&regex);
+	return status;
+}
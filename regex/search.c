@@ -0,0 +1,343 @@
+#include "rgx.h"
+
+/**
+ * Unanchored search and replacement.
+ *
+ * A match is the longest one at the leftmost position where a non-empty
+ * match starts. Empty matches are never reported, so patterns like a*
+ * only replace actual runs of characters.
+ *
+ * With the live sets of the DFA (see rgx_live_t), one backward pass over
+ * the input keeps the live set at the end of every block of
+ * RGX_LIVE_BLOCK bytes, and the forward pass recomputes the sets of one
+ * block at a time from them. A byte starts a match if the DFA is still
+ * live after reading it, and the run from there stops at the end of the
+ * longest match, so every byte is read a bounded number of times.
+ * Without them, the anchored matcher is tried at every position whose
+ * byte can start a match, which is quadratic when many of them fail late.
+ */
+
+#define RGX_LOCAL_SPANS 64
+#define RGX_LOCAL_MARKS 64
+#define RGX_LIVE_BLOCK 1024
+
+typedef struct _rgx_searcher_t
+{
+	const rgx_dfa_t* dfa;
+	const regex_t* regex;
+	// bytes that can begin a non-empty match
+	bool first[256];
+	// live sets at the end of every block, NULL without them
+	const rgx_live_t* live;
+	str_t input;
+	uint32_t* marks;
+	uint32_t local[RGX_LOCAL_MARKS];
+	// live sets of the positions low..high of the current block
+	size_t low;
+	size_t high;
+	uint32_t window[RGX_LIVE_BLOCK + 1];
+} rgx_searcher_t;
+
+static uint32_t live_step(const rgx_live_t* live, const rgx_dfa_t* dfa, uint32_t state, char c)
+{
+	return live->trans[state * dfa->classes_len + dfa->classes[(unsigned char)c]];
+}
+
+static void searcher_init_dfa(rgx_searcher_t* s, const rgx_dfa_t* dfa, str_t input)
+{
+	s->dfa = dfa;
+	s->regex = NULL;
+	s->live = rgx_dfa_live(dfa);
+	s->marks = NULL;
+	if (s->live)
+	{
+		const rgx_live_t* live = s->live;
+		size_t blocks = (input.len + RGX_LIVE_BLOCK - 1) / RGX_LIVE_BLOCK;
+		s->marks = blocks <= RGX_LOCAL_MARKS ? s->local : (uint32_t*)malloc(blocks * sizeof(uint32_t));
+		s->input = input;
+		s->low = 1;
+		s->high = 0;
+		uint32_t state = live->start;
+		for (size_t b = blocks; b-- > 0;)
+		{
+			s->marks[b] = state;
+			size_t low = b * RGX_LIVE_BLOCK;
+			size_t high = low + RGX_LIVE_BLOCK < input.len ? low + RGX_LIVE_BLOCK : input.len;
+			for (size_t i = high; i-- > low;)
+				state = live_step(live, dfa, state, input.data[i]);
+		}
+		return;
+	}
+	for (unsigned c = 0; c < 256; c++)
+		s->first[c] = dfa->start != RGX_DFA_DEAD
+			&& dfa->trans[dfa->start * dfa->classes_len + dfa->classes[c]] != RGX_DFA_DEAD;
+}
+
+/**
+ * True if a match can still end at or after position pos > 0 of the
+ * input for a DFA run that is in state there.
+ */
+static bool searcher_live(rgx_searcher_t* s, size_t pos, uint32_t state)
+{
+	const rgx_live_t* live = s->live;
+	if (pos < s->low || pos > s->high)
+	{
+		size_t b = (pos - 1) / RGX_LIVE_BLOCK;
+		s->low = b * RGX_LIVE_BLOCK;
+		s->high = s->low + RGX_LIVE_BLOCK < s->input.len ? s->low + RGX_LIVE_BLOCK : s->input.len;
+		s->window[s->high - s->low] = s->marks[b];
+		for (size_t i = s->high; i-- > s->low;)
+			s->window[i - s->low] = live_step(live, s->dfa, s->window[i + 1 - s->low], s->input.data[i]);
+	}
+	uint32_t set = s->window[pos - s->low];
+	return (live->sets[set * live->words + state / 64] >> (state % 64)) & 1;
+}
+
+static void searcher_init_regex(rgx_searcher_t* s, const regex_t* regex)
+{
+	s->dfa = NULL;
+	s->regex = regex;
+	s->live = NULL;
+	s->marks = NULL;
+	for (unsigned c = 0; c < 256; c++)
+	{
+		char one[2] = { (char)c, 0 };
+		s->first[c] = c != 0 && rgx_prefix_viable(regex, (str_t) { .data = one, .len = 1 });
+	}
+}
+
+/**
+ * Length of the longest non-empty match at the start of input, 0 if none.
+ */
+static size_t searcher_anchored(const rgx_searcher_t* s, const char* input, size_t len)
+{
+	if (!s->dfa)
+	{
+		match_res_t res = rgx_match_impl_n((char*)input, len, s->regex);
+		return res.succ ? (size_t)(res.rem - input) : 0;
+	}
+	const rgx_dfa_t* dfa = s->dfa;
+	uint32_t state = dfa->start;
+	size_t best = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		state = dfa->trans[state * dfa->classes_len + dfa->classes[(unsigned char)input[i]]];
+		if (state == RGX_DFA_DEAD)
+			break;
+		if (dfa->accept[state])
+			best = i + 1;
+	}
+	return best;
+}
+
+static void searcher_free(rgx_searcher_t* s)
+{
+	if (s->marks != s->local)
+		free(s->marks);
+}
+
+static bool searcher_next(rgx_searcher_t* s, str_t input, size_t from, str_t* match)
+{
+	if (s->live)
+	{
+		const rgx_dfa_t* dfa = s->dfa;
+		for (size_t i = from; i < input.len; i++)
+		{
+			uint32_t state = dfa->trans[dfa->start * dfa->classes_len + dfa->classes[(unsigned char)input.data[i]]];
+			if (!searcher_live(s, i + 1, state))
+				continue;
+			// live after the first byte, so a match ends at end or later
+			size_t end = i + 1;
+			size_t len = dfa->accept[state] ? 1 : 0;
+			while (end < input.len)
+			{
+				state = dfa->trans[state * dfa->classes_len + dfa->classes[(unsigned char)input.data[end]]];
+				if (!searcher_live(s, ++end, state))
+					break;
+				if (dfa->accept[state])
+					len = end - i;
+			}
+			*match = (str_t) { .data = input.data + i, .len = len };
+			return true;
+		}
+		return false;
+	}
+	const unsigned char* data = (const unsigned char*)input.data;
+	for (size_t i = from; i < input.len; i++)
+	{
+		if (!s->first[data[i]])
+			continue;
+		size_t len = searcher_anchored(s, input.data + i, input.len - i);
+		if (len)
+		{
+			*match = (str_t) { .data = input.data + i, .len = len };
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Collects every match, then writes the result into out with a single
+ * reservation of the exact final size.
+ */
+static size_t replace_all(rgx_searcher_t* s, str_t input, str_t replacement, rgx_buffer_t* out)
+{
+	str_t local[RGX_LOCAL_SPANS];
+	str_t* spans = local;
+	size_t count = 0;
+	size_t cap = RGX_LOCAL_SPANS;
+	size_t matched = 0;
+	str_t match;
+	size_t pos = 0;
+	while (searcher_next(s, input, pos, &match))
+	{
+		if (count == cap)
+		{
+			str_t* grown = (str_t*)malloc(2 * cap * sizeof(str_t));
+			memcpy(grown, spans, count * sizeof(str_t));
+			if (spans != local)
+				free(spans);
+			spans = grown;
+			cap *= 2;
+		}
+		spans[count++] = match;
+		matched += match.len;
+		pos = (size_t)(match.data - input.data) + match.len;
+	}
+
+	size_t size = out->len + input.len - matched + count * replacement.len + 1;
+	if (size > out->cap)
+	{
+		out->data = (char*)realloc(out->data, size);
+		out->cap = size;
+	}
+	char* it = out->data + out->len;
+	const char* prev = input.data;
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t keep = (size_t)(spans[i].data - prev);
+		memcpy(it, prev, keep);
+		it += keep;
+		if (replacement.len)
+			memcpy(it, replacement.data, replacement.len);
+		it += replacement.len;
+		prev = spans[i].data + spans[i].len;
+	}
+	size_t rest = (size_t)(input.data + input.len - prev);
+	memcpy(it, prev, rest);
+	it += rest;
+	*it = 0;
+	out->len = (size_t)(it - out->data);
+
+	if (spans != local)
+		free(spans);
+	return count;
+}
+
+static size_t replace_stream(rgx_searcher_t* s, str_t input, str_t replacement, rgx_sink_t sink, void* ctx)
+{
+	size_t count = 0;
+	size_t pos = 0;
+	str_t match;
+	while (searcher_next(s, input, pos, &match))
+	{
+		size_t start = (size_t)(match.data - input.data);
+		if (start > pos)
+			sink(ctx, input.data + pos, start - pos);
+		if (replacement.len)
+			sink(ctx, replacement.data, replacement.len);
+		pos = start + match.len;
+		count++;
+	}
+	if (pos < input.len)
+		sink(ctx, input.data + pos, input.len - pos);
+	return count;
+}
+
+// API --------------------------------------------------
+
+bool rgx_dfa_search(const rgx_dfa_t* dfa, str_t input, str_t* match)
+{
+	if (!dfa || !match || (!input.data && input.len))
+		return false;
+	rgx_searcher_t s;
+	searcher_init_dfa(&s, dfa, input);
+	bool res = searcher_next(&s, input, 0, match);
+	searcher_free(&s);
+	return res;
+}
+
+bool rgx_search(const regex_t* regex, str_t input, str_t* match)
+{
+	if (!regex || !match || (!input.data && input.len))
+		return false;
+	rgx_dfa_t* dfa = rgx_dfa_compile(regex);
+	rgx_searcher_t s;
+	if (dfa) searcher_init_dfa(&s, dfa, input);
+	else     searcher_init_regex(&s, regex);
+	bool res = searcher_next(&s, input, 0, match);
+	searcher_free(&s);
+	rgx_dfa_delete(&dfa);
+	return res;
+}
+
+size_t rgx_dfa_replace_all(const rgx_dfa_t* dfa, str_t input, str_t replacement, rgx_buffer_t* out)
+{
+	if (!dfa || !out || (!input.data && input.len))
+		return 0;
+	rgx_searcher_t s;
+	searcher_init_dfa(&s, dfa, input);
+	size_t res = replace_all(&s, input, replacement, out);
+	searcher_free(&s);
+	return res;
+}
+
+size_t rgx_dfa_replace_stream(const rgx_dfa_t* dfa, str_t input, str_t replacement, rgx_sink_t sink, void* ctx)
+{
+	if (!dfa || !sink || (!input.data && input.len))
+		return 0;
+	rgx_searcher_t s;
+	searcher_init_dfa(&s, dfa, input);
+	size_t res = replace_stream(&s, input, replacement, sink, ctx);
+	searcher_free(&s);
+	return res;
+}
+
+size_t rgx_replace_all(const regex_t* regex, str_t input, str_t replacement, rgx_buffer_t* out)
+{
+	if (!regex || !out || (!input.data && input.len))
+		return 0;
+	rgx_dfa_t* dfa = rgx_dfa_compile(regex);
+	rgx_searcher_t s;
+	if (dfa) searcher_init_dfa(&s, dfa, input);
+	else     searcher_init_regex(&s, regex);
+	size_t res = replace_all(&s, input, replacement, out);
+	searcher_free(&s);
+	rgx_dfa_delete(&dfa);
+	return res;
+}
+
+size_t rgx_replace_stream(const regex_t* regex, str_t input, str_t replacement, rgx_sink_t sink, void* ctx)
+{
+	if (!regex || !sink || (!input.data && input.len))
+		return 0;
+	rgx_dfa_t* dfa = rgx_dfa_compile(regex);
+	rgx_searcher_t s;
+	if (dfa) searcher_init_dfa(&s, dfa, input);
+	else     searcher_init_regex(&s, regex);
+	size_t res = replace_stream(&s, input, replacement, sink, ctx);
+	searcher_free(&s);
+	rgx_dfa_delete(&dfa);
+	return res;
+}
+
+void rgx_buffer_delete(rgx_buffer_t* buffer)
+{
+	if (!buffer)
+		return;
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->len = 0;
+	buffer->cap = 0;
+}
@@ -75,6 +75,290 @@ int test_quote_set(void)
 	return 1 - (single && doubl && back);
 }
 
+int test_backtrack(void)
+{
+	bool star = rgx_accept_src("aaaa", "a*a");
+	bool plus = rgx_accept_src("abab", "(ab)+ab");
+	bool uni = rgx_accept_src("abc", "(a|ab)c");
+	bool fail = rgx_accept_src("aaa", "a*b");
+	return !(star && plus && uni && !fail);
+}
+
+int test_backtrack_longest(void)
+{
+	str_t match = rgx_match_src("aaab", "(a|aa)*b");
+	str_t prefix = rgx_match_src("abcx", "(a|ab)(c|bcd)");
+	return !(match.len == 4 && prefix.len == 3);
+}
+
+int test_backtrack_pathological(void)
+{
+	char src[4097];
+	memset(src, 'a', 4096);
+	src[4096] = 0;
+	// exponential for a naive backtracker
+	bool acc = rgx_accept_src(src, "(a*)*(a|aa)*b");
+	str_t match = rgx_match_src(src, "(a*a*)*");
+	return acc || match.len != 4096;
+}
+
+int test_prefix_viable(void)
+{
+	regex_t* rgx = rgx_compile("ab*c");
+	bool empty = rgx_prefix_viable(rgx, str_from_cstr(""));
+	bool part = rgx_prefix_viable(rgx, str_from_cstr("abbb"));
+	bool full = rgx_prefix_viable(rgx, str_from_cstr("abbc"));
+	bool dead = rgx_prefix_viable(rgx, str_from_cstr("abx"));
+	bool over = rgx_prefix_viable(rgx, str_from_cstr("abcc"));
+	rgx_delete(&rgx);
+	return !(empty && part && full && !dead && !over);
+}
+
+int test_dfa(void)
+{
+	regex_t* rgx = rgx_compile("(a|b)*abb");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	int res = dfa == NULL;
+	if (dfa)
+	{
+		res += !rgx_dfa_accept("babaabb", dfa);
+		res += rgx_dfa_accept("babaab", dfa);
+		res += rgx_dfa_match("abbabbxy", dfa).len != 6;
+		res += rgx_dfa_match("xabb", dfa).len != 0;
+	}
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_dfa_dead_state(void)
+{
+	regex_t* rgx = rgx_compile("\\d+:\\c*");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	int res = dfa == NULL;
+	if (dfa)
+	{
+		res += !rgx_dfa_prefix_viable(dfa, str_from_cstr("12"));
+		res += rgx_dfa_prefix_viable(dfa, str_from_cstr("12x:abc"));
+		// the run stops in the dead state, the rest is never read
+		uint32_t state = rgx_dfa_feed(dfa, dfa->start, str_from_cstr("x"));
+		res += state != RGX_DFA_DEAD;
+		res += rgx_dfa_feed(dfa, state, str_from_cstr("12:ab")) != RGX_DFA_DEAD;
+		res += rgx_dfa_feed(dfa, dfa->states, str_from_cstr("1")) != RGX_DFA_DEAD;
+	}
+	res += rgx_dfa_feed(NULL, 1, str_from_cstr("1")) != RGX_DFA_DEAD;
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_dfa_long_literal(void)
+{
+	// the NFA grows while the DFA is built, long enough to reallocate
+	regex_t* rgx = rgx_compile("user=u1999999");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	int res = dfa == NULL;
+	if (dfa)
+	{
+		res += !rgx_dfa_accept("user=u1999999", dfa);
+		res += rgx_dfa_accept("user=u1999998", dfa);
+	}
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_negate(void)
+{
+	regex_t* rgx = rgx_compile("~(ab)");
+	int res = rgx == NULL;
+	if (rgx)
+	{
+		res += !rgx_accept("", rgx);
+		res += !rgx_accept("abc", rgx);
+		res += rgx_accept("ab", rgx);
+		res += rgx_match("abc", rgx).len != 3;
+	}
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_intersect(void)
+{
+	// identifier, but not a keyword
+	regex_t* rgx = rgx_compile("\\c(\\c|\\d)* & ~(if|else)");
+	int res = rgx == NULL;
+	if (rgx)
+	{
+		res += !rgx_accept("iff", rgx);
+		res += !rgx_accept("x1", rgx);
+		res += rgx_accept("if", rgx);
+		res += rgx_accept("else", rgx);
+		res += rgx_accept("1x", rgx);
+		res += !rgx_prefix_viable(rgx, str_from_cstr("el"));
+	}
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_intersect_empty(void)
+{
+	// \d&\c has an empty language, nothing after x can match
+	regex_t* rgx = rgx_compile("x(\\d&\\c)|(a&a)(\\d&\\c)|(\\d&\\c)*b");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	int res = rgx == NULL || dfa == NULL;
+	if (dfa)
+	{
+		res += rgx_prefix_viable(rgx, str_from_cstr("x"));
+		res += rgx_dfa_prefix_viable(dfa, str_from_cstr("x"));
+		res += rgx_prefix_viable(rgx, str_from_cstr("a"));
+		res += rgx_dfa_prefix_viable(dfa, str_from_cstr("a"));
+		res += !rgx_prefix_viable(rgx, str_from_cstr(""));
+		res += !rgx_accept("b", rgx);
+		res += rgx_accept("x", rgx);
+	}
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_negate_linear(void)
+{
+	// the complement never dies on a run of 'a', every byte is read once
+	regex_t* rgx = rgx_compile("(~(ab))*");
+	size_t len = 1 << 20;
+	char* run = (char*)malloc(len + 1);
+	memset(run, 'a', len);
+	run[len] = 0;
+	match_res_t res = rgx_match_impl(run, rgx);
+	bool ok = res.succ && res.rem == run + len;
+	run[len / 2] = 'b';
+	ok = ok && rgx_accept(run, rgx);
+	free(run);
+	rgx_delete(&rgx);
+	return !ok;
+}
+
+int test_intersect_dfa(void)
+{
+	// the automaton nodes also work inside larger expressions
+	regex_t* rgx = rgx_compile("(a*&~(aaa))b\\&");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	int res = rgx == NULL || dfa == NULL;
+	if (dfa)
+	{
+		res += !rgx_accept("aab&", rgx);
+		res += rgx_accept("aaab&", rgx);
+		res += !rgx_dfa_accept("aab&", dfa);
+		res += !rgx_dfa_accept("aaaab&", dfa);
+		res += rgx_dfa_accept("aaab&", dfa);
+	}
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_search(void)
+{
+	regex_t* rgx = rgx_compile("\\d+");
+	str_t match = {NULL, 0};
+	bool found = rgx_search(rgx, str_from_cstr("id=abc 1234 x"), &match);
+	bool none = rgx_search(rgx, str_from_cstr("no digits"), &match);
+	rgx_delete(&rgx);
+	return !(found && !none && match.len == 4 && strncmp(match.data, "1234", 4) == 0);
+}
+
+int test_search_starts(void)
+{
+	// the leftmost start wins over the earliest end
+	regex_t* rgx = rgx_compile("abcd|c");
+	rgx_dfa_t* dfa = rgx_dfa_compile(rgx);
+	str_t match = {NULL, 0};
+	int res = dfa == NULL;
+	if (dfa)
+	{
+		// the live sets are left to the first search
+		res += dfa->live != NULL;
+		res += !rgx_dfa_search(dfa, str_from_cstr("xabcd"), &match);
+		res += match.len != 4 || strncmp(match.data, "abcd", 4) != 0;
+		res += dfa->live == NULL;
+		res += !rgx_dfa_search(dfa, str_from_cstr("xabc"), &match);
+		res += match.len != 1 || match.data[0] != 'c';
+	}
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+
+	// a long run that never matches is read once
+	rgx = rgx_compile("\\c*x");
+	dfa = rgx_dfa_compile(rgx);
+	size_t len = 1 << 20;
+	char* run = (char*)malloc(len);
+	memset(run, 'a', len);
+	res += dfa == NULL || rgx_dfa_search(dfa, (str_t) { .data = run, .len = len }, &match);
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+
+	// and so is one where every match could go on to the end
+	rgx = rgx_compile("a|a\\c*b");
+	dfa = rgx_dfa_compile(rgx);
+	rgx_buffer_t out = {NULL, 0, 0};
+	res += dfa == NULL || rgx_dfa_replace_all(dfa, (str_t) { .data = run, .len = len }, str_from_cstr(""), &out) != len;
+	res += out.len != 0;
+	rgx_buffer_delete(&out);
+	free(run);
+	rgx_dfa_delete(&dfa);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_replace_all(void)
+{
+	regex_t* rgx = rgx_compile("pass=\\c*");
+	rgx_buffer_t out = {NULL, 0, 0};
+	size_t count = rgx_replace_all(rgx, str_from_cstr("user=a pass=secret x pass=b"),
+		str_from_cstr("pass=***"), &out);
+	int res = count != 2 || strcmp(out.data, "user=a pass=*** x pass=***") != 0;
+	rgx_buffer_delete(&out);
+	rgx_delete(&rgx);
+	return res;
+}
+
+static void sink_append(void* ctx, const char* data, size_t len)
+{
+	rgx_buffer_t* out = (rgx_buffer_t*)ctx;
+	out->data = realloc(out->data, out->len + len + 1);
+	memcpy(out->data + out->len, data, len);
+	out->len += len;
+	out->data[out->len] = 0;
+}
+
+int test_replace_stream(void)
+{
+	regex_t* rgx = rgx_compile("a*");
+	rgx_buffer_t out = {NULL, 0, 0};
+	// empty matches are not replaced
+	size_t count = rgx_replace_stream(rgx, str_from_cstr("baaac"), str_from_cstr("-"), sink_append, &out);
+	int res = count != 1 || strcmp(out.data, "b-c") != 0;
+	rgx_buffer_delete(&out);
+	rgx_delete(&rgx);
+	return res;
+}
+
+int test_dfa_search(void)
+{
+	regex_t* rgx = rgx_compile("user=u1999999");
+	rgx_dfa_t* search = rgx_dfa_compile_search(rgx);
+	int res = search == NULL;
+	if (search)
+	{
+		res += !rgx_dfa_accept("2023-01-01 user=u1999999", search);
+		res += rgx_dfa_accept("2023-01-01 user=u1999998", search);
+	}
+	rgx_dfa_delete(&search);
+	rgx_delete(&rgx);
+	return res;
+}
+
 RUN_TESTS(
 	TEST (compile), 
 	TEST (compile_err), 
@@ -84,4 +368,21 @@ RUN_TESTS(
 	TEST (accept_err), 
 	TEST (tkn_escape),
 	TEST (quote_set),
+	TEST (backtrack),
+	TEST (backtrack_longest),
+	TEST (backtrack_pathological),
+	TEST (prefix_viable),
+	TEST (dfa),
+	TEST (dfa_dead_state),
+	TEST (dfa_long_literal),
+	TEST (negate),
+	TEST (intersect),
+	TEST (intersect_empty),
+	TEST (negate_linear),
+	TEST (intersect_dfa),
+	TEST (search),
+	TEST (search_starts),
+	TEST (replace_all),
+	TEST (replace_stream),
+	TEST (dfa_search),
 )